@@ -10,23 +10,58 @@
 
 
 /* LIBRARIES */
-#include <stdlib.h>
-#include <stdio.h>
-#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
 #include <time.h>
+#include "otpclient.h"
+#include "otpkey.h"
+#include "otppad.h"
+
+
+/* MACROS */
+#define BACKLOG 5
+#define ACCEPTID "key"
+#define WATERMARK (64 * 1024 * 1024)	// default pool size in characters
+#define GENCHUNK (64 * 1024)			// characters generated per refill step
+#define MAXCLAIM (1024 * 1024 * 1024)	// largest single claim
+#define MAXSERVE 16						// most connections served at once
 
 
 /* STRUCTS AND ENUMS */
-typedef enum bool {FALSE, TRUE} bool;
+// ring of ready-to-use pad, topped up by a generator thread
+typedef struct padpool {
+	char *ring;
+	size_t cap;							// watermark, ring size
+	size_t head;						// next character to hand out
+	size_t fill;						// characters ready
+	pthread_mutex_t lock;
+	pthread_cond_t filled;				// signalled when pad is added
+	pthread_cond_t drained;				// signalled when pad is claimed
+	unsigned long long generated;
+	unsigned long long claimed;
+	unsigned long long stalls;			// claims that had to wait for generator
+	double gentime;						// seconds spent generating
+	int serving;						// connection threads running
+} padpool;
 
 
 /* GLOBAL VARIABLES */
 const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ";
+padpool pool;
 
 
 /* FUNCTION DECLARATIONS */
 bool isPositiveInt(char *arg);
 bool hasValidArgs(int argc, char *arg);
+void * generator(void *arg);
+void claim(char *pad, size_t len);
+void * serve(void *arg);
+void serveconn(int sockfd);
+int service(char *port, size_t watermark);
+int claimpad(char *port, size_t length);
+int poolstats(char *port);
+int container(char *path, size_t length);
+int padfiles(char *list, size_t length, int threads, bool direct);
 
 
 /* FUNCTION DEFINITIONS */
@@ -86,17 +121,452 @@ bool hasValidArgs(int argc, char *arg)
 }
 
 
+/* NAME
+ *  generator
+ * SYNOPSYS
+ * 	background thread, keeps the pool filled up to its watermark
+ */
+void * generator(void *arg)
+{
+	(void) arg;
+	unsigned char raw[OTPPAD_RAW];
+	size_t pos = OTPPAD_RAW;
+	struct timespec t0, t1;
+	char *buf = (char *) malloc(GENCHUNK);
+	if (!buf) {
+		fprintf(stderr, "Error: out of memory for pad.\n");
+		exit(1);
+	}
+
+	while (1)
+	{
+		// wait for room in the ring
+		pthread_mutex_lock(&pool.lock);
+		while (pool.fill >= pool.cap)
+			pthread_cond_wait(&pool.drained, &pool.lock);
+		size_t n = pool.cap - pool.fill;
+		pthread_mutex_unlock(&pool.lock);
+		if (n > GENCHUNK)
+			n = GENCHUNK;
+
+		// generate outside the lock so claims are not held up
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (otppad_fill(buf, n, raw, &pos) == -1)
+			exit(1);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		// append at tail, wrapping around the end of the ring
+		pthread_mutex_lock(&pool.lock);
+		size_t tail = (pool.head + pool.fill) % pool.cap;
+		size_t first = (n < pool.cap - tail) ? n : pool.cap - tail;
+		memcpy(pool.ring + tail, buf, first);
+		memcpy(pool.ring, buf + first, n - first);
+		pool.fill = pool.fill + n;
+		pool.generated = pool.generated + n;
+		pool.gentime = pool.gentime + (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+		pthread_cond_broadcast(&pool.filled);
+		pthread_mutex_unlock(&pool.lock);
+	}
+
+	return NULL;
+}
+
+
+/* NAME
+ *  claim
+ * SYNOPSYS
+ * 	removes len characters of pad from the pool into pad, waiting on
+ *  the generator only if the pool runs dry; claimed pad is wiped
+ *  from the ring so it can never be handed out twice
+ */
+void claim(char *pad, size_t len)
+{
+	size_t got = 0;
+	bool stalled = FALSE;
+
+	pthread_mutex_lock(&pool.lock);
+	while (got < len)
+	{
+		while (pool.fill == 0) {
+			if (!stalled) {
+				pool.stalls++;
+				stalled = TRUE;
+			}
+			pthread_cond_wait(&pool.filled, &pool.lock);
+		}
+
+		size_t n = len - got;
+		if (n > pool.fill)
+			n = pool.fill;
+		if (n > pool.cap - pool.head)
+			n = pool.cap - pool.head;
+
+		memcpy(pad + got, pool.ring + pool.head, n);
+		memset(pool.ring + pool.head, 0, n);
+		pool.head = (pool.head + n) % pool.cap;
+		pool.fill = pool.fill - n;
+		pool.claimed = pool.claimed + n;
+		got = got + n;
+		pthread_cond_signal(&pool.drained);
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	pad[len] = '\0';
+}
+
+
+/* NAME
+ *  serve
+ * SYNOPSYS
+ * 	per-connection thread: verifies id, then answers
+ *  "CLAIM <n>" with n characters of pad and "STATS" with pool metrics
+ */
+void * serve(void *arg)
+{
+	int sockfd = (int) (long) arg;
+
+	serveconn(sockfd);
+	close(sockfd);
+
+	pthread_mutex_lock(&pool.lock);
+	pool.serving--;
+	pthread_mutex_unlock(&pool.lock);
+	return NULL;
+}
+
+
+/* NAME
+ *  serveconn
+ * SYNOPSYS
+ * 	serves the requests of one connection until it closes or fails
+ */
+void serveconn(int sockfd)
+{
+	char *id = otp_recv(sockfd);
+	if (!(id && strcmp(id, ACCEPTID) == 0)) {
+		otp_send(sockfd, "INVALID ID");
+		otpbuf_free(id);
+		return;
+	}
+	otpbuf_free(id);
+	if (otp_send(sockfd, "OK") < 0)
+		return;
+
+	char *req;
+	while ((req = otp_recv(sockfd)) != NULL)
+	{
+		int status = -1;
+		if (strncmp(req, "CLAIM ", 6) == 0) {
+			size_t len = strtoul(req + 6, NULL, 10);
+			if (len > 0 && len <= MAXCLAIM) {
+				char *pad = otpbuf_alloc(len);
+				if (!pad) {
+					fprintf(stderr, "Error: out of memory for claim of %zu.\n", len);
+					otpbuf_free(req);
+					return;
+				}
+				claim(pad, len);
+				status = otp_sendn(sockfd, pad, len);
+				otpbuf_free(pad);
+			}
+		}
+		else if (strcmp(req, "STATS") == 0) {
+			char stats[256];
+			pthread_mutex_lock(&pool.lock);
+			sprintf(stats, "fill %zu\ncapacity %zu\ngenerated %llu\nclaimed %llu\nstalls %llu\nrate %.0f\n",
+				pool.fill, pool.cap, pool.generated, pool.claimed, pool.stalls,
+				pool.gentime > 0 ? pool.generated / pool.gentime : 0.0);
+			pthread_mutex_unlock(&pool.lock);
+			status = otp_send(sockfd, stats);
+		}
+
+		otpbuf_free(req);
+		if (status < 0)
+			break;
+	}
+}
+
+
+/* NAME
+ *  service
+ * SYNOPSYS
+ * 	runs keygen as a pad pool service on port
+ */
+int service(char *port, size_t watermark)
+{
+	if (!isValidPort(strtol(port, NULL, 10))) {
+		fprintf(stderr, "Invalid port number.\n");
+		return 1;
+	}
+
+	// set up pool and start generating before accepting claims
+	pool.ring = (char *) calloc(watermark, sizeof(char));
+	if (!pool.ring) {
+		fprintf(stderr, "Error: out of memory for pool of %zu.\n", watermark);
+		return 1;
+	}
+	pool.cap = watermark;
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.filled, NULL);
+	pthread_cond_init(&pool.drained, NULL);
+
+	pthread_t tid;
+	if (pthread_create(&tid, NULL, generator, NULL) != 0) {
+		fprintf(stderr, "Error: cannot start pad generator.\n");
+		return 1;
+	}
+
+	int listenfd = initialize("127.0.0.1", port, BIND);
+	if (listenfd == -1)
+		return 1;
+	if (listen(listenfd, BACKLOG) == -1) {
+		perror("listen()");
+		return 1;
+	}
+
+	// one thread per connection, up to MAXSERVE at once
+	while (1)
+	{
+		int sockfd = accept(listenfd, NULL, NULL);
+		if (sockfd == -1) {
+			perror("accept()");
+			continue;
+		}
+
+		pthread_mutex_lock(&pool.lock);
+		bool full = (pool.serving >= MAXSERVE);
+		if (!full)
+			pool.serving++;
+		pthread_mutex_unlock(&pool.lock);
+		if (full) {
+			fprintf(stderr, "Error: %d connections, rejecting new connection.\n", MAXSERVE);
+			close(sockfd);
+			continue;
+		}
+
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if (pthread_create(&tid, &attr, serve, (void *) (long) sockfd) != 0) {
+			close(sockfd);
+			pthread_mutex_lock(&pool.lock);
+			pool.serving--;
+			pthread_mutex_unlock(&pool.lock);
+		}
+		pthread_attr_destroy(&attr);
+	}
+
+	return 0;
+}
+
+
+/* NAME
+ *  claimpad
+ * SYNOPSYS
+ * 	claims length characters from a pad pool service and prints
+ *  them like the offline generator does
+ */
+int claimpad(char *port, size_t length)
+{
+	otpc *c = otpc_new_endpoints(port, OTPC_KEY);
+	if (!c) {
+		fprintf(stderr, "Invalid port number.\n");
+		return 1;
+	}
+
+	char *pad = NULL;
+	int status = otpc_claimpad(c, length, &pad);
+	otpc_free(c);
+	if (status != OTPC_OK) {
+		fprintf(stderr, "Error: %s.\n", otpc_strerror(status));
+		return 1;
+	}
+
+	printf("%s\n", pad);
+	otpbuf_free(pad);
+	return 0;
+}
+
+
+/* NAME
+ *  poolstats
+ * SYNOPSYS
+ * 	prints fill level and generation rate of a pad pool service
+ */
+int poolstats(char *port)
+{
+	otpc *c = otpc_new_endpoints(port, OTPC_KEY);
+	if (!c) {
+		fprintf(stderr, "Invalid port number.\n");
+		return 1;
+	}
+
+	char *stats = NULL;
+	int status = otpc_query(c, "STATS", &stats);
+	otpc_free(c);
+	if (status != OTPC_OK) {
+		fprintf(stderr, "Error: %s.\n", otpc_strerror(status));
+		return 1;
+	}
+
+	printf("%s", stats);
+	otpbuf_free(stats);
+	return 0;
+}
+
+
+/* NAME
+ *  container
+ * SYNOPSYS
+ * 	writes length random characters to a key container at path
+ */
+int container(char *path, size_t length)
+{
+	otpkey_writer *w = otpkey_create(path, length);
+	if (!w)
+		return 1;
+
+	unsigned char raw[OTPPAD_RAW];
+	size_t pos = OTPPAD_RAW;
+	size_t done = 0;
+	int status = 0;
+	char *buf = (char *) malloc(GENCHUNK);
+	if (!buf) {
+		fprintf(stderr, "Error: out of memory for key.\n");
+		status = -1;
+	}
+	while (done < length && status == 0)
+	{
+		size_t n = (length - done < GENCHUNK) ? length - done : GENCHUNK;
+		status = otppad_fill(buf, n, raw, &pos);
+		if (status == 0)
+			status = otpkey_write(w, buf, n);
+		done = done + n;
+	}
+	if (buf) {
+		explicit_bzero(buf, GENCHUNK);
+		free(buf);
+	}
+	explicit_bzero(raw, sizeof(raw));
+
+	if (otpkey_finish(w) == -1)
+		status = -1;
+	return (status == 0) ? 0 : 1;
+}
+
+
+/* NAME
+ *  padfiles
+ * SYNOPSYS
+ * 	writes length random characters and a newline to the comma
+ *  separated shard files in list, in parallel (otppad.h)
+ */
+int padfiles(char *list, size_t length, int threads, bool direct)
+{
+	char *paths[OTPPAD_FILES];
+	int files = 0;
+	char *save = NULL;
+	char *path;
+	for (path = strtok_r(list, ",", &save); path; path = strtok_r(NULL, ",", &save)) {
+		if (files == OTPPAD_FILES) {
+			fprintf(stderr, "Error: At most %d pad files.\n", OTPPAD_FILES);
+			return 1;
+		}
+		paths[files++] = path;
+	}
+	if (files == 0) {
+		fprintf(stderr, "Error: No pad file.\n");
+		return 1;
+	}
+	return (otppad_write(paths, files, length, threads, direct) == 0) ? 0 : 1;
+}
+
+
 /* NAME
  *  main
  * SYNOPSYS 
  * 	prints <number> random characters (A-Z or ' ') plus newline
  *  total chars = <number> + 1
+ *  with -s, runs as a pad pool service instead; with -c, claims
+ *  <number> characters from such a service; with -q, prints its stats;
+ *  with -k, writes a key container (otpkey.h) to file instead; with
+ *  -o, writes the same output to files, -j threads at once (default
+ *  one per processor), -d through O_DIRECT, resuming an interrupted run
  * USAGE
  *  keygen <number>
+ *  keygen -k <file> <number>
+ *  keygen -o <file>[,<file>...] [-j <threads>] [-d] <number>
+ *  keygen -s <port> [-w <watermark>]
+ *  keygen -c <port> <number>
+ *  keygen -q <port>
+ *  any form may take [-m <buffer mode>] [-S <socket options>]
  */
 int main(int argc, char *argv[]) {
 	
 	srand(time(NULL));
+
+	// options
+	char *serveport = NULL;
+	char *claimport = NULL;
+	char *keypath = NULL;
+	char *padlist = NULL;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	bool direct = FALSE;
+	size_t watermark = WATERMARK;
+	int opt;
+	while ((opt = getopt(argc, argv, "s:w:c:q:m:S:k:o:j:d")) != -1) {
+		switch (opt)
+		{
+			case 's':		// service mode on port
+				serveport = optarg;
+				break;
+			case 'w':		// pool size for service mode
+				if (!isPositiveInt(optarg) || (watermark = strtoul(optarg, NULL, 10)) == 0) {
+					fprintf(stderr, "Error: Watermark must be positive integer.\n");
+					exit(1);
+				}
+				break;
+			case 'c':		// claim from service on port
+				claimport = optarg;
+				break;
+			case 'k':		// write a key container
+				keypath = optarg;
+				break;
+			case 'o':		// write pad files in parallel
+				padlist = optarg;
+				break;
+			case 'j':		// threads for -o
+				if (!isPositiveInt(optarg) || (threads = atoi(optarg)) < 1 || threads > OTPPAD_THREADS) {
+					fprintf(stderr, "Error: Threads must be 1 to %d.\n", OTPPAD_THREADS);
+					exit(1);
+				}
+				break;
+			case 'd':		// O_DIRECT for -o
+				direct = TRUE;
+				break;
+			case 'q':		// print service stats
+				return poolstats(optarg);
+			case 'S':		// socket options
+				if (otp_setsockopts(optarg) == -1) {
+					fprintf(stderr, "Error: Invalid socket options %s.\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'm':		// buffer pool mode
+				if (otpbuf_setmode(optarg) == -1) {
+					fprintf(stderr, "Error: Invalid buffer mode %s.\n", optarg);
+					exit(1);
+				}
+				break;
+			default:
+				exit(1);
+		}
+	}
+	argc = argc - (optind - 1);
+	argv = argv + (optind - 1);
+
+	if (serveport)
+		return service(serveport, watermark);
 	
 	if (!hasValidArgs(argc, argv[1]))
 	{
@@ -104,10 +574,17 @@ int main(int argc, char *argv[]) {
 	}
 	
 	// convert from str -> int
-	int length = strtol(argv[1], NULL, 10);
+	size_t length = strtoul(argv[1], NULL, 10);
+
+	if (claimport)
+		return claimpad(claimport, length);
+	if (keypath)
+		return container(keypath, length);
+	if (padlist)
+		return padfiles(padlist, length, (threads > OTPPAD_THREADS) ? OTPPAD_THREADS : threads, direct);
 	
 	// loop and print
-	int i;
+	size_t i;
 	for (i = 0; i < length; i++)
 	{
 		int r = rand() % 27;
@@ -117,4 +594,4 @@ int main(int argc, char *argv[]) {
 	printf("\n");
 	
 	return 0;
-}
\ No newline at end of file
+}
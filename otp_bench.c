@@ -0,0 +1,900 @@
+/*
+ * otp_bench.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * micro-benchmarks for library components
+ */
+
+
+/* LIBRARIES */
+#include <dirent.h>
+#include <time.h>
+#include "otpclient.h"
+#include "otpcrc.h"
+#include "otpkey.h"
+#include "otppack.h"
+#include "otpreuse.h"
+
+
+/* MACROS */
+#define SAMPLELEN (8 * 1024 * 1024)		// default synthetic input size
+#define ALLOCLEN (64 * 1024 * 1024)		// default alloc benchmark buffer size
+#define ALLOCROUNDS 20
+#define NETBYTES 32						// default net benchmark message size
+#define NETCOUNT 1000					// default net benchmark requests
+#define REUSELEN 4096					// default reuse benchmark request size
+#define REUSEPAD (256 * 1024 * 1024)	// pad consumed by the reuse benchmark
+#define KEYREQ (1024 * 1024)			// default key benchmark window
+#define BATCHCOUNT 10000				// default batch benchmark messages
+#define KEYFILE (64 * 1024 * 1024)		// key written by the key benchmark
+#define CRCLEN (64 * 1024)				// default crc benchmark buffer size
+#define CRCBYTES (1024UL * 1024 * 1024)	// bytes checksummed per crc benchmark
+#define PACKLEN (64 * 1024)				// default pack benchmark buffer size
+#define PACKBYTES (256UL * 1024 * 1024)	// characters packed per pack benchmark
+#define RESUMELEN (64 * 1024 * 1024)	// default resume benchmark message size
+#define RESUMEKILLS 2					// default daemon children killed
+#define RESUMEGAP 300000				// microseconds between kills
+
+
+/* STRUCTS AND ENUMS */
+// outcome of an asynchronous request
+typedef struct bench_job {
+	volatile int done;
+	int status;
+	char *out;
+} bench_job;
+
+
+/* GLOBAL VARIABLES */
+// common english words, used to build compressible sample text
+const char *words[] = {
+	"THE", "OF", "AND", "TO", "IN", "A", "IS", "THAT", "FOR", "IT", "AS", "WAS",
+	"WITH", "BE", "BY", "ON", "NOT", "HE", "THIS", "ARE", "OR", "HIS", "FROM",
+	"AT", "WHICH", "BUT", "HAVE", "AN", "HAD", "THEY", "YOU", "WERE", "THEIR",
+	"ONE", "ALL", "WE", "CAN", "HER", "HAS", "THERE", "BEEN", "IF", "MORE",
+	"WHEN", "WILL", "WOULD", "WHO", "SO", "NO", "MESSAGE", "KEY", "SERVER",
+	"ATTACK", "AT", "DAWN", "RETREAT", "NORTH", "BRIDGE", "SUPPLIES", "ARRIVE"
+};
+
+
+/* FUNCTION DECLARATIONS */
+double now();
+char * sample_text(size_t len);
+int bench_compress(int argc, char *argv[]);
+int bench_alloc(int argc, char *argv[]);
+int time_crypt(otpc *c, const char *msg, size_t len, int count, double *secs);
+int bench_net(int argc, char *argv[]);
+int bench_shm(int argc, char *argv[]);
+int bench_reuse(int argc, char *argv[]);
+int bench_key(int argc, char *argv[]);
+int bench_batch(int argc, char *argv[]);
+int bench_crc(int argc, char *argv[]);
+int bench_pack(int argc, char *argv[]);
+void job_done(int status, char *result, size_t len, void *arg);
+int kill_children(pid_t parent);
+int bench_resume(int argc, char *argv[]);
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  now
+ * SYNOPSYS
+ * 	monotonic time in seconds
+ */
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/* NAME
+ *  sample_text
+ * SYNOPSYS
+ * 	builds len characters of random english-like words
+ */
+char * sample_text(size_t len)
+{
+	char *text = otpbuf_alloc(len);
+	size_t nwords = sizeof(words) / sizeof(words[0]);
+	size_t pos = 0;
+
+	srand(1);
+	while (pos < len) {
+		const char *w = words[rand() % nwords];
+		while (*w && pos < len)
+			text[pos++] = *w++;
+		if (pos < len)
+			text[pos++] = ' ';
+	}
+
+	text[len] = '\0';
+	return text;
+}
+
+
+/* NAME
+ *  bench_compress
+ * SYNOPSYS
+ * 	measures compression ratio and throughput of otp_compress
+ *  on a file (A-Z or space) or synthetic english text
+ */
+int bench_compress(int argc, char *argv[])
+{
+	char *text = (argc > 0) ? f_tostring(argv[0]) : sample_text(SAMPLELEN);
+	if (!text || !hasValidChars(text)) {
+		fprintf(stderr, "Error: Invalid characters in file.\n");
+		return 1;
+	}
+	size_t len = strlen(text);
+
+	size_t clen, dlen;
+	double t0 = now();
+	char *packed = otp_compress(text, len, &clen);
+	double t1 = now();
+	if (!packed) {
+		fprintf(stderr, "Error: No memory to compress.\n");
+		return 1;
+	}
+	char *unpacked = otp_decompress(packed, clen, &dlen);
+	double t2 = now();
+
+	if (!unpacked || dlen != len || memcmp(text, unpacked, len) != 0) {
+		fprintf(stderr, "Error: round trip mismatch.\n");
+		return 1;
+	}
+
+	printf("input        %zu symbols\n", len);
+	printf("output       %zu symbols (%.1f%% of input, %.2f bits/symbol)\n",
+		clen, 100.0 * clen / len, 14.0 / 3.0 * clen / len);
+	printf("compress     %.1f MB/s\n", len / (t1 - t0) / 1e6);
+	printf("decompress   %.1f MB/s\n", len / (t2 - t1) / 1e6);
+
+	otpbuf_free(text);
+	otpbuf_free(packed);
+	otpbuf_free(unpacked);
+	return 0;
+}
+
+
+/* NAME
+ *  bench_alloc
+ * SYNOPSYS
+ * 	compares a fresh heap buffer per request (allocate, fill, free)
+ *  with the otpbuf pool, for buffers of the given size in bytes
+ */
+int bench_alloc(int argc, char *argv[])
+{
+	size_t len = (argc > 0) ? strtoul(argv[0], NULL, 10) : ALLOCLEN;
+	if (len == 0) {
+		fprintf(stderr, "Error: Size must be positive integer.\n");
+		return 1;
+	}
+	int i;
+
+	// heap: every request pays for page faults on first touch;
+	// wiped before free, as otpbuf_free does
+	double t0 = now();
+	for (i = 0; i < ALLOCROUNDS; i++) {
+		char *buf = (char *) calloc(len + 1, sizeof(char));
+		memset(buf, 'A', len);
+		explicit_bzero(buf, len);
+		free(buf);
+	}
+	double t1 = now();
+
+	// pool: first request maps and prefaults, later ones reuse
+	for (i = 0; i < ALLOCROUNDS; i++) {
+		char *buf = otpbuf_alloc(len);
+		memset(buf, 'A', len);
+		otpbuf_free(buf);
+	}
+	double t2 = now();
+
+	printf("buffer       %zu bytes, %d rounds\n", len, ALLOCROUNDS);
+	printf("heap         %.3f ms/request\n", (t1 - t0) * 1e3 / ALLOCROUNDS);
+	printf("otpbuf       %.3f ms/request\n", (t2 - t1) * 1e3 / ALLOCROUNDS);
+	return 0;
+}
+
+
+/* NAME
+ *  time_crypt
+ * SYNOPSYS
+ * 	times count encryption requests of msg (also the key) on client c,
+ *  after one untimed request to connect
+ *  returns OTPC_OK or the first failure
+ */
+int time_crypt(otpc *c, const char *msg, size_t len, int count, double *secs)
+{
+	char *out = NULL;
+	int i;
+	int status = otpc_crypt(c, msg, len, msg, len, &out);
+	otpbuf_free(out);
+	double t0 = now();
+	for (i = 0; i < count && status == OTPC_OK; i++) {
+		status = otpc_crypt(c, msg, len, msg, len, &out);
+		otpbuf_free(out);
+	}
+	*secs = now() - t0;
+	return status;
+}
+
+
+/* NAME
+ *  bench_net
+ * SYNOPSYS
+ * 	times encryption requests of a given size against a running
+ *  otp_enc_d over one pooled connection, with optional socket options
+ */
+int bench_net(int argc, char *argv[])
+{
+	if (argc < 1) {
+		fprintf(stderr, "Usage: otp_bench net <port> [bytes] [count] [socket options] | reuse [bytes] | shm <port> <unix path> [bytes] [count]\n");
+		return 2;
+	}
+	size_t len = (argc > 1) ? strtoul(argv[1], NULL, 10) : NETBYTES;
+	int count = (argc > 2) ? atoi(argv[2]) : NETCOUNT;
+	if (argc > 3 && otp_setsockopts(argv[3]) == -1) {
+		fprintf(stderr, "Error: Invalid socket options %s.\n", argv[3]);
+		return 2;
+	}
+	if (len == 0 || count <= 0) {
+		fprintf(stderr, "Error: Size and count must be positive integers.\n");
+		return 2;
+	}
+
+	otpc *c = otpc_new_endpoints(argv[0], OTPC_ENC);
+	if (!c) {
+		fprintf(stderr, "Error: Invalid port number %s.\n", argv[0]);
+		return 2;
+	}
+	char *msg = otpbuf_alloc(len);
+	memset(msg, 'A', len);
+
+	// first request connects, the rest reuse the connection
+	double secs;
+	int status = time_crypt(c, msg, len, count, &secs);
+
+	otpbuf_free(msg);
+	otpc_free(c);
+	if (status != OTPC_OK) {
+		fprintf(stderr, "Error: %s.\n", otpc_strerror(status));
+		return 1;
+	}
+
+	printf("requests     %d x %zu bytes\n", count, len);
+	printf("latency      %.1f us/request\n", secs * 1e6 / count);
+	printf("throughput   %.1f MB/s of input\n", (double) len * count / secs / 1e6);
+	return 0;
+}
+
+
+/* NAME
+ *  bench_shm
+ * SYNOPSYS
+ * 	compares encryption requests to one otp_enc_d over TCP, over its
+ *  unix socket, and over a shared memory ring on that socket, one
+ *  request at a time and, for the ring, with every slot in flight
+ */
+int bench_shm(int argc, char *argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: otp_bench shm <port> <unix path> [bytes] [count]\n");
+		return 2;
+	}
+	size_t len = (argc > 2) ? strtoul(argv[2], NULL, 10) : NETBYTES;
+	int count = (argc > 3) ? atoi(argv[3]) : NETCOUNT;
+	if (len == 0 || count <= 0) {
+		fprintf(stderr, "Error: Size and count must be positive integers.\n");
+		return 2;
+	}
+	char *msg = otpbuf_alloc(len);
+	memset(msg, 'A', len);
+
+	// sockets
+	const char *names[] = {"tcp", "unix"};
+	double secs[4];
+	int i, status = OTPC_OK;
+	for (i = 0; i < 2 && status == OTPC_OK; i++) {
+		otpc *c = otpc_new_endpoints(argv[i], OTPC_ENC);
+		if (!c) {
+			fprintf(stderr, "Error: Invalid endpoint %s.\n", argv[i]);
+			return 2;
+		}
+		status = time_crypt(c, msg, len, count, &secs[i]);
+		otpc_free(c);
+	}
+	if (status != OTPC_OK) {
+		fprintf(stderr, "Error: %s %s.\n", names[i - 1], otpc_strerror(status));
+		return 1;
+	}
+
+	otpc_shm *s = otpc_shm_new(argv[1], OTPC_ENC, len);
+	if (!s) {
+		fprintf(stderr, "Error: No ring from daemon at %s.\n", argv[1]);
+		return 1;
+	}
+
+	// ring, one at a time: copy in, wait, copy out
+	char *out = NULL;
+	double t0 = now();
+	for (i = 0; i < count && status == OTPC_OK; i++) {
+		status = otpc_shm_crypt(s, msg, len, msg, &out);
+		otpbuf_free(out);
+	}
+	secs[2] = now() - t0;
+
+	// ring, pipelined: input and key written in place, results read
+	// in place, a new request as soon as a slot frees up
+	int sent = 0, got = 0;
+	t0 = now();
+	while (got < count && status == OTPC_OK) {
+		char *sin, *skey;
+		const char *res;
+		size_t n;
+		if (sent < count && otpc_shm_reserve(s, len, &sin, &skey) == OTPC_OK) {
+			memcpy(sin, msg, len);
+			memcpy(skey, msg, len);
+			otpc_shm_submit(s);
+			sent++;
+		}
+		else {
+			status = otpc_shm_result(s, &res, &n);
+			got++;
+		}
+	}
+	secs[3] = now() - t0;
+	otpc_shm_free(s);
+	otpbuf_free(msg);
+	if (status != OTPC_OK) {
+		fprintf(stderr, "Error: ring %s.\n", otpc_strerror(status));
+		return 1;
+	}
+
+	const char *labels[] = {"tcp", "unix", "ring", "ring piped"};
+	printf("requests     %d x %zu bytes\n", count, len);
+	for (i = 0; i < 4; i++)
+		printf("%-12s %8.1f us/request %8.1f MB/s\n", labels[i], secs[i] * 1e6 / count,
+			(double) len * count / secs[i] / 1e6);
+	return 0;
+}
+
+
+/* NAME
+ *  bench_reuse
+ * SYNOPSYS
+ * 	times the key reuse check on fresh pad of a given request size,
+ *  counts false positives, then checks that reused key is caught
+ *  at the same offset, shifted, and as a short slice
+ */
+int bench_reuse(int argc, char *argv[])
+{
+	size_t len = (argc > 0) ? strtoul(argv[0], NULL, 10) : REUSELEN;
+	if (len < 2 * OTPREUSE_WINDOW) {
+		fprintf(stderr, "Error: Size must be at least %d.\n", 2 * OTPREUSE_WINDOW);
+		return 1;
+	}
+	if (otpreuse_init(OTPREUSE_MB) == -1)
+		return 1;
+
+	// random pad, reused as a ring so the test doesn't hold it all
+	char *text = sample_text(len);
+	char *pad = otpbuf_alloc(len);
+	size_t count = REUSEPAD / len;
+	size_t i, j;
+	double spent = 0;
+	srand(2);
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < len; j++)
+			pad[j] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ "[rand() % 27];
+		double t0 = now();
+		otpreuse_seen(text, pad, len);
+		spent = spent + now() - t0;
+	}
+
+	uint64_t checked, fp;
+	otpreuse_stats(&checked, &fp);
+
+	// last request resent whole, then its key again: on other input,
+	// shifted by a few characters, and a tail
+	int resend = otpreuse_seen(text, pad, len);
+	int same = otpreuse_seen(NULL, pad, len);
+	int shifted = otpreuse_seen(NULL, pad + 7, len - 7);
+	int tail = otpreuse_seen(NULL, pad + len / 2, len / 2);
+
+	printf("requests     %zu x %zu characters\n", count, len);
+	printf("check        %.2f ns/character\n", spent * 1e9 / ((double) count * len));
+	printf("false hits   %lu\n", (unsigned long) fp);
+	printf("reuse        same offset %s, shifted %s, tail %s\n",
+		same ? "caught" : "missed", shifted ? "caught" : "missed", tail ? "caught" : "missed");
+	printf("resend       %s\n", resend ? "flagged" : "not flagged");
+
+	otpbuf_free(text);
+	otpbuf_free(pad);
+	return 0;
+}
+
+
+/* NAME
+ *  bench_key
+ * SYNOPSYS
+ * 	times getting a request's key window from a plain key file (read
+ *  and character scan, as clients did) against a key container (map,
+ *  verify the blocks used), both opening the key per request as
+ *  otp_enc does, and a container kept open
+ */
+int bench_key(int argc, char *argv[])
+{
+	size_t len = (argc > 0) ? strtoul(argv[0], NULL, 10) : KEYREQ;
+	if (len == 0 || len > KEYFILE) {
+		fprintf(stderr, "Error: Size must be 1 to %d.\n", KEYFILE);
+		return 2;
+	}
+	int count = KEYFILE / len;
+	const char *tmp = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+	char plainpath[256], boxpath[256];
+	snprintf(plainpath, sizeof(plainpath), "%s/otp_bench.%d.key", tmp, (int) getpid());
+	snprintf(boxpath, sizeof(boxpath), "%s/otp_bench.%d.kc", tmp, (int) getpid());
+
+	// the same key both ways
+	const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ";
+	char *pad = otpbuf_alloc(KEYFILE);
+	size_t i;
+	for (i = 0; i < KEYFILE; i++)
+		pad[i] = alphabet[rand() % 27];
+	pad[KEYFILE] = '\n';
+	FILE *f = fopen(plainpath, "w");
+	otpkey_writer *w = otpkey_create(boxpath, KEYFILE);
+	if (!f || !w || fwrite(pad, 1, KEYFILE + 1, f) != KEYFILE + 1 || fclose(f) != 0
+			|| otpkey_write(w, pad, KEYFILE) == -1 || otpkey_finish(w) == -1) {
+		fprintf(stderr, "Error: could not write keys to %s.\n", tmp);
+		return 1;
+	}
+	otpbuf_free(pad);
+
+	int bad = 0, n;
+	double t0 = now();
+	for (n = 0; n < count; n++) {
+		char *key = f_tostringn(plainpath, n * len, len);
+		if (!key || strlen(key) != len || !hasValidCharsn(key, len))
+			bad++;
+		otpbuf_free(key);
+	}
+	double tplain = now() - t0;
+
+	t0 = now();
+	for (n = 0; n < count; n++) {
+		size_t got;
+		otpkey *k = otpkey_open(boxpath);
+		if (!k || !otpkey_window(k, n * len, len, &got) || got != len || !k->checked)
+			bad++;
+		otpkey_close(k);
+	}
+	double tbox = now() - t0;
+
+	otpkey *k = otpkey_open(boxpath);
+	t0 = now();
+	for (n = 0; n < count; n++) {
+		size_t got;
+		if (!otpkey_window(k, n * len, len, &got))
+			bad++;
+	}
+	double tfirst = now() - t0;
+	t0 = now();
+	for (n = 0; n < count; n++) {
+		size_t got;
+		if (!otpkey_window(k, n * len, len, &got))
+			bad++;
+	}
+	double tagain = now() - t0;
+	otpkey_close(k);
+	unlink(plainpath);
+	unlink(boxpath);
+
+	printf("requests               %d x %zu characters of a %d character key\n", count, len, KEYFILE);
+	printf("plain, read + scan     %.1f us/request\n", tplain * 1e6 / count);
+	printf("container, map + sums  %.1f us/request\n", tbox * 1e6 / count);
+	printf("container kept open    %.1f us/request first use, %.2f after\n", tfirst * 1e6 / count, tagain * 1e6 / count);
+	if (bad)
+		printf("failed                 %d\n", bad);
+	return bad ? 1 : 0;
+}
+
+
+/* NAME
+ *  bench_batch
+ * SYNOPSYS
+ * 	encrypts count messages of a given size against a running
+ *  otp_enc_d (at -P off) one request each, then all as batches, and
+ *  checks both give the same ciphertext
+ */
+int bench_batch(int argc, char *argv[])
+{
+	if (argc < 1) {
+		fprintf(stderr, "Usage: otp_bench batch <port> [bytes] [count]\n");
+		return 2;
+	}
+	size_t len = (argc > 1) ? strtoul(argv[1], NULL, 10) : NETBYTES;
+	int count = (argc > 2) ? atoi(argv[2]) : BATCHCOUNT;
+	if (len == 0 || count <= 0) {
+		fprintf(stderr, "Error: Size and count must be positive integers.\n");
+		return 2;
+	}
+	otpc *c = otpc_new_endpoints(argv[0], OTPC_ENC);
+	if (!c) {
+		fprintf(stderr, "Error: Invalid port number %s.\n", argv[0]);
+		return 2;
+	}
+
+	size_t total = len * count;
+	char *text = sample_text(total);
+	char *pad = sample_text(total);
+	const char **ins = (const char **) malloc(count * sizeof(char *));
+	size_t *lens = (size_t *) malloc(count * sizeof(size_t));
+	char *each = otpbuf_alloc(total);
+	int i;
+	for (i = 0; i < count; i++) {
+		ins[i] = text + i * len;
+		lens[i] = len;
+	}
+
+	// first request connects
+	char *out = NULL;
+	int status = otpc_crypt(c, text, len, pad, len, &out);
+	otpbuf_free(out);
+	double t0 = now();
+	for (i = 0; i < count && status == OTPC_OK; i++) {
+		status = otpc_crypt(c, ins[i], len, pad + i * len, len, &out);
+		if (status == OTPC_OK)
+			memcpy(each + i * len, out, len);
+		otpbuf_free(out);
+	}
+	double tone = now() - t0;
+
+	char *all = NULL;
+	t0 = now();
+	if (status == OTPC_OK)
+		status = otpc_batch(c, ins, lens, count, pad, total, &all);
+	double tbatch = now() - t0;
+	otpc_free(c);
+	if (status != OTPC_OK) {
+		fprintf(stderr, "Error: %s.\n", otpc_strerror(status));
+		return 1;
+	}
+
+	bool same = (memcmp(all, each, total) == 0) ? TRUE : FALSE;
+	printf("messages     %d x %zu bytes\n", count, len);
+	printf("one each     %.1f us/message, %.0f messages/s\n", tone * 1e6 / count, count / tone);
+	printf("batched      %.2f us/message, %.0f messages/s, %.1f MB/s of input\n", tbatch * 1e6 / count,
+		count / tbatch, total / tbatch / 1e6);
+	printf("same output  %s\n", same ? "yes" : "NO");
+	otpbuf_free(all);
+	otpbuf_free(each);
+	otpbuf_free(text);
+	otpbuf_free(pad);
+	free(ins);
+	free(lens);
+	return same ? 0 : 1;
+}
+
+
+/* NAME
+ *  bench_crc
+ * SYNOPSYS
+ * 	checks otpcrc32c against the table driven version over every
+ *  length and alignment up to 256, then times both over buffers of
+ *  bytes, 1 GB in all
+ */
+int bench_crc(int argc, char *argv[])
+{
+	size_t len = (argc > 0) ? strtoul(argv[0], NULL, 10) : CRCLEN;
+	if (len == 0 || len > CRCBYTES) {
+		fprintf(stderr, "Error: Size must be 1 to %lu.\n", CRCBYTES);
+		return 2;
+	}
+	char *buf = sample_text(len + 256);
+
+	int bad = 0;
+	size_t off, n;
+	for (off = 0; off < 8; off++)
+		for (n = 0; n <= 256; n++)
+			if (otpcrc32c(0, buf + off, n) != otpcrc32c_sw(0, buf + off, n))
+				bad++;
+
+	size_t rounds = CRCBYTES / len, r;
+	uint32_t sum = 0, swsum = 0;
+	double t0 = now();
+	for (r = 0; r < rounds; r++)
+		sum ^= otpcrc32c(r, buf, len);
+	double tauto = now() - t0;
+	t0 = now();
+	for (r = 0; r < rounds; r++)
+		swsum ^= otpcrc32c_sw(r, buf, len);
+	double tsw = now() - t0;
+	if (sum != swsum)
+		bad++;
+	otpbuf_free(buf);
+
+	double gb = (double) rounds * len / 1e9;
+	printf("buffers     %zu x %zu bytes\n", rounds, len);
+	printf("otpcrc32c   %.2f GB/s (%s)\n", gb / tauto, otpcrc32c_hardware() ? "crc32 instruction" : "tables");
+	printf("tables      %.2f GB/s\n", gb / tsw);
+	if (bad) {
+		fprintf(stderr, "Error: %d lengths disagree with the tables.\n", bad);
+		return 1;
+	}
+	return 0;
+}
+
+
+/* NAME
+ *  bench_pack
+ * SYNOPSYS
+ * 	checks otppack and otpunpack against the table driven versions, and
+ *  that one undoes the other, for every length up to 256 at eight
+ *  alignments; that a character outside the alphabet anywhere, or an
+ *  invalid group, is refused; then times both ways over buffers of
+ *  bytes characters, 256M characters in all
+ */
+int bench_pack(int argc, char *argv[])
+{
+	size_t len = (argc > 0) ? strtoul(argv[0], NULL, 10) : PACKLEN;
+	if (len == 0 || len > PACKBYTES) {
+		fprintf(stderr, "Error: Size must be 1 to %lu.\n", PACKBYTES);
+		return 2;
+	}
+	char *buf = sample_text(len + 256);
+	unsigned char *packed = (unsigned char *) otpbuf_alloc(OTPPACK_LEN(len + 256));
+	unsigned char *swpacked = (unsigned char *) otpbuf_alloc(OTPPACK_LEN(len + 256));
+	char *back = otpbuf_alloc(len + 256 + OTPPACK_GROUP);
+	char *swback = otpbuf_alloc(len + 256 + OTPPACK_GROUP);
+
+	int bad = 0;
+	size_t off, n;
+	for (off = 0; off < 8; off++)
+		for (n = 0; n <= 256; n++) {
+			size_t groups = OTPPACK_LEN(n) / OTPPACK_BYTES;
+			if (otppack(buf + off, n, packed) == -1 || otppack_sw(buf + off, n, swpacked) == -1
+					|| memcmp(packed, swpacked, OTPPACK_LEN(n)) != 0
+					|| otpunpack(packed, groups, back) == -1 || otpunpack_sw(packed, groups, swback) == -1
+					|| memcmp(back, swback, groups * OTPPACK_GROUP) != 0
+					|| memcmp(buf + off, back, n) != 0)
+				bad++;
+		}
+	for (n = 0; n < 64; n++) {
+		char was = buf[n];
+		buf[n] = (n & 1) ? 'a' : '@';
+		if (otppack(buf, 64, packed) != -1)
+			bad++;
+		buf[n] = was;
+	}
+	otppack(buf, 64, packed);
+	for (n = 0; n < OTPPACK_LEN(64); n += OTPPACK_BYTES) {
+		unsigned char was = packed[n];
+		packed[n] = 0xff;
+		if (otpunpack(packed, OTPPACK_LEN(64) / OTPPACK_BYTES, back) != -1)
+			bad++;
+		packed[n] = was;
+	}
+
+	size_t rounds = PACKBYTES / len, r;
+	size_t groups = OTPPACK_LEN(len) / OTPPACK_BYTES;
+	double t0 = now();
+	for (r = 0; r < rounds; r++)
+		otppack(buf, len, packed);
+	double tpack = now() - t0;
+	t0 = now();
+	for (r = 0; r < rounds; r++)
+		otpunpack(packed, groups, back);
+	double tunpack = now() - t0;
+	t0 = now();
+	for (r = 0; r < rounds; r++)
+		otppack_sw(buf, len, swpacked);
+	double tswpack = now() - t0;
+	t0 = now();
+	for (r = 0; r < rounds; r++)
+		otpunpack_sw(swpacked, groups, swback);
+	double tswunpack = now() - t0;
+	if (memcmp(buf, back, len) != 0 || memcmp(buf, swback, len) != 0)
+		bad++;
+	otpbuf_free(buf);
+	otpbuf_free((char *) packed);
+	otpbuf_free((char *) swpacked);
+	otpbuf_free(back);
+	otpbuf_free(swback);
+
+	double mb = (double) rounds * len / 1e6;
+	printf("buffers     %zu x %zu characters, %zu bytes packed (%.1f%%)\n",
+		rounds, len, (size_t) OTPPACK_LEN(len), 100.0 * OTPPACK_LEN(len) / len);
+	printf("otppack     %.0f MB/s, otpunpack %.0f MB/s of characters (%s)\n",
+		mb / tpack, mb / tunpack, otppack_vector() ? "SSE4.1" : "tables");
+	printf("tables      %.0f MB/s, %.0f MB/s\n", mb / tswpack, mb / tswunpack);
+	if (bad) {
+		fprintf(stderr, "Error: %d checks failed.\n", bad);
+		return 1;
+	}
+	return 0;
+}
+
+
+/* NAME
+ *  job_done
+ * SYNOPSYS
+ * 	otpc_crypt_async callback: records the outcome in a bench_job
+ */
+void job_done(int status, char *result, size_t len, void *arg)
+{
+	bench_job *j = (bench_job *) arg;
+	(void) len;
+	j->status = status;
+	j->out = result;
+	__atomic_store_n(&j->done, 1, __ATOMIC_RELEASE);
+}
+
+
+/* NAME
+ *  kill_children
+ * SYNOPSYS
+ * 	kills every child process of parent, that is the connections of
+ *  a daemon, found in /proc
+ *  returns how many were killed
+ */
+int kill_children(pid_t parent)
+{
+	DIR *d = opendir("/proc");
+	if (!d)
+		return 0;
+	int killed = 0;
+	struct dirent *e;
+	while ((e = readdir(d)) != NULL) {
+		pid_t pid = atoi(e->d_name);
+		if (pid <= 0)
+			continue;
+		char path[64];
+		char line[512];
+		snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+		FILE *f = fopen(path, "r");
+		if (!f)
+			continue;
+		size_t n = fread(line, 1, sizeof(line) - 1, f);
+		fclose(f);
+		line[n] = '\0';
+
+		// "pid (comm) state ppid ...", comm may hold spaces
+		char *p = strrchr(line, ')');
+		int ppid = 0;
+		if (p && sscanf(p + 1, " %*c %d", &ppid) == 1 && ppid == parent && kill(pid, SIGKILL) == 0)
+			killed++;
+	}
+	closedir(d);
+	return killed;
+}
+
+
+/* NAME
+ *  bench_resume
+ * SYNOPSYS
+ * 	encrypts one message of a given size against a running otp_enc_d
+ *  while killing the daemon's children serving it a given number of
+ *  times, and checks the result against the cipher run in process;
+ *  run the daemon with -P reject, a resend must not count as reuse
+ */
+int bench_resume(int argc, char *argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: otp_bench resume <daemon pid> <port> [bytes] [kills]\n");
+		return 2;
+	}
+	pid_t daemon = atoi(argv[0]);
+	size_t len = (argc > 2) ? strtoul(argv[2], NULL, 10) : RESUMELEN;
+	int kills = (argc > 3) ? atoi(argv[3]) : RESUMEKILLS;
+	if (daemon <= 0 || len == 0 || kills < 0) {
+		fprintf(stderr, "Error: Pid, size and kills must be positive integers.\n");
+		return 2;
+	}
+	otpc *c = otpc_new_endpoints(argv[1], OTPC_ENC);
+	otpc *local = otpc_new_local(OTPC_ENC);
+	if (!c) {
+		fprintf(stderr, "Error: Invalid port number %s.\n", argv[1]);
+		return 2;
+	}
+
+	// fresh pad each run, or a long lived daemon would see it reused
+	char *text = sample_text(len);
+	char *pad = otpbuf_alloc(len);
+	size_t i;
+	srand(time(NULL) ^ getpid());
+	for (i = 0; i < len; i++)
+		pad[i] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ "[rand() % 27];
+	char *want = NULL;
+	otpc_crypt(local, text, len, pad, len, &want);
+
+	bench_job j = {0, OTPC_OK, NULL};
+	double t0 = now();
+	if (otpc_crypt_async(c, text, len, pad, len, job_done, &j) != OTPC_OK) {
+		fprintf(stderr, "Error: Unable to start request.\n");
+		return 1;
+	}
+	int killed = 0;
+	int rounds = 0;
+	while (!__atomic_load_n(&j.done, __ATOMIC_ACQUIRE)) {
+		usleep(RESUMEGAP);
+		// a round counts once it finds a child, the request may not
+		// have connected yet
+		int n = 0;
+		if (rounds < kills && !__atomic_load_n(&j.done, __ATOMIC_ACQUIRE))
+			n = kill_children(daemon);
+		if (n > 0) {
+			killed = killed + n;
+			rounds++;
+		}
+	}
+	double secs = now() - t0;
+
+	bool same = (j.status == OTPC_OK && memcmp(j.out, want, len) == 0) ? TRUE : FALSE;
+	printf("message      %zu characters, %.2f s\n", len, secs);
+	printf("killed       %d children in %d rounds\n", killed, rounds);
+	printf("status       %s\n", j.status == OTPC_OK ? "ok" : otpc_strerror(j.status));
+	printf("same output  %s\n", same ? "yes" : "NO");
+
+	otpc_free(c);
+	otpc_free(local);
+	otpbuf_free(j.out);
+	otpbuf_free(want);
+	otpbuf_free(text);
+	otpbuf_free(pad);
+	return same ? 0 : 1;
+}
+
+
+/* NAME
+ *  main
+ * SYNOPSYS
+ * 	runs the named benchmark
+ * USAGE
+ *  otp_bench compress [file]
+ *  otp_bench alloc [bytes]
+ *  otp_bench net <port> [bytes] [count] [socket options]
+ *  otp_bench reuse [bytes]
+ *  otp_bench shm <port> <unix path> [bytes] [count]
+ *  otp_bench key [bytes]
+ *  otp_bench batch <port> [bytes] [count]
+ *  otp_bench crc [bytes]
+ *  otp_bench pack [bytes]
+ *  otp_bench resume <daemon pid> <port> [bytes] [kills]
+ */
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: otp_bench compress [file] | alloc [bytes] | net <port> [bytes] [count] [socket options]\n");
+		exit(2);
+	}
+
+	if (strcmp(argv[1], "compress") == 0)
+		return bench_compress(argc - 2, argv + 2);
+	if (strcmp(argv[1], "alloc") == 0)
+		return bench_alloc(argc - 2, argv + 2);
+	if (strcmp(argv[1], "net") == 0)
+		return bench_net(argc - 2, argv + 2);
+	if (strcmp(argv[1], "reuse") == 0)
+		return bench_reuse(argc - 2, argv + 2);
+	if (strcmp(argv[1], "shm") == 0)
+		return bench_shm(argc - 2, argv + 2);
+	if (strcmp(argv[1], "key") == 0)
+		return bench_key(argc - 2, argv + 2);
+	if (strcmp(argv[1], "batch") == 0)
+		return bench_batch(argc - 2, argv + 2);
+	if (strcmp(argv[1], "crc") == 0)
+		return bench_crc(argc - 2, argv + 2);
+	if (strcmp(argv[1], "pack") == 0)
+		return bench_pack(argc - 2, argv + 2);
+	if (strcmp(argv[1], "resume") == 0)
+		return bench_resume(argc - 2, argv + 2);
+
+	fprintf(stderr, "Error: Unknown benchmark %s.\n", argv[1]);
+	return 2;
+}
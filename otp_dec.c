@@ -10,24 +10,30 @@
 
 
 /* LIBRARIES */
-#include "otplib.h"
-
-
-/* MACROS */
-#define MYID "dec"
+#include <ctype.h>
+#include <getopt.h>
+#include "otpclient.h"
+#include "otpkey.h"
 
 
 /* GLOBAL VARIABLES */
-int sockfd = 0;							// file descriptor for socket
-char *reply = NULL;						// server response to id
+struct option longopts[] = {
+	{"key-offset", required_argument, NULL, 'o'},
+	{"ledger", required_argument, NULL, 'l'},
+	{"local", no_argument, NULL, 'L'},
+	{NULL, 0, NULL, 0}
+};
+otpc *client = NULL;					// connection to daemon
 char *plain = NULL;						// contents of plaintext
-char *key = NULL;						// contents of key
+otpkey *keyfile = NULL;					// key file, mapped
+const char *key = NULL;					// key window, in keyfile
 char *code = NULL;						// encoded message
 
 
 /* FUNCTION DECLARATIONS */
 void memclean();
 void closesock();
+int daemonstats(char *port);
 
 
 /* FUNCTION DEFINITIONS */
@@ -37,14 +43,11 @@ void closesock();
  * 	frees dynamic memory
  */
 void memclean() {
-	if (reply)
-		free(reply);
 	if (plain)
-		free(plain);
-	if (key)
-		free(key);
+		otpbuf_free(plain);
+	otpkey_close(keyfile);
 	if (code)
-		free(code);
+		otpbuf_free(code);
 }
 
 
@@ -54,8 +57,34 @@ void memclean() {
  * 	closes sockets
  */
 void closesock() {
-	if (sockfd > 0)
-		close(sockfd);
+	if (client)
+		otpc_free(client);
+}
+
+
+/* NAME
+ *  daemonstats
+ * SYNOPSYS 
+ * 	prints per lane request counts and latencies of a daemon
+ */
+int daemonstats(char *port) {
+	otpc *c = otpc_new_endpoints(port, OTPC_STATS);
+	if (!c) {
+		fprintf(stderr, "Invalid port number.\n");
+		return 1;
+	}
+
+	char *stats = NULL;
+	int status = otpc_query(c, "STATS", &stats);
+	otpc_free(c);
+	if (status != OTPC_OK) {
+		fprintf(stderr, "Error: %s.\n", otpc_strerror(status));
+		return 1;
+	}
+
+	printf("%s", stats);
+	otpbuf_free(stats);
+	return 0;
 }
 
 
@@ -65,7 +94,22 @@ void closesock() {
  * 	simple client - connects, sends ciphertext and key,
  *  receives back and prints cipher
  * USAGE
- *  otp_enc <ciphertext file> <key file> <port num>
+ *  otp_dec [-z] [-m <buffer mode>] [-S <socket options>] [-g <seconds>]
+ *         [-o | --key-offset <offset> | -l | --ledger <file>]
+ *         <ciphertext file> <key file> <port num | endpoint list>
+ *  otp_dec --local [options] <ciphertext file> <key file> [<endpoint list>]
+ *  otp_dec -q <port num | socket path>
+ *  a <ciphertext file> of - reads stdin and streams the result to stdout
+ *  endpoint list: comma separated port, host:port or [ipv6]:port,
+ *  requests go to the least loaded healthy endpoint
+ *  only the key characters [offset, offset + length) are read and sent;
+ *  a ledger file holds the next unused offset and is advanced past the
+ *  key used, so one pad serves many messages; a key container from
+ *  keygen -k is mapped and only the blocks used are verified; with
+ *  -q, prints the daemon's lane stats; a connection lost part way is
+ *  replaced for up to -g seconds (default 10, 0 none) and what was not
+ *  answered sent again; with --local no daemon is used, the
+ *  cipher runs in this process and any endpoint list is ignored
  */
 int main(int argc, char *argv[]) {
 	
@@ -73,73 +117,141 @@ int main(int argc, char *argv[]) {
 	atexit(memclean);
 	atexit(closesock);
 	
-	// variables
-	int status = -5;
-	char port[8];
-	memset(port, '\0', sizeof(port));
+	// options
+	bool compress = FALSE;
+	size_t keyoff = 0;
+	char *ledger = NULL;
+	int resume = OTPC_RESUME;
+	bool local = FALSE;
+	int opt;
+	while ((opt = getopt_long(argc, argv, "zm:o:l:S:q:g:", longopts, NULL)) != -1) {
+		switch (opt)
+		{
+			case 'z':		// decompress plaintext after decrypting
+				compress = TRUE;
+				break;
+			case 'm':		// buffer pool mode
+				if (otpbuf_setmode(optarg) == -1) {
+					fprintf(stderr, "Error: Invalid buffer mode %s.\n", optarg);
+					exit(2);
+				}
+				break;
+			case 'S':		// socket options
+				if (otp_setsockopts(optarg) == -1) {
+					fprintf(stderr, "Error: Invalid socket options %s.\n", optarg);
+					exit(2);
+				}
+				break;
+			case 'o':		// first key character to use
+				if (!isdigit(optarg[0])) {
+					fprintf(stderr, "Error: Key offset must be non-negative integer.\n");
+					exit(2);
+				}
+				keyoff = strtoull(optarg, NULL, 10);
+				break;
+			case 'l':		// ledger file holding next key offset
+				ledger = optarg;
+				break;
+			case 'g':		// seconds to resume a broken transfer for
+				if (!isdigit(optarg[0])) {
+					fprintf(stderr, "Error: Resume period must be non-negative integer.\n");
+					exit(2);
+				}
+				resume = atoi(optarg);
+				break;
+			case 'L':		// cipher in process, no daemon
+				local = TRUE;
+				break;
+			case 'q':		// print daemon stats
+				return daemonstats(optarg);
+			default:
+				exit(2);
+		}
+	}
+	argc = argc - (optind - 1);
+	argv = argv + (optind - 1);
 	
-	// check that program was executed with 4 arguments
-	if (argc != 4) {
+	// check that program was executed with 3 positional arguments,
+	// the endpoint list may be left out with --local
+	if (argc != 4 && !(local && argc == 3)) {
 		fprintf(stderr, "Incorrect number of arguments.\n");
 		exit(2);
 	}
 	
-	// get ciphertext and key from file
-	code = f_tostring(argv[1]);
-	if (!code)
-		exit(1);
-	key = f_tostring(argv[2]);
-	if (!key)
-		exit(1);
-	
-	// error checking: valid characters, length
-	if (!(hasValidChars(code) && hasValidChars(key))) {
-		fprintf(stderr, "Error: Invalid characters in file.\n");
-		exit(1);
+	// get ciphertext from file, unless streaming
+	bool stream = (strcmp(argv[1], "-") == 0) ? TRUE : FALSE;
+	if (stream && compress) {
+		fprintf(stderr, "Error: -z needs the whole ciphertext, not -.\n");
+		exit(2);
 	}
-	if (strlen(code) > strlen(key)) {
-		fprintf(stderr, "Error: Key too short.\n");
-		exit(1);
+	if (!stream) {
+		code = f_tostring(argv[1]);
+		if (!code)
+			exit(1);
 	}
 	
-	// get port as string
-	strcpy(port, argv[3]);
-	
-	// check for valid port number
-	if (!isValidPort(atoi(port))) {
-		fprintf(stderr, "Error: Unable to connect. Invalid port number %s.\n", port);
-		exit(2);
+	// get only the key window needed
+	int ledgerfd = -1;
+	if (ledger && (ledgerfd = ledger_open(ledger, &keyoff)) == -1)
+		exit(1);
+	keyfile = otpkey_open(argv[2]);
+	if (!keyfile)
+		exit(1);
+	size_t keylen = 0;
+	if (!stream) {
+		key = otpkey_window(keyfile, keyoff, strlen(code), &keylen);
+		if (!key)
+			exit(1);
 	}
 	
-	// connect, get socket file descriptor
-	sockfd = initialize("localhost", port, CONNECT);
-	if (sockfd == -1) {
+	// check for valid port numbers
+	client = local ? otpc_new_local(OTPC_DEC) : otpc_new_endpoints(argv[3], OTPC_DEC);
+	if (!client) {
+		fprintf(stderr, "Error: Unable to connect. Invalid port number %s.\n", argv[3]);
 		exit(2);
 	}
+	otpc_setcompress(client, compress);
+	otpc_setkeychecked(client, keyfile->checked);
+	otpc_setresume(client, resume);
 	
-	// authenticate, send id, wait for reply
-	otp_send(sockfd, MYID);
-	reply = otp_recv(sockfd);
-	if (!(reply && strcmp(reply, "OK") == 0)) {
-		fprintf(stderr, "Error: ID mismatch, connection to port %s rejected.\n", port);
-		fprintf(stderr, "(Specifically, otp_dec cannot connect to otp_enc_d.)\n");
-		exit(2);
+	// send ciphertext, key, receive reply; or stream stdin to stdout
+	size_t used = 0;
+	int status;
+	if (stream)
+		status = otpc_stream(client, 0, 1, keyfile->fd, (keyfile->data - keyfile->map) + keyoff, &used);
+	else {
+		status = otpc_crypt(client, code, strlen(code), key, keylen, &plain);
+		if (status == OTPC_OK)
+			used = strlen(code);			// key used is the length of the ciphertext
 	}
 	
-	// send ciphertext, key
-	if ((status = otp_send(sockfd, code)) < 0) {
-		fprintf(stderr, "Error: otp_send() unable to send ciphertext\n");
+	// a partial stream has spent its key too
+	if (ledgerfd != -1 && used > 0 && ledger_close(ledgerfd, keyoff + used) == -1)
 		exit(1);
+	switch (status)
+	{
+		case OTPC_OK:
+			printf("%s\n", stream ? "" : plain);
+			break;
+		case OTPC_ECHARS:
+		case OTPC_EKEY:
+		case OTPC_ECOMP:
+		case OTPC_ESIZE:
+		case OTPC_EBUSY:
+		case OTPC_ERATE:
+		case OTPC_EREUSE:
+			fprintf(stderr, "Error: %s.\n", otpc_strerror(status));
+			exit(1);
+		case OTPC_EIO:
+			fprintf(stderr, "Error: unable to send ciphertext and key\n");
+			exit(1);
+		case OTPC_EREJECT:
+			fprintf(stderr, "Error: ID mismatch, connection to port %s rejected.\n", argv[3]);
+			fprintf(stderr, "(Specifically, otp_dec cannot connect to otp_enc_d.)\n");
+			exit(2);
+		default:
+			exit(2);
 	}
-	if ((status = otp_send(sockfd, key)) < 0) {
-		fprintf(stderr, "Error: otp_send() unable to send key\n");
-		exit(1);
-	}
-	
-	// receive code
-	code = otp_recv(sockfd);
-	if (code)
-		printf("%s\n", code);
 	
     return 0;
 }
@@ -0,0 +1,433 @@
+/*
+ * otp_replay.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * capture replay - plays a daemon capture (otpcap.h) back against a
+ * daemon: each captured connection opens, sends requests of the same
+ * sizes and closes at the captured times, with synthetic payloads,
+ * optionally sped up or slowed down; every request takes its own
+ * window of a synthetic pad, so the daemon's reuse check sees fresh key
+ */
+
+
+/* LIBRARIES */
+#include <time.h>
+#include "otpcap.h"
+#include "otpclient.h"
+
+
+/* MACROS */
+#define CONCURRENCY 64					// default connections replayed at once
+#define REPLAYPAD (256 * 1024 * 1024)	// most synthetic pad, windows wrap past it
+
+
+/* STRUCTS AND ENUMS */
+// one captured connection, from its open to its close
+typedef struct session {
+	otpcap_rec *recs;					// its records, in time order
+	size_t n;
+	uint64_t open;						// captured start
+	uint8_t via;
+	size_t maxlen;						// largest request
+} session;
+
+// what a replayed request saw
+typedef struct result {
+	double lat;							// seconds, request to reply
+	double lag;							// seconds behind schedule when sent
+	uint32_t us;						// captured service time
+	bool ok;
+} result;
+
+
+/* GLOBAL VARIABLES */
+static uint64_t t0;						// captured time of the first connection
+static struct timespec start;			// replay time of t0
+static double speed = 1.0;
+static char *endpoint;
+static otpc_mode mode;
+static char *input;						// synthetic input, as long as the largest request
+static char *pad;						// synthetic key, every request's window in turn
+static otpcap_rec *recs;				// the capture
+static size_t *keyoffs;					// window in pad of each request in recs
+static result *results;
+static size_t nresults = 0;
+static int active = 0;					// sessions being replayed
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle = PTHREAD_COND_INITIALIZER;
+
+
+/* FUNCTION DECLARATIONS */
+int bytime(const void *a, const void *b);
+int byconn(const void *a, const void *b);
+int bydouble(const void *a, const void *b);
+double now();
+void waituntil(uint64_t ts);
+void report(const char *name, double *v, size_t n);
+void * replay(void *arg);
+uint64_t nextrand(uint64_t *state);
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  byconn
+ * SYNOPSYS
+ * 	qsort comparator: connection, then time
+ */
+int byconn(const void *a, const void *b)
+{
+	const otpcap_rec *x = (const otpcap_rec *) a;
+	const otpcap_rec *y = (const otpcap_rec *) b;
+
+	if (x->conn != y->conn)
+		return (x->conn < y->conn) ? -1 : 1;
+	if (x->ts != y->ts)
+		return (x->ts < y->ts) ? -1 : 1;
+	return (x->op < y->op) ? -1 : (x->op > y->op);
+}
+
+
+/* NAME
+ *  bytime
+ * SYNOPSYS
+ * 	qsort comparator: sessions by start
+ */
+int bytime(const void *a, const void *b)
+{
+	const session *x = (const session *) a;
+	const session *y = (const session *) b;
+
+	if (x->open != y->open)
+		return (x->open < y->open) ? -1 : 1;
+	return 0;
+}
+
+
+/* NAME
+ *  bydouble
+ * SYNOPSYS
+ * 	qsort comparator: ascending doubles
+ */
+int bydouble(const void *a, const void *b)
+{
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return (x < y) ? -1 : (x > y);
+}
+
+
+/* NAME
+ *  now
+ * SYNOPSYS
+ * 	seconds since the replay started
+ */
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec - start.tv_sec) + (ts.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+
+/* NAME
+ *  waituntil
+ * SYNOPSYS
+ * 	sleeps until the replay time of captured time ts
+ */
+void waituntil(uint64_t ts)
+{
+	double at = (ts - t0) / 1e9 / speed;
+	struct timespec due = start;
+	due.tv_sec += (time_t) at;
+	due.tv_nsec += (long) ((at - (time_t) at) * 1e9);
+	if (due.tv_nsec >= 1000000000L) {
+		due.tv_sec++;
+		due.tv_nsec -= 1000000000L;
+	}
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR)
+		;
+}
+
+
+/* NAME
+ *  nextrand
+ * SYNOPSYS
+ * 	next value of a fast generator (splitmix64), good enough for
+ *  synthetic pad and much faster than rand() over hundreds of MB
+ */
+uint64_t nextrand(uint64_t *state)
+{
+	uint64_t x = (*state += 0x9E3779B97F4A7C15ULL);
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+
+/* NAME
+ *  replay
+ * SYNOPSYS
+ * 	thread: replays one session on a connection of its own
+ */
+void * replay(void *arg)
+{
+	session *s = (session *) arg;
+	otpc *c = NULL;
+	otpc_shm *ring = NULL;
+
+	if (s->via == CAP_RING && endpoint[0] == '/')
+		ring = otpc_shm_new(endpoint, mode, s->maxlen ? s->maxlen : 1);
+	if (!ring) {
+		c = otpc_new_endpoints(endpoint, mode);
+		c->maxidle = 1;
+	}
+
+	size_t i;
+	for (i = 0; i < s->n; i++) {
+		otpcap_rec *r = &s->recs[i];
+		if (r->op == CAP_CLOSE)
+			waituntil(r->ts);
+		if (r->op != CAP_REQ)
+			continue;
+
+		waituntil(r->ts);
+		double sched = (r->ts - t0) / 1e9 / speed;
+		double t = now();
+		char *out = NULL;
+		const char *key = pad + keyoffs[r - recs];
+		int status = ring ? otpc_shm_crypt(ring, input, r->len, key, &out)
+			: otpc_crypt(c, input, r->len, key, r->len, &out);
+		double done = now();
+		otpbuf_free(out);
+
+		pthread_mutex_lock(&lock);
+		result *res = &results[nresults++];
+		pthread_mutex_unlock(&lock);
+		res->lat = done - t;
+		res->lag = (t > sched) ? t - sched : 0;
+		res->us = r->us;
+		res->ok = (status == OTPC_OK) ? TRUE : FALSE;
+	}
+
+	otpc_shm_free(ring);
+	otpc_free(c);
+	pthread_mutex_lock(&lock);
+	active--;
+	pthread_cond_signal(&idle);
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+
+/* NAME
+ *  report
+ * SYNOPSYS
+ * 	prints percentiles of n values, in milliseconds
+ */
+void report(const char *name, double *v, size_t n)
+{
+	if (n == 0)
+		return;
+	qsort(v, n, sizeof(double), bydouble);
+	printf("%-12s p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f ms\n", name,
+		v[n / 2] * 1e3, v[n * 9 / 10] * 1e3, v[n * 99 / 100] * 1e3, v[n - 1] * 1e3);
+}
+
+
+/* NAME
+ *  main
+ * SYNOPSYS
+ * 	loads a capture and replays it
+ * USAGE
+ *  otp_replay [-s <speed>] [-c <connections>] <capture file> <endpoint>
+ *  speed 2 replays twice as fast, 0.5 at half speed; at most
+ *  <connections> (default 64) are replayed at once, later ones wait
+ *  and fall behind schedule; endpoint is a port, host:port or unix
+ *  socket path, as for otp_enc (a path replays rings as rings)
+ */
+int main(int argc, char *argv[]) {
+	int maxactive = CONCURRENCY;
+	int opt;
+	while ((opt = getopt(argc, argv, "s:c:")) != -1) {
+		switch (opt)
+		{
+			case 's':
+				speed = atof(optarg);
+				if (speed <= 0) {
+					fprintf(stderr, "Error: Invalid speed %s.\n", optarg);
+					exit(2);
+				}
+				break;
+			case 'c':
+				maxactive = atoi(optarg);
+				if (maxactive <= 0) {
+					fprintf(stderr, "Error: Invalid connection limit %s.\n", optarg);
+					exit(2);
+				}
+				break;
+			default:
+				exit(2);
+		}
+	}
+	if (argc - optind != 2) {
+		fprintf(stderr, "Usage: otp_replay [-s <speed>] [-c <connections>] <capture file> <endpoint>\n");
+		exit(2);
+	}
+	endpoint = argv[optind + 1];
+	otpc *probe = otpc_new_endpoints(endpoint, OTPC_ENC);
+	if (!probe) {
+		fprintf(stderr, "Error: Invalid endpoint %s.\n", endpoint);
+		exit(2);
+	}
+	otpc_free(probe);
+
+	// load capture
+	FILE *f = fopen(argv[optind], "rb");
+	if (!f) {
+		perror("Error: fopen()");
+		exit(1);
+	}
+	otpcap_hdr hdr;
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 || strcmp(hdr.magic, OTPCAP_MAGIC) != 0
+			|| hdr.recsize != sizeof(otpcap_rec)) {
+		fprintf(stderr, "Error: %s is not a capture.\n", argv[optind]);
+		exit(1);
+	}
+	mode = (strncmp(hdr.id, "dec", 3) == 0) ? OTPC_DEC : OTPC_ENC;
+	fseek(f, 0, SEEK_END);
+	size_t nrecs = (ftell(f) - sizeof(hdr)) / sizeof(otpcap_rec);
+	fseek(f, sizeof(hdr), SEEK_SET);
+	recs = (otpcap_rec *) malloc((nrecs + 1) * sizeof(otpcap_rec));
+	nrecs = fread(recs, sizeof(otpcap_rec), nrecs, f);
+	fclose(f);
+
+	// split into sessions: pids are reused, so a new open starts a
+	// new session even on the same connection number
+	qsort(recs, nrecs, sizeof(otpcap_rec), byconn);
+	session *sessions = (session *) calloc(nrecs + 1, sizeof(session));
+	size_t nsessions = 0, nreqs = 0, maxlen = 0;
+	size_t i;
+	for (i = 0; i < nrecs; i++) {
+		otpcap_rec *r = &recs[i];
+		session *s = nsessions ? &sessions[nsessions - 1] : NULL;
+		if (!s || r->op == CAP_OPEN || r->conn != s->recs[0].conn || s->recs[s->n - 1].op == CAP_CLOSE) {
+			s = &sessions[nsessions++];
+			s->recs = r;
+			s->open = r->ts;
+			s->via = r->via;
+		}
+		s->n++;
+		if (r->op == CAP_REQ) {
+			nreqs++;
+			if (r->len > s->maxlen)
+				s->maxlen = r->len;
+		}
+		if (s->maxlen > maxlen)
+			maxlen = s->maxlen;
+	}
+	if (nreqs == 0) {
+		fprintf(stderr, "Error: No requests in capture.\n");
+		exit(1);
+	}
+	qsort(sessions, nsessions, sizeof(session), bytime);
+	t0 = sessions[0].open;
+	uint64_t span = 0;
+	for (i = 0; i < nrecs; i++) {
+		if (recs[i].ts - t0 > span)
+			span = recs[i].ts - t0;
+	}
+
+	// synthetic payloads: the daemon only checks the input's
+	// characters, so one input serves every request, but each request
+	// gets the next window of pad in schedule order, as a real sender
+	// would; the pad holds them all, up to REPLAYPAD
+	size_t total = 0;
+	for (i = 0; i < nrecs; i++)
+		if (recs[i].op == CAP_REQ)
+			total = total + recs[i].len;
+	size_t padlen = (total < REPLAYPAD) ? total : REPLAYPAD;
+	if (padlen < maxlen)
+		padlen = maxlen;
+	keyoffs = (size_t *) calloc(nrecs + 1, sizeof(size_t));
+	input = otpbuf_alloc(maxlen);
+	pad = otpbuf_alloc(padlen);
+	results = (result *) calloc(nreqs, sizeof(result));
+	if (!keyoffs || !input || !pad || !results) {
+		fprintf(stderr, "Error: No memory for %zu characters of pad.\n", padlen);
+		exit(1);
+	}
+	uint64_t state = time(NULL) ^ getpid();
+	for (i = 0; i < maxlen; i++)
+		input[i] = 'A' + i % 26;
+	for (i = 0; i < padlen; i++)
+		pad[i] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ "[nextrand(&state) % 27];
+
+	size_t cursor = 0, j;
+	bool wrapped = FALSE;
+	for (i = 0; i < nsessions; i++) {
+		for (j = 0; j < sessions[i].n; j++) {
+			otpcap_rec *r = &sessions[i].recs[j];
+			if (r->op != CAP_REQ)
+				continue;
+			if (cursor + r->len > padlen) {
+				cursor = 0;
+				wrapped = TRUE;
+			}
+			keyoffs[r - recs] = cursor;
+			cursor = cursor + r->len;
+		}
+	}
+	if (wrapped)
+		fprintf(stderr, "Warning: Capture needs more than %d characters of pad, key windows repeat; replay against otp_enc_d -P off.\n",
+			REPLAYPAD);
+
+	printf("capture      %zu connections, %zu requests over %.3f s, replaying at %gx\n",
+		nsessions, nreqs, span / 1e9, speed);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nsessions; i++) {
+		waituntil(sessions[i].open);
+		pthread_mutex_lock(&lock);
+		while (active >= maxactive)
+			pthread_cond_wait(&idle, &lock);
+		active++;
+		pthread_mutex_unlock(&lock);
+
+		pthread_t tid;
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		pthread_attr_setstacksize(&attr, 256 * 1024);
+		if (pthread_create(&tid, &attr, replay, &sessions[i]) != 0) {
+			perror("Error: pthread_create()");
+			exit(1);
+		}
+		pthread_attr_destroy(&attr);
+	}
+	pthread_mutex_lock(&lock);
+	while (active > 0)
+		pthread_cond_wait(&idle, &lock);
+	pthread_mutex_unlock(&lock);
+	double took = now();
+
+	// summary
+	double *lat = (double *) malloc(nresults * sizeof(double));
+	double *lag = (double *) malloc(nresults * sizeof(double));
+	double *svc = (double *) malloc(nresults * sizeof(double));
+	size_t nok = 0;
+	for (i = 0; i < nresults; i++) {
+		lag[i] = results[i].lag;
+		svc[i] = results[i].us / 1e6;
+		if (results[i].ok)
+			lat[nok++] = results[i].lat;
+	}
+	printf("replayed     %zu requests, %zu failed, in %.3f s (schedule %.3f s)\n",
+		nresults, nresults - nok, took, span / 1e9 / speed);
+	report("latency", lat, nok);
+	report("captured", svc, nresults);
+	report("behind", lag, nresults);
+
+	return (nok == nresults) ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/*
+ * otp_trace.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * trace decoder - prints otptrace dumps as per-request timelines
+ */
+
+
+/* LIBRARIES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "otptrace.h"
+
+
+/* GLOBAL VARIABLES */
+const char *evnames[TR_NEVENTS] = {
+	"accept", "id", "handshake", "recv input", "recv key", "validate",
+	"codec", "send", "client start", "client connect", "client send input",
+	"client send key", "client recv"
+};
+
+
+/* FUNCTION DECLARATIONS */
+int byrequest(const void *a, const void *b);
+otptrace_rec * load(char *filename, otptrace_rec *recs, size_t *num, size_t *cap);
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  byrequest
+ * SYNOPSYS
+ * 	qsort comparator: pid, then request, then time
+ */
+int byrequest(const void *a, const void *b)
+{
+	const otptrace_rec *x = (const otptrace_rec *) a;
+	const otptrace_rec *y = (const otptrace_rec *) b;
+
+	if (x->pid != y->pid)
+		return (x->pid < y->pid) ? -1 : 1;
+	if (x->req != y->req)
+		return (x->req < y->req) ? -1 : 1;
+	if (x->ts != y->ts)
+		return (x->ts < y->ts) ? -1 : 1;
+	return 0;
+}
+
+
+/* NAME
+ *  load
+ * SYNOPSYS
+ * 	appends the records of one dump file, growing the array as needed
+ */
+otptrace_rec * load(char *filename, otptrace_rec *recs, size_t *num, size_t *cap)
+{
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		fprintf(stderr, "File Not Found: %s.\n", filename);
+		return recs;
+	}
+
+	uint32_t magic = 0;
+	if (fread(&magic, sizeof(magic), 1, f) != 1 || magic != OTPTRACE_MAGIC) {
+		fprintf(stderr, "Error: %s is not a trace dump.\n", filename);
+		fclose(f);
+		return recs;
+	}
+
+	otptrace_rec r;
+	while (fread(&r, sizeof(r), 1, f) == 1) {
+		if (r.ev >= TR_NEVENTS)
+			continue;
+		if (*num == *cap) {
+			*cap = (*cap) ? (*cap) * 2 : 4096;
+			recs = (otptrace_rec *) realloc(recs, (*cap) * sizeof(otptrace_rec));
+		}
+		recs[(*num)++] = r;
+	}
+
+	fclose(f);
+	return recs;
+}
+
+
+/* NAME
+ *  main
+ * SYNOPSYS
+ * 	loads dumps and prints, per request, each event with its offset
+ *  from the first event and the length of the phase it ends
+ * USAGE
+ *  otp_trace <dump file>...
+ */
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: otp_trace <dump file>...\n");
+		exit(2);
+	}
+
+	otptrace_rec *recs = NULL;
+	size_t num = 0, cap = 0;
+	int i;
+	for (i = 1; i < argc; i++)
+		recs = load(argv[i], recs, &num, &cap);
+
+	qsort(recs, num, sizeof(otptrace_rec), byrequest);
+
+	size_t j = 0;
+	while (j < num) {
+		// find extent of this request
+		size_t k = j;
+		while (k < num && recs[k].pid == recs[j].pid && recs[k].req == recs[j].req)
+			k++;
+
+		printf("pid %u request %u: %.3f ms\n", recs[j].pid, recs[j].req,
+			(recs[k - 1].ts - recs[j].ts) / 1e6);
+		size_t e;
+		for (e = j; e < k; e++) {
+			printf("  %10.3f ms  %10.3f ms  %-18s", (recs[e].ts - recs[j].ts) / 1e6,
+				(e > j) ? (recs[e].ts - recs[e - 1].ts) / 1e6 : 0.0, evnames[recs[e].ev]);
+			if (recs[e].arg)
+				printf("  %llu", (unsigned long long) recs[e].arg);
+			printf("\n");
+		}
+
+		j = k;
+	}
+
+	free(recs);
+	return 0;
+}
@@ -0,0 +1,301 @@
+/*
+ * otpbuf.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * payload and key buffer pool
+ *
+ * pooled buffers are grouped in power-of-two size classes starting at
+ * 2 MB (one huge page); the header lives at the start of the mapping,
+ * the caller gets the bytes after it
+ */
+
+
+/* LIBRARIES */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "otpbuf.h"
+
+
+/* MACROS */
+#define HUGEPAGE (2 * 1024 * 1024)
+#define NCLASS 40						// 2 MB << 39 is more than any address space
+#define MAGIC 0x4F545042554621ULL		// "OTPBUF!"
+
+
+/* STRUCTS AND ENUMS */
+// sits in front of every buffer, 64 bytes to keep payload aligned
+typedef struct bufhdr {
+	uint64_t magic;
+	size_t maplen;						// bytes mapped including header, 0 if heap
+	size_t cap;							// usable bytes
+	size_t used;						// bytes handed out, wiped on release
+	int cls;							// size class, -1 if heap
+	char pad[64 - sizeof(uint64_t) - 3 * sizeof(size_t) - sizeof(int)];
+} bufhdr;
+
+
+/* GLOBAL VARIABLES */
+static int mode = OTPBUF_THP;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static bufhdr *cache[NCLASS][OTPBUF_CACHE];
+static int ncached[NCLASS];
+static int cachemax = OTPBUF_CACHE;		// released buffers kept per size class
+static int lockwarned = 0;
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  otpbuf_setmode
+ * SYNOPSYS
+ * 	sets pool mode from a comma separated list of "thp", "huge",
+ *  "lock" or "none"; returns 0, or -1 on an unknown word
+ */
+int otpbuf_setmode(const char *spec)
+{
+	char *copy = strdup(spec);
+	char *save = NULL;
+	char *word;
+	int m = 0;
+
+	for (word = strtok_r(copy, ",", &save); word; word = strtok_r(NULL, ",", &save)) {
+		if (strcmp(word, "thp") == 0)
+			m = m | OTPBUF_THP;
+		else if (strcmp(word, "huge") == 0)
+			m = m | OTPBUF_HUGETLB;
+		else if (strcmp(word, "lock") == 0)
+			m = m | OTPBUF_LOCK;
+		else if (strcmp(word, "none") != 0) {
+			free(copy);
+			return -1;
+		}
+	}
+
+	free(copy);
+	mode = m;
+	return 0;
+}
+
+
+/* NAME
+ *  prefault
+ * SYNOPSYS
+ * 	touches every page so first use by the caller takes no faults
+ */
+static void prefault(char *base, size_t len)
+{
+#ifdef MADV_POPULATE_WRITE
+	if (madvise(base, len, MADV_POPULATE_WRITE) == 0)
+		return;
+#endif
+	long page = sysconf(_SC_PAGESIZE);
+	size_t off;
+	for (off = 0; off < len; off += page)
+		((volatile char *) base)[off] = 0;
+}
+
+
+/* NAME
+ *  mapclass
+ * SYNOPSYS
+ * 	maps a new buffer of size class cls, huge page aligned
+ */
+static bufhdr * mapclass(int cls)
+{
+	size_t len = (size_t) HUGEPAGE << cls;
+	char *base = MAP_FAILED;
+
+	// explicit huge pages, if reserved
+#ifdef MAP_HUGETLB
+	if (mode & OTPBUF_HUGETLB)
+		base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+
+	// otherwise over-map and trim so transparent huge pages can back it
+	if (base == MAP_FAILED) {
+		char *raw = mmap(NULL, len + HUGEPAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (raw == MAP_FAILED)
+			return NULL;
+		base = (char *) (((uintptr_t) raw + HUGEPAGE - 1) & ~((uintptr_t) HUGEPAGE - 1));
+		if (base > raw)
+			munmap(raw, base - raw);
+		munmap(base + len, raw + HUGEPAGE - base);
+#ifdef MADV_HUGEPAGE
+		if (mode & (OTPBUF_THP | OTPBUF_HUGETLB))
+			madvise(base, len, MADV_HUGEPAGE);
+#endif
+	}
+
+	// keep pad material out of swap
+	if ((mode & OTPBUF_LOCK) && mlock(base, len) == -1 && !lockwarned) {
+		perror("Warning: mlock()");
+		lockwarned = 1;
+	}
+
+	prefault(base, len);
+
+	bufhdr *h = (bufhdr *) base;
+	h->magic = MAGIC;
+	h->maplen = len;
+	h->cap = len - sizeof(bufhdr);
+	h->cls = cls;
+	return h;
+}
+
+
+/* NAME
+ *  classof
+ * SYNOPSYS
+ * 	returns the smallest size class holding need bytes
+ */
+static int classof(size_t need)
+{
+	int cls = 0;
+	while (cls < NCLASS - 1 && ((size_t) HUGEPAGE << cls) < need)
+		cls++;
+	return cls;
+}
+
+
+/* NAME
+ *  otpbuf_size
+ * SYNOPSYS
+ * 	returns the bytes a buffer from otpbuf_alloc(len) takes: its whole
+ *  size class mapping if pooled, all of it resident once pre-faulted
+ */
+size_t otpbuf_size(size_t len)
+{
+	size_t need = len + 1 + sizeof(bufhdr);
+	if (len + 1 < OTPBUF_THRESHOLD)
+		return need;
+	return (size_t) HUGEPAGE << classof(need);
+}
+
+
+/* NAME
+ *  otpbuf_setcache
+ * SYNOPSYS
+ * 	keeps at most n (0 to OTPBUF_CACHE) released buffers per size
+ *  class from now on, unmapping any cached beyond that
+ */
+void otpbuf_setcache(int n)
+{
+	int cls;
+	pthread_mutex_lock(&lock);
+	cachemax = n;
+	for (cls = 0; cls < NCLASS; cls++)
+		while (ncached[cls] > n) {
+			bufhdr *h = cache[cls][--ncached[cls]];
+			munmap(h, h->maplen);
+		}
+	pthread_mutex_unlock(&lock);
+}
+
+
+/* NAME
+ *  otpbuf_alloc
+ * SYNOPSYS
+ * 	returns a zeroed buffer of len + 1 bytes (room for a terminating
+ *  null), or NULL if memory is exhausted
+ */
+char * otpbuf_alloc(size_t len)
+{
+	bufhdr *h = NULL;
+	size_t need = len + 1 + sizeof(bufhdr);
+
+	if (len + 1 < OTPBUF_THRESHOLD) {
+		h = (bufhdr *) calloc(1, need);
+		if (!h)
+			return NULL;
+		h->magic = MAGIC;
+		h->maplen = 0;
+		h->cap = len + 1;
+		h->cls = -1;
+	}
+	else {
+		int cls = classof(need);
+
+		// reuse a released buffer: already faulted in, already wiped
+		pthread_mutex_lock(&lock);
+		if (ncached[cls] > 0)
+			h = cache[cls][--ncached[cls]];
+		pthread_mutex_unlock(&lock);
+
+		if (!h)
+			h = mapclass(cls);
+		if (!h)
+			return NULL;
+	}
+
+	h->used = len + 1;
+	return (char *) (h + 1);
+}
+
+
+/* NAME
+ *  otpbuf_grow
+ * SYNOPSYS
+ * 	makes buf hold at least len + 1 bytes, keeping its contents;
+ *  buf may be NULL; returns the (possibly moved) buffer
+ */
+char * otpbuf_grow(char *buf, size_t len)
+{
+	if (!buf)
+		return otpbuf_alloc(len);
+
+	bufhdr *h = ((bufhdr *) buf) - 1;
+	if (h->cap >= len + 1) {
+		if (h->used < len + 1)
+			h->used = len + 1;
+		return buf;
+	}
+
+	char *bigger = otpbuf_alloc(len);
+	if (!bigger)
+		return NULL;
+	memcpy(bigger, buf, h->used);
+	otpbuf_free(buf);
+	return bigger;
+}
+
+
+/* NAME
+ *  otpbuf_free
+ * SYNOPSYS
+ * 	wipes the used part of buf and returns it to the pool (or heap)
+ */
+void otpbuf_free(char *buf)
+{
+	if (!buf)
+		return;
+
+	bufhdr *h = ((bufhdr *) buf) - 1;
+	if (h->magic != MAGIC) {
+		fprintf(stderr, "Error: otpbuf_free() on foreign buffer.\n");
+		abort();
+	}
+	explicit_bzero(buf, h->used);
+
+	if (h->cls < 0) {
+		h->magic = 0;
+		free(h);
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	if (ncached[h->cls] < cachemax) {
+		cache[h->cls][ncached[h->cls]++] = h;
+		h = NULL;
+	}
+	pthread_mutex_unlock(&lock);
+
+	if (h)
+		munmap(h, h->maplen);
+}
@@ -0,0 +1,47 @@
+#ifndef OTPBUF_H
+#define OTPBUF_H
+
+
+/*
+ * otpbuf.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * payload and key buffer pool (header file)
+ *
+ * buffers at or above OTPBUF_THRESHOLD are mapped directly, backed by
+ * huge pages, pre-faulted, optionally mlock'ed, and kept for reuse
+ * after release; smaller ones come from the heap. Either way the
+ * used bytes are wiped on release. otpbuf_size tells what a buffer
+ * really takes and otpbuf_setcache how many are kept, for callers
+ * that budget memory. Every buffer from otpbuf_alloc (and so from
+ * otp_recv, f_tostring, otp_compress, otp_decompress and otpc_crypt)
+ * must be released with otpbuf_free, never free.
+ */
+
+
+/* LIBRARIES */
+#include <stddef.h>
+
+
+/* MACROS */
+#define OTPBUF_THRESHOLD (1024 * 1024)	// smallest pooled buffer
+#define OTPBUF_CACHE 4					// released buffers kept per size class
+
+// pool modes, combined with |
+#define OTPBUF_THP 1					// transparent huge pages (default)
+#define OTPBUF_HUGETLB 2				// explicit huge pages, falls back to THP
+#define OTPBUF_LOCK 4					// mlock pooled buffers
+
+
+/* FUNCTION DECLARATIONS */
+int otpbuf_setmode(const char *spec);
+char * otpbuf_alloc(size_t len);
+size_t otpbuf_size(size_t len);
+void otpbuf_setcache(int n);
+char * otpbuf_grow(char *buf, size_t len);
+void otpbuf_free(char *buf);
+
+#endif
@@ -0,0 +1,214 @@
+/*
+ * otpcap.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * traffic capture
+ *
+ * the parent opens the capture file for appending before it forks, so
+ * every child writes to the same file; each write is a whole number of
+ * records, so children never interleave within one. Children buffer
+ * records and write them out whenever they go idle, and at exit.
+ */
+
+
+/* LIBRARIES */
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "otpcap.h"
+
+
+/* GLOBAL VARIABLES */
+static int capfd = -1;					// capture file, -1 if off
+static otpcap_rec batch[OTPCAP_BATCH];	// child: records not yet written
+static int nbatch = 0;
+static uint32_t conn = 0;				// child: connection number (pid)
+static otpcap_via via = CAP_TCP;
+
+
+/* FUNCTION DECLARATIONS */
+static void bootid(uint8_t *boot);
+static void otpcap_add(otpcap_op op, uint64_t ts, uint32_t len, uint32_t us);
+static void otpcap_close();
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  bootid
+ * SYNOPSYS
+ * 	reads the kernel's id for this boot into boot (16 bytes), all
+ *  zeros if it cannot
+ */
+static void bootid(uint8_t *boot)
+{
+	memset(boot, 0, 16);
+	FILE *f = fopen(OTPCAP_BOOTID, "r");
+	if (!f)
+		return;
+	char text[64];
+	if (fgets(text, sizeof(text), f)) {
+		int n = 0;
+		char *p;
+		for (p = text; *p && n < 32; p++) {
+			int d = (*p >= '0' && *p <= '9') ? *p - '0'
+				: (*p >= 'a' && *p <= 'f') ? *p - 'a' + 10 : -1;
+			if (d == -1)
+				continue;					// dashes, newline
+			boot[n / 2] = (boot[n / 2] << 4) | d;
+			n++;
+		}
+	}
+	fclose(f);
+}
+
+
+/* NAME
+ *  otpcap_open
+ * SYNOPSYS
+ * 	parent: opens capture file path for appending, writing the header
+ *  if it is new, or checking it was captured from the same kind of
+ *  daemon (handshake id) during this boot if not: monotonic times from
+ *  an earlier boot would not line up with new ones
+ *  returns 0 or -1 (error)
+ */
+int otpcap_open(const char *path, const char *id)
+{
+	capfd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	if (capfd == -1) {
+		perror("open() capture");
+		return -1;
+	}
+
+	otpcap_hdr hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	strcpy(hdr.magic, OTPCAP_MAGIC);
+	strncpy(hdr.id, id, sizeof(hdr.id) - 1);
+	hdr.recsize = sizeof(otpcap_rec);
+	bootid(hdr.boot);
+
+	struct stat st;
+	if (fstat(capfd, &st) == 0 && st.st_size == 0) {
+		if (write(capfd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+			perror("write() capture");
+			return -1;
+		}
+		return 0;
+	}
+
+	// appending to an earlier capture
+	otpcap_hdr old;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	ssize_t n = (fd == -1) ? -1 : read(fd, &old, sizeof(old));
+	if (fd != -1)
+		close(fd);
+	if (n != sizeof(old) || memcmp(&old, &hdr, offsetof(otpcap_hdr, boot)) != 0) {
+		fprintf(stderr, "Capture file %s is from another daemon or format.\n", path);
+		return -1;
+	}
+	if (memcmp(old.boot, hdr.boot, sizeof(hdr.boot)) != 0) {
+		fprintf(stderr, "Capture file %s is from an earlier boot, start a new one.\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+
+/* NAME
+ *  otpcap_now
+ * SYNOPSYS
+ * 	monotonic time in nanoseconds
+ */
+uint64_t otpcap_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/* NAME
+ *  otpcap_add
+ * SYNOPSYS
+ * 	child: buffers one record, writing the buffer out when full
+ */
+static void otpcap_add(otpcap_op op, uint64_t ts, uint32_t len, uint32_t us)
+{
+	otpcap_rec *r = &batch[nbatch++];
+	r->ts = ts;
+	r->conn = conn;
+	r->len = len;
+	r->us = us;
+	r->op = op;
+	r->via = via;
+	r->pad = 0;
+	if (nbatch == OTPCAP_BATCH)
+		otpcap_flush();
+}
+
+
+/* NAME
+ *  otpcap_close
+ * SYNOPSYS
+ * 	child, at exit: records the end of the connection, writes out
+ */
+static void otpcap_close()
+{
+	otpcap_add(CAP_CLOSE, otpcap_now(), 0, 0);
+	otpcap_flush();
+}
+
+
+/* NAME
+ *  otpcap_start
+ * SYNOPSYS
+ * 	child: records a connection, over via, once its handshake is done;
+ *  its close is recorded at exit
+ */
+void otpcap_start(otpcap_via v)
+{
+	if (capfd == -1)
+		return;
+	conn = getpid();
+	via = v;
+	otpcap_add(CAP_OPEN, otpcap_now(), 0, 0);
+	atexit(otpcap_close);
+}
+
+
+/* NAME
+ *  otpcap_req
+ * SYNOPSYS
+ * 	child: records a request of len characters served from start
+ *  (otpcap_now) until now
+ */
+void otpcap_req(uint64_t start, size_t len)
+{
+	if (capfd == -1)
+		return;
+	uint64_t us = (otpcap_now() - start) / 1000;
+	otpcap_add(CAP_REQ, start, (len > UINT32_MAX) ? UINT32_MAX : len,
+		(us > UINT32_MAX) ? UINT32_MAX : us);
+}
+
+
+/* NAME
+ *  otpcap_flush
+ * SYNOPSYS
+ * 	child: writes buffered records in one append
+ */
+void otpcap_flush()
+{
+	if (capfd == -1 || nbatch == 0)
+		return;
+	if (write(capfd, batch, nbatch * sizeof(otpcap_rec)) == -1)
+		perror("write() capture");
+	nbatch = 0;
+}
@@ -0,0 +1,65 @@
+#ifndef OTPCAP_H
+#define OTPCAP_H
+
+
+/*
+ * otpcap.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * traffic capture (header file)
+ *
+ * with -C <file> a daemon appends one fixed size record per connection
+ * opened or closed and per request served: when, how long, how many
+ * characters, over what, on which connection. Payloads are never
+ * recorded. Times are CLOCK_MONOTONIC, which counts from boot, so a
+ * capture is only appended to during the boot that started it.
+ * otp_replay plays a capture back against a daemon with
+ * synthetic payloads.
+ */
+
+
+/* LIBRARIES */
+#include <stdint.h>
+
+
+/* MACROS */
+#define OTPCAP_MAGIC "OTPCAP2"			// first bytes of a capture file
+#define OTPCAP_BOOTID "/proc/sys/kernel/random/boot_id"
+#define OTPCAP_BATCH 128				// records a child buffers before writing
+
+
+/* STRUCTS AND ENUMS */
+typedef enum otpcap_op {CAP_OPEN, CAP_REQ, CAP_CLOSE} otpcap_op;
+typedef enum otpcap_via {CAP_TCP, CAP_UNIX, CAP_RING} otpcap_via;
+
+// start of a capture file
+typedef struct otpcap_hdr {
+	char magic[8];
+	char id[4];							// handshake id of the daemon, "enc" or "dec"
+	uint32_t recsize;					// sizeof(otpcap_rec)
+	uint8_t boot[16];					// kernel boot id the times count from, 0 if unknown
+} otpcap_hdr;
+
+// one event
+typedef struct otpcap_rec {
+	uint64_t ts;						// start, CLOCK_MONOTONIC nanoseconds (since boot)
+	uint32_t conn;						// serving child's pid
+	uint32_t len;						// request characters, 0 for open / close
+	uint32_t us;						// microseconds to serve the request
+	uint8_t op;							// otpcap_op
+	uint8_t via;						// otpcap_via
+	uint16_t pad;
+} otpcap_rec;
+
+
+/* FUNCTION DECLARATIONS */
+int otpcap_open(const char *path, const char *id);
+void otpcap_start(otpcap_via via);
+uint64_t otpcap_now();
+void otpcap_req(uint64_t start, size_t len);
+void otpcap_flush();
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * otpcipher.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * cipher engine
+ *
+ * every byte maps to a number, 0 for those outside the alphabet, as
+ * input in shared memory can change after it was validated; sums and
+ * differences index a doubled alphabet, so no character needs a
+ * division.
+ */
+
+
+/* LIBRARIES */
+#include <pthread.h>
+#include <stdint.h>
+#include "otpcipher.h"
+
+
+/* GLOBAL VARIABLES */
+static const char twice[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ABCDEFGHIJKLMNOPQRSTUVWXYZ ";
+static uint8_t value[256];				// A-Z = 0-25, space = 26, others 0
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+
+/* FUNCTION DECLARATIONS */
+static void maketable();
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  maketable
+ * SYNOPSYS
+ * 	fills the character values
+ */
+static void maketable()
+{
+	int i;
+	for (i = 0; i <= 25; i++)
+		value['A' + i] = i;
+	value[' '] = 26;
+}
+
+
+/* NAME
+ *  otpcipher_encode
+ * SYNOPSYS
+ * 	uses key to encrypt length characters of plaintext into code,
+ *  which may be plain itself, and terminates it
+ */
+void otpcipher_encode(const char *plain, const char *key, char *code, size_t length)
+{
+	pthread_once(&once, maketable);
+	const unsigned char *p = (const unsigned char *) plain;
+	const unsigned char *k = (const unsigned char *) key;
+	size_t j;
+	for (j = 0; j < length; j++)
+		code[j] = twice[value[p[j]] + value[k[j]]];
+	code[length] = '\0';
+}
+
+
+/* NAME
+ *  otpcipher_decode
+ * SYNOPSYS
+ * 	uses key to decrypt length characters of ciphertext into plain,
+ *  which may be code itself, and terminates it
+ */
+void otpcipher_decode(const char *code, const char *key, char *plain, size_t length)
+{
+	pthread_once(&once, maketable);
+	const unsigned char *c = (const unsigned char *) code;
+	const unsigned char *k = (const unsigned char *) key;
+	size_t j;
+	for (j = 0; j < length; j++)
+		plain[j] = twice[value[c[j]] + 27 - value[k[j]]];
+	plain[length] = '\0';
+}
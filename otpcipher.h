@@ -0,0 +1,30 @@
+#ifndef OTPCIPHER_H
+#define OTPCIPHER_H
+
+
+/*
+ * otpcipher.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * cipher engine (header file)
+ *
+ * the one-time pad itself: each character of A to Z and space is a
+ * number 0 to 26, and encryption adds the key's number to it mod 27,
+ * decryption subtracts it. The daemons run it on every request, and
+ * libotp clients created with otpc_new_local run it in process, so
+ * both give the same result for the same input and key.
+ */
+
+
+/* LIBRARIES */
+#include <stddef.h>
+
+
+/* FUNCTION DECLARATIONS */
+void otpcipher_encode(const char *plain, const char *key, char *code, size_t length);
+void otpcipher_decode(const char *code, const char *key, char *plain, size_t length);
+
+#endif
@@ -0,0 +1,1517 @@
+/*
+ * otpclient.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * embeddable client library (libotp)
+ */
+
+
+/* LIBRARIES */
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include "otpcipher.h"
+#include "otpclient.h"
+#include "otptrace.h"
+
+
+/* STRUCTS AND ENUMS */
+// arguments handed to an async worker thread
+typedef struct otpc_job {
+	otpc *c;
+	const char *in;
+	size_t len;
+	const char *key;
+	size_t keylen;
+	otpc_cb cb;
+	void *arg;
+} otpc_job;
+
+// state shared by the sending and receiving halves of a stream; the
+// input of each request is held until its reply arrives, so it can be
+// sent again over a new connection
+typedef struct otpc_pipe {
+	int sockfd;							// changed only by the receiving half
+	int infd;
+	int keyfd;
+	size_t keyoff;
+	int wake;							// eventfd, wakes the sender waiting for input
+	int resume;							// seconds to reconnect for, 0 for none
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	size_t queued;						// requests read and held
+	size_t sent;						// requests sent, back to acked on a new connection
+	size_t acked;						// replies received
+	size_t used;						// key characters taken
+	char *held[OTPC_WINDOW];			// input of request i in held[i % OTPC_WINDOW]
+	size_t heldlen[OTPC_WINDOW];
+	size_t heldoff[OTPC_WINDOW];		// its key, from keyoff
+	bool broken;						// connection lost, sender waits for a new one
+	bool sending;						// sender is writing to sockfd
+	bool eof;							// input is finished
+	double until;						// reconnecting gives up at, 0 if connected since the last reply
+	int status;							// first failure, OTPC_OK if none
+} otpc_pipe;
+
+
+/* FUNCTION DECLARATIONS */
+static otpc * otpc_alloc(otpc_mode mode);
+static bool otpc_addep(otpc *c, const char *host, const char *port);
+static double otpc_now();
+static otpc_ep * otpc_pick(otpc *c);
+static void otpc_done(otpc *c, otpc_ep *ep, bool ok);
+static int otpc_connect(otpc *c, otpc_ep *ep);
+static int otpc_get(otpc *c, otpc_ep *ep, bool *pooled);
+static void otpc_put(otpc *c, otpc_ep *ep, int sockfd);
+static int otpc_refusal(const char *reply);
+static int otpc_roundtrip(otpc *c, const char **msgs, size_t *lens, int n, char **out);
+static int otpc_resumed(otpc *c, const char **msgs, size_t *lens, int n, char **out);
+static int otpc_request(otpc *c, const char *in, size_t len, const char *key, size_t keylen, char **out);
+static int otpc_batch1(otpc *c, const char **ins, const size_t *lens, int n, const char *key, size_t total, char *out);
+static void * otpc_worker(void *job);
+static void otpc_pipe_fail(otpc_pipe *p, int status);
+static void otpc_pipe_wake(otpc_pipe *p);
+static void * otpc_sender(void *pipe);
+static int otpc_pipe_resume(otpc *c, otpc_pipe *p, otpc_ep **ep);
+static int otpc_chunk(int infd, int keyfd, size_t keyoff, char *in, char *key, size_t *len, bool *nl);
+static int otpc_stream_local(otpc *c, int infd, int outfd, int keyfd, size_t keyoff, size_t *used);
+static void otpc_cipher(otpc *c, const char *in, const char *key, char *out, size_t len);
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  otpc_alloc
+ * SYNOPSYS
+ * 	allocates an empty client
+ */
+static otpc * otpc_alloc(otpc_mode mode)
+{
+	otpc *c = (otpc *) calloc(1, sizeof(otpc));
+	c->neps = 0;
+	c->next = 0;
+	c->mode = mode;
+	c->maxidle = OTPC_MAXIDLE;
+	c->compress = FALSE;
+	c->keychecked = FALSE;
+	c->resume = OTPC_RESUME;
+	c->local = FALSE;
+	pthread_mutex_init(&c->lock, NULL);
+	TRACE_INIT();
+
+	return c;
+}
+
+
+/* NAME
+ *  otpc_addep
+ * SYNOPSYS
+ * 	adds endpoint host:port (or unix socket path host), returns FALSE
+ *  on invalid port or too many
+ */
+static bool otpc_addep(otpc *c, const char *host, const char *port)
+{
+	if (c->neps >= OTPC_MAXEPS || (host[0] != '/' && !isValidPort(strtol(port, NULL, 10))))
+		return FALSE;
+
+	otpc_ep *ep = &c->eps[c->neps++];
+	ep->host = strdup(host);
+	ep->port = strdup(port);
+	return TRUE;
+}
+
+
+/* NAME
+ *  otpc_new
+ * SYNOPSYS
+ * 	creates a client for the daemon at host:port
+ *  mode selects the id sent in the handshake (enc, dec or key)
+ *  returns NULL on invalid port
+ */
+otpc * otpc_new(char *host, char *port, otpc_mode mode)
+{
+	otpc *c = otpc_alloc(mode);
+	if (!otpc_addep(c, host, port)) {
+		otpc_free(c);
+		return NULL;
+	}
+
+	return c;
+}
+
+
+/* NAME
+ *  otpc_new_endpoints
+ * SYNOPSYS
+ * 	creates a client spreading requests over a comma separated list
+ *  of endpoints, each "port", "host:port", "[ipv6 address]:port" or
+ *  a unix socket path starting with / (a bare port means localhost);
+ *  returns NULL if any entry is invalid
+ */
+otpc * otpc_new_endpoints(const char *list, otpc_mode mode)
+{
+	otpc *c = otpc_alloc(mode);
+	char *copy = strdup(list);
+	char *save = NULL;
+	char *entry;
+	bool ok = TRUE;
+
+	for (entry = strtok_r(copy, ",", &save); entry && ok; entry = strtok_r(NULL, ",", &save)) {
+		char *host = "localhost";
+		char *port = entry;
+		char *colon;
+
+		if (entry[0] == '/') {
+			// unix socket path, port unused
+			host = entry;
+			port = "0";
+		}
+		else if (entry[0] == '[') {
+			// bracketed IPv6 address
+			char *end = strchr(entry, ']');
+			if (!end || end[1] != ':') {
+				ok = FALSE;
+				break;
+			}
+			*end = '\0';
+			host = entry + 1;
+			port = end + 2;
+		}
+		else if ((colon = strchr(entry, ':')) != NULL) {
+			// a second colon means an unbracketed IPv6 address
+			if (strchr(colon + 1, ':')) {
+				ok = FALSE;
+				break;
+			}
+			*colon = '\0';
+			host = entry;
+			port = colon + 1;
+		}
+
+		ok = otpc_addep(c, host, port);
+	}
+
+	free(copy);
+	if (!ok || c->neps == 0) {
+		otpc_free(c);
+		return NULL;
+	}
+
+	return c;
+}
+
+
+/* NAME
+ *  otpc_new_local
+ * SYNOPSYS
+ * 	creates a client that encrypts (OTPC_ENC) or decrypts (OTPC_DEC)
+ *  in process with the daemons' cipher engine, with no daemon; it
+ *  validates, compresses and reads key as any other client does
+ *  returns NULL for other modes
+ */
+otpc * otpc_new_local(otpc_mode mode)
+{
+	if (mode != OTPC_ENC && mode != OTPC_DEC)
+		return NULL;
+	otpc *c = otpc_alloc(mode);
+	c->local = TRUE;
+	return c;
+}
+
+
+/* NAME
+ *  otpc_free
+ * SYNOPSYS
+ * 	closes pooled connections and frees client
+ *  no requests may be in flight
+ */
+void otpc_free(otpc *c)
+{
+	if (!c)
+		return;
+
+	int i, j;
+	for (i = 0; i < c->neps; i++) {
+		for (j = 0; j < c->eps[i].numidle; j++)
+			close(c->eps[i].idle[j]);
+		free(c->eps[i].host);
+		free(c->eps[i].port);
+	}
+
+	pthread_mutex_destroy(&c->lock);
+	free(c);
+}
+
+
+/* NAME
+ *  otpc_now
+ * SYNOPSYS
+ * 	monotonic time in seconds
+ */
+static double otpc_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/* NAME
+ *  otpc_pick
+ * SYNOPSYS
+ * 	chooses the healthy endpoint with the fewest outstanding requests,
+ *  breaking ties round robin; if every endpoint is ejected, probes the
+ *  one whose ejection ends soonest
+ */
+static otpc_ep * otpc_pick(otpc *c)
+{
+	double t = otpc_now();
+	otpc_ep *best = NULL;
+	otpc_ep *probe = NULL;
+	int i;
+
+	pthread_mutex_lock(&c->lock);
+	for (i = 0; i < c->neps; i++) {
+		otpc_ep *ep = &c->eps[(c->next + i) % c->neps];
+		if (ep->ejected_until <= t) {
+			if (!best || ep->outstanding < best->outstanding)
+				best = ep;
+		}
+		else if (!probe || ep->ejected_until < probe->ejected_until)
+			probe = ep;
+	}
+	if (!best)
+		best = probe;
+	best->outstanding++;
+	c->next = (c->next + 1) % c->neps;
+	pthread_mutex_unlock(&c->lock);
+
+	return best;
+}
+
+
+/* NAME
+ *  otpc_done
+ * SYNOPSYS
+ * 	ends a request on ep; a failure ejects the endpoint for a period
+ *  that doubles with each consecutive failure
+ */
+static void otpc_done(otpc *c, otpc_ep *ep, bool ok)
+{
+	pthread_mutex_lock(&c->lock);
+	ep->outstanding--;
+	if (ok)
+		ep->fails = 0;
+	else {
+		double ms = OTPC_EJECT_MS;
+		int i;
+		for (i = 1; i < ep->fails && ms < OTPC_EJECT_MAX_MS; i++)
+			ms = ms * 2;
+		if (ms > OTPC_EJECT_MAX_MS)
+			ms = OTPC_EJECT_MAX_MS;
+		ep->fails++;
+		ep->ejected_until = otpc_now() + ms / 1000.0;
+	}
+	pthread_mutex_unlock(&c->lock);
+}
+
+
+/* NAME
+ *  otpc_connect
+ * SYNOPSYS
+ * 	opens a new connection to ep and performs the id handshake
+ *  returns socket or OTPC_ECONNECT / OTPC_EREJECT, or OTPC_ERATE if
+ *  the daemon refused the connection
+ */
+static int otpc_connect(otpc *c, otpc_ep *ep)
+{
+	int sockfd = initialize(ep->host, ep->port, CONNECT);
+	if (sockfd == -1)
+		return OTPC_ECONNECT;
+
+	// authenticate, send id, wait for reply; encryption and decryption
+	// may ask for CRC32C trailers and packing
+	char *reply = NULL;
+	const char *ids[] = {"enc", "dec", "key", "stats"};
+	char id[24];
+	bool crypt = (c->mode == OTPC_ENC || c->mode == OTPC_DEC) ? TRUE : FALSE;
+	bool crc = (otp_wantcrc() && crypt) ? TRUE : FALSE;
+	bool pack = (otp_wantpack() && crypt) ? TRUE : FALSE;
+	snprintf(id, sizeof(id), "%s%s%s", ids[c->mode], crc ? OTP_CRCID : "", pack ? OTP_PACKID : "");
+	otp_setcrc(sockfd, FALSE);
+	otp_setpack(sockfd, FALSE);
+	if (otp_send(sockfd, id) >= 0)
+		reply = otp_recv(sockfd);
+	if (!(reply && strcmp(reply, "OK") == 0) || (crc && otp_setcrc(sockfd, TRUE) == -1)
+			|| (pack && otp_setpack(sockfd, TRUE) == -1)) {
+		int status = (reply && otpc_refusal(reply) == OTPC_ERATE) ? OTPC_ERATE : OTPC_EREJECT;
+		otpbuf_free(reply);
+		close(sockfd);
+		return status;
+	}
+
+	otpbuf_free(reply);
+	return sockfd;
+}
+
+
+/* NAME
+ *  otpc_get
+ * SYNOPSYS
+ * 	takes an idle pooled connection to ep or opens a new one
+ *  sets pooled to TRUE if the connection came from the pool
+ */
+static int otpc_get(otpc *c, otpc_ep *ep, bool *pooled)
+{
+	int sockfd = -1;
+
+	pthread_mutex_lock(&c->lock);
+	if (ep->numidle > 0)
+		sockfd = ep->idle[--ep->numidle];
+	pthread_mutex_unlock(&c->lock);
+
+	*pooled = (sockfd != -1) ? TRUE : FALSE;
+	if (sockfd == -1)
+		sockfd = otpc_connect(c, ep);
+
+	return sockfd;
+}
+
+
+/* NAME
+ *  otpc_put
+ * SYNOPSYS
+ * 	returns a healthy connection to the pool, closes it if pool is full
+ */
+static void otpc_put(otpc *c, otpc_ep *ep, int sockfd)
+{
+	pthread_mutex_lock(&c->lock);
+	if (ep->numidle < c->maxidle) {
+		ep->idle[ep->numidle++] = sockfd;
+		sockfd = -1;
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	if (sockfd != -1)
+		close(sockfd);
+}
+
+
+/* NAME
+ *  otpc_refusal
+ * SYNOPSYS
+ * 	returns the otpc_status a daemon's refusal reply (OTP_REFUSED)
+ *  stands for, or OTPC_OK if reply is not a refusal
+ */
+static int otpc_refusal(const char *reply)
+{
+	if (reply[0] != OTP_REFUSED)
+		return OTPC_OK;
+	if (strcmp(reply, OTP_RSIZE) == 0)
+		return OTPC_ESIZE;
+	if (strcmp(reply, OTP_RBUSY) == 0)
+		return OTPC_EBUSY;
+	if (strcmp(reply, OTP_RRATE) == 0)
+		return OTPC_ERATE;
+	if (strcmp(reply, OTP_RREUSE) == 0)
+		return OTPC_EREUSE;
+	return OTPC_EIO;
+}
+
+
+/* NAME
+ *  otpc_roundtrip
+ * SYNOPSYS
+ * 	sends n messages over a pooled connection and receives one reply
+ *  a failed endpoint is ejected and the request retried on another;
+ *  a request the daemon refused is not, and the daemon is not ejected
+ */
+static int otpc_roundtrip(otpc *c, const char **msgs, size_t *lens, int n, char **out)
+{
+	int status = OTPC_EIO;
+	if (c->neps == 0)
+		return OTPC_ECONNECT;
+
+	// one try per endpoint, plus one since a pooled connection may
+	// have been closed by the daemon while idle
+	int attempt;
+	for (attempt = 0; attempt <= c->neps; attempt++) {
+		otpc_ep *ep = otpc_pick(c);
+		bool pooled = FALSE;
+		TRACE_REQ();
+		TRACE(TR_C_START, 0);
+		int sockfd = otpc_get(c, ep, &pooled);
+		if (sockfd == OTPC_ERATE) {
+			otpc_done(c, ep, TRUE);
+			return sockfd;
+		}
+		if (sockfd < 0) {
+			otpc_done(c, ep, FALSE);
+			status = sockfd;
+			continue;
+		}
+		TRACE(TR_C_CONNECT, pooled);
+
+		// send messages, receive result
+		char *result = NULL;
+		int i;
+		for (i = 0; i < n; i++) {
+			long sent = (i < n - 1) ? otp_sendn_more(sockfd, msgs[i], lens[i]) : otp_sendn(sockfd, msgs[i], lens[i]);
+			if (sent < 0)
+				break;
+			TRACE(i == 0 ? TR_C_SEND_IN : TR_C_SEND_KEY, lens[i]);
+		}
+		if (i == n)
+			result = otp_recv(sockfd);
+		TRACE(TR_C_RECV, result ? strlen(result) : 0);
+
+		int refused = result ? otpc_refusal(result) : OTPC_OK;
+		if (refused != OTPC_OK) {
+			otpbuf_free(result);
+			close(sockfd);
+			otpc_done(c, ep, TRUE);
+			return refused;
+		}
+		if (result) {
+			otpc_put(c, ep, sockfd);
+			otpc_done(c, ep, TRUE);
+			*out = result;
+			return OTPC_OK;
+		}
+
+		// a stale pooled connection says nothing about the endpoint
+		close(sockfd);
+		otpc_done(c, ep, pooled);
+		status = OTPC_EIO;
+	}
+
+	return status;
+}
+
+
+/* NAME
+ *  otpc_resumed
+ * SYNOPSYS
+ * 	otpc_roundtrip, except that a request broken part way (not one
+ *  that never reached a daemon) keeps reconnecting and resending for
+ *  c->resume seconds; each reply acknowledges its request, so a
+ *  series of them picks up after the last one answered
+ */
+static int otpc_resumed(otpc *c, const char **msgs, size_t *lens, int n, char **out)
+{
+	double until = 0;
+	int ms = OTPC_RESUME_MS;
+	while (1) {
+		int status = otpc_roundtrip(c, msgs, lens, n, out);
+		if (status == OTPC_OK || c->resume <= 0)
+			return status;
+		if (status != OTPC_EIO && !(status == OTPC_ECONNECT && until > 0))
+			return status;
+		if (until == 0)
+			until = otpc_now() + c->resume;
+		if (otpc_now() + ms / 1000.0 > until)
+			return status;
+		usleep(ms * 1000);
+		if (ms < OTPC_EJECT_MS)
+			ms = ms * 2;
+	}
+}
+
+
+/* NAME
+ *  otpc_request
+ * SYNOPSYS
+ * 	sends one already-validated input and key and receives the result;
+ *  input over OTPC_MAXREQ goes as a series of requests, so no daemon
+ *  has to hold all of it (or refuse it) at once, and a broken
+ *  connection costs only the request in hand
+ */
+static int otpc_request(otpc *c, const char *in, size_t len, const char *key, size_t keylen, char **out)
+{
+	if (c->local) {
+		if (!(*out = otpbuf_alloc(len)))
+			return OTPC_EIO;
+		otpc_cipher(c, in, key, *out, len);
+		return OTPC_OK;
+	}
+	if (len <= OTPC_MAXREQ) {
+		const char *msgs[2] = {in, key};
+		size_t lens[2] = {len, keylen};
+		return otpc_resumed(c, msgs, lens, 2, out);
+	}
+
+	char *all = otpbuf_alloc(len);
+	if (!all)
+		return OTPC_EIO;
+	size_t done = 0;
+	while (done < len) {
+		size_t n = (len - done < OTPC_MAXREQ) ? len - done : OTPC_MAXREQ;
+		const char *msgs[2] = {in + done, key + done};
+		size_t lens[2] = {n, n};
+		char *part = NULL;
+		int status = otpc_resumed(c, msgs, lens, 2, &part);
+		if (status != OTPC_OK || strlen(part) != n) {
+			otpbuf_free(part);
+			otpbuf_free(all);
+			return (status != OTPC_OK) ? status : OTPC_EIO;
+		}
+		memcpy(all + done, part, n);
+		otpbuf_free(part);
+		done += n;
+	}
+	all[len] = '\0';
+	*out = all;
+	return OTPC_OK;
+}
+
+
+/* NAME
+ *  otpc_query
+ * SYNOPSYS
+ * 	sends a single request line (e.g. "STATS") and receives the reply;
+ *  a client created with OTPC_STATS gets a daemon's lane stats
+ */
+int otpc_query(otpc *c, const char *req, char **out)
+{
+	size_t len = strlen(req);
+	*out = NULL;
+	return otpc_roundtrip(c, &req, &len, 1, out);
+}
+
+
+/* NAME
+ *  otpc_claimpad
+ * SYNOPSYS
+ * 	claims len characters of fresh pad from a keygen service
+ *  (client created with OTPC_KEY); *pad is owned by caller
+ */
+int otpc_claimpad(otpc *c, size_t len, char **pad)
+{
+	char req[32];
+	sprintf(req, "CLAIM %zu", len);
+
+	int status = otpc_query(c, req, pad);
+	if (status == OTPC_OK && strlen(*pad) != len) {
+		otpbuf_free(*pad);
+		*pad = NULL;
+		status = OTPC_EIO;
+	}
+
+	return status;
+}
+
+
+/* NAME
+ *  otpc_crypt
+ * SYNOPSYS
+ * 	encrypts (or decrypts) len bytes of in with key, blocking
+ *  on success *out is a dynamically allocated string owned by caller
+ *  returns OTPC_OK or a negative otpc_status
+ */
+int otpc_crypt(otpc *c, const char *in, size_t len, const char *key, size_t keylen, char **out)
+{
+	*out = NULL;
+
+	// error checking: valid characters
+	if (!hasValidCharsn(in, len))
+		return OTPC_ECHARS;
+
+	// compress plaintext first, so the key check sees what is sent
+	char *packed = NULL;
+	if (c->compress && c->mode == OTPC_ENC) {
+		packed = otp_compress(in, len, &len);
+		if (!packed)
+			return OTPC_EIO;
+		in = packed;
+	}
+
+	// only the first len characters of key are used, or sent
+	int status = OTPC_EKEY;
+	if (len <= keylen)
+		status = (c->keychecked || hasValidCharsn(key, len)) ? otpc_request(c, in, len, key, len, out) : OTPC_ECHARS;
+	otpbuf_free(packed);
+
+	// decompress decrypted text
+	if (status == OTPC_OK && c->compress && c->mode == OTPC_DEC) {
+		size_t n;
+		char *plain = otp_decompress(*out, strlen(*out), &n);
+		otpbuf_free(*out);
+		*out = plain;
+		if (!plain)
+			status = OTPC_ECOMP;
+	}
+
+	return status;
+}
+
+
+/* NAME
+ *  otpc_batch1
+ * SYNOPSYS
+ * 	sends n inputs, total characters, as one batch request with key
+ *  from key, and copies the outputs to out
+ */
+static int otpc_batch1(otpc *c, const char **ins, const size_t *lens, int n, const char *key, size_t total, char *out)
+{
+	int i;
+	if (c->local) {
+		size_t off = 0;
+		for (i = 0; i < n; i++) {
+			otpc_cipher(c, ins[i], key + off, out + off, lens[i]);
+			off += lens[i];
+		}
+		return OTPC_OK;
+	}
+
+	// "#<count> <len> <len> ... " then inputs, then key
+	char *frame = otpbuf_alloc(22 * (n + 1) + 2 * total);
+	if (!frame)
+		return OTPC_EIO;
+	size_t pos = sprintf(frame, "%c%d ", OTP_BATCH, n);
+	for (i = 0; i < n; i++)
+		pos += sprintf(frame + pos, "%zu ", lens[i]);
+	size_t hdrlen = pos;
+	for (i = 0; i < n; i++) {
+		memcpy(frame + pos, ins[i], lens[i]);
+		pos += lens[i];
+	}
+	memcpy(frame + pos, key, total);
+	pos += total;
+
+	// the reply repeats the header, then the outputs
+	const char *msg = frame;
+	char *reply = NULL;
+	int status = otpc_resumed(c, &msg, &pos, 1, &reply);
+	if (status == OTPC_OK && (strlen(reply) != hdrlen + total || memcmp(reply, frame, hdrlen) != 0))
+		status = OTPC_EIO;
+	if (status == OTPC_OK)
+		memcpy(out, reply + hdrlen, total);
+
+	explicit_bzero(frame + hdrlen + total, total);
+	otpbuf_free(frame);
+	otpbuf_free(reply);
+	return status;
+}
+
+
+/* NAME
+ *  otpc_batch
+ * SYNOPSYS
+ * 	encrypts (or decrypts) n inputs in as few round trips as it can,
+ *  as batch requests of up to OTPC_MAXREQ characters each; the inputs
+ *  use consecutive key from key, as one message of them all would.
+ *  No compression. On success *out holds the outputs one after
+ *  another, lens[i] characters each, owned by caller
+ *  returns OTPC_OK or a negative otpc_status
+ */
+int otpc_batch(otpc *c, const char **ins, const size_t *lens, int n, const char *key, size_t keylen, char **out)
+{
+	*out = NULL;
+	if (c->mode != OTPC_ENC && c->mode != OTPC_DEC)
+		return OTPC_EREJECT;
+
+	size_t total = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		if (!hasValidCharsn(ins[i], lens[i]))
+			return OTPC_ECHARS;
+		total += lens[i];
+	}
+	if (total > keylen)
+		return OTPC_EKEY;
+	if (!c->keychecked && !hasValidCharsn(key, total))
+		return OTPC_ECHARS;
+
+	char *all = otpbuf_alloc(total);
+	if (!all)
+		return OTPC_EIO;
+	int status = OTPC_OK;
+	size_t done = 0;
+	int first = 0;
+	while (status == OTPC_OK && first < n) {
+		// as many entries as fit, at least one
+		int last = first;
+		size_t size = 0, sub = 0;
+		while (last < n && (last == first || size + 2 * lens[last] + 22 <= OTPC_MAXREQ)) {
+			size += 2 * lens[last] + 22;
+			sub += lens[last];
+			last++;
+		}
+		status = otpc_batch1(c, ins + first, lens + first, last - first, key + done, sub, all + done);
+		done += sub;
+		first = last;
+	}
+
+	if (status != OTPC_OK) {
+		otpbuf_free(all);
+		return status;
+	}
+	all[total] = '\0';
+	*out = all;
+	return OTPC_OK;
+}
+
+
+/* NAME
+ *  otpc_setcompress
+ * SYNOPSYS
+ * 	enables compression of plaintext before encryption (OTPC_ENC)
+ *  or decompression after decryption (OTPC_DEC)
+ */
+void otpc_setcompress(otpc *c, bool on)
+{
+	c->compress = on;
+}
+
+
+/* NAME
+ *  otpc_setkeychecked
+ * SYNOPSYS
+ * 	skips the key character scan, for keys from a container whose
+ *  characters were checked when it was written (otpkey.h)
+ */
+void otpc_setkeychecked(otpc *c, bool on)
+{
+	c->keychecked = on;
+}
+
+
+/* NAME
+ *  otpc_setresume
+ * SYNOPSYS
+ * 	sets how long a request or stream broken part way keeps trying to
+ *  reconnect and resend what was not answered (default OTPC_RESUME
+ *  seconds, 0 to fail at once)
+ */
+void otpc_setresume(otpc *c, int seconds)
+{
+	c->resume = seconds;
+}
+
+
+/* NAME
+ *  otpc_worker
+ * SYNOPSYS
+ * 	thread body for otpc_crypt_async
+ */
+static void * otpc_worker(void *job)
+{
+	otpc_job *j = (otpc_job *) job;
+	char *out = NULL;
+
+	int status = otpc_crypt(j->c, j->in, j->len, j->key, j->keylen, &out);
+	j->cb(status, out, out ? strlen(out) : 0, j->arg);
+
+	free(j);
+	return NULL;
+}
+
+
+/* NAME
+ *  otpc_crypt_async
+ * SYNOPSYS
+ * 	as otpc_crypt, but returns immediately and calls cb from another
+ *  thread on completion; in and key must stay valid until then
+ *  returns OTPC_OK if the request was started
+ */
+int otpc_crypt_async(otpc *c, const char *in, size_t len, const char *key, size_t keylen, otpc_cb cb, void *arg)
+{
+	otpc_job *j = (otpc_job *) calloc(1, sizeof(otpc_job));
+	j->c = c;
+	j->in = in;
+	j->len = len;
+	j->key = key;
+	j->keylen = keylen;
+	j->cb = cb;
+	j->arg = arg;
+
+	pthread_t tid;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	int status = pthread_create(&tid, &attr, otpc_worker, j);
+	pthread_attr_destroy(&attr);
+
+	if (status != 0) {
+		free(j);
+		return OTPC_EIO;
+	}
+
+	return OTPC_OK;
+}
+
+
+/* NAME
+ *  otpc_strerror
+ * SYNOPSYS
+ * 	returns message for an otpc_status
+ */
+const char * otpc_strerror(int status)
+{
+	switch (status)
+	{
+		case OTPC_OK:
+			return "Success";
+		case OTPC_ECONNECT:
+			return "Unable to connect";
+		case OTPC_EREJECT:
+			return "ID mismatch, connection rejected";
+		case OTPC_EIO:
+			return "Connection lost during request";
+		case OTPC_ECHARS:
+			return "Invalid characters in file";
+		case OTPC_EKEY:
+			return "Key too short";
+		case OTPC_ECOMP:
+			return "Malformed compressed message";
+		case OTPC_ESIZE:
+			return "Request larger than ring slot or daemon limit";
+		case OTPC_EFULL:
+			return "Ring full, collect results first";
+		case OTPC_EREUSE:
+			return "Key reuse, request refused";
+		case OTPC_ERATE:
+			return "Over rate limit, request refused";
+		case OTPC_EBUSY:
+			return "Daemon busy, request refused";
+		default:
+			return "Unknown error";
+	}
+}
+
+
+/* NAME
+ *  otpc_pipe_fail
+ * SYNOPSYS
+ * 	records the first failure of a stream and wakes both halves
+ */
+static void otpc_pipe_fail(otpc_pipe *p, int status)
+{
+	pthread_mutex_lock(&p->lock);
+	if (p->status == OTPC_OK)
+		p->status = status;
+	p->eof = TRUE;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+	shutdown(p->sockfd, SHUT_RDWR);
+	otpc_pipe_wake(p);
+}
+
+
+/* NAME
+ *  otpc_pipe_wake
+ * SYNOPSYS
+ * 	wakes the sender of a stream if it is waiting for input
+ */
+static void otpc_pipe_wake(otpc_pipe *p)
+{
+	uint64_t one = 1;
+	if (write(p->wake, &one, sizeof(one)) == -1)
+		return;
+}
+
+
+/* NAME
+ *  otpc_sender
+ * SYNOPSYS
+ * 	sending half of a stream: reads input as it arrives, pairs each
+ *  chunk with the next key window and sends both without waiting for
+ *  replies, up to OTPC_WINDOW ahead; a newline at the very end of
+ *  input is dropped; after a new connection, first sends again the
+ *  chunks not answered, while the receiving half reads their replies
+ */
+static void * otpc_sender(void *pipe)
+{
+	otpc_pipe *p = (otpc_pipe *) pipe;
+	char *key = (char *) malloc(OTPC_CHUNK);
+	size_t keyfor = (size_t) -1;		// request whose key is in key
+	bool nl = FALSE;					// newline held back from last chunk
+	int status = key ? OTPC_OK : OTPC_EIO;
+
+	while (status == OTPC_OK) {
+		// a request to send, or a free slot to hold new input until it
+		// is answered; at the end of input, stay for requests to send
+		// again until all are answered
+		pthread_mutex_lock(&p->lock);
+		while (p->status == OTPC_OK && (p->broken || (p->sent == p->queued
+				&& (p->eof ? p->acked < p->queued : p->queued - p->acked >= OTPC_WINDOW))))
+			pthread_cond_wait(&p->cond, &p->lock);
+		status = p->status;
+		bool done = (p->eof && p->acked == p->queued) ? TRUE : FALSE;
+		bool fresh = (p->sent == p->queued) ? TRUE : FALSE;
+		char *in = p->held[p->queued % OTPC_WINDOW];
+		size_t used = p->used;
+		pthread_mutex_unlock(&p->lock);
+		if (status != OTPC_OK || done)
+			break;
+
+		if (fresh) {
+			// input, or a new connection to send chunks again over
+			struct pollfd fds[2] = {{p->infd, POLLIN, 0}, {p->wake, POLLIN, 0}};
+			if (poll(fds, 2, -1) == -1 && errno != EINTR) {
+				status = OTPC_EIO;
+				break;
+			}
+			if (fds[1].revents & POLLIN) {
+				uint64_t n;
+				if (read(p->wake, &n, sizeof(n)) == -1 && errno != EAGAIN)
+					status = OTPC_EIO;
+				continue;
+			}
+			if (fds[0].revents == 0)
+				continue;
+
+			size_t len = 0;
+			status = otpc_chunk(p->infd, p->keyfd, p->keyoff + used, in, key, &len, &nl);
+			if (status != OTPC_OK)
+				break;
+			pthread_mutex_lock(&p->lock);
+			if (len == 0)
+				p->eof = TRUE;
+			else {
+				int slot = p->queued % OTPC_WINDOW;
+				p->heldlen[slot] = len;
+				p->heldoff[slot] = p->used;
+				keyfor = p->queued;
+				p->queued++;
+				p->used = p->used + len;
+			}
+			pthread_cond_broadcast(&p->cond);
+			pthread_mutex_unlock(&p->lock);
+			continue;
+		}
+
+		// the next request in order, new or not answered on a lost
+		// connection; counted as sent before it is, so a send that
+		// fails leaves it to be sent again with the others
+		pthread_mutex_lock(&p->lock);
+		int sockfd = p->sockfd;
+		size_t next = p->sent;
+		int slot = next % OTPC_WINDOW;
+		size_t len = p->heldlen[slot];
+		size_t off = p->heldoff[slot];
+		p->sent++;
+		p->sending = TRUE;
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->lock);
+
+		// key of a request sent again is read again
+		bool ok = TRUE;
+		if (next != keyfor) {
+			ok = (pread(p->keyfd, key, len, p->keyoff + off) == (ssize_t) len) ? TRUE : FALSE;
+			keyfor = ok ? next : (size_t) -1;
+		}
+		if (ok)
+			ok = (otp_sendn_more(sockfd, p->held[slot], len) >= 0 && otp_sendn(sockfd, key, len) >= 0) ? TRUE : FALSE;
+		pthread_mutex_lock(&p->lock);
+		p->sending = FALSE;
+		if (!ok && p->resume > 0)
+			p->broken = TRUE;
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->lock);
+		if (!ok && p->resume <= 0)
+			status = OTPC_EIO;
+	}
+
+	if (key)
+		explicit_bzero(key, OTPC_CHUNK);
+	free(key);
+	if (status != OTPC_OK)
+		otpc_pipe_fail(p, status);
+	return NULL;
+}
+
+
+/* NAME
+ *  otpc_chunk
+ * SYNOPSYS
+ * 	reads the next chunk of a stream's input into in (OTPC_CHUNK), after
+ *  the newline held back from the last one if *nl, holding back a
+ *  newline at its end in turn, so one at the very end of input is
+ *  dropped; then reads its key window from keyfd at keyoff into key,
+ *  which ends at the key file's newline
+ *  sets *len to the characters read, 0 at the end of input; returns
+ *  OTPC_OK or error
+ */
+static int otpc_chunk(int infd, int keyfd, size_t keyoff, char *in, char *key, size_t *len, bool *nl)
+{
+	size_t have = 0;
+	while (have == 0) {
+		if (*nl)
+			in[have++] = '\n';
+		ssize_t n = read(infd, in + have, OTPC_CHUNK - have);
+		if (n == -1 && errno == EINTR) {
+			have = 0;
+			continue;
+		}
+		if (n == -1)
+			return OTPC_EIO;
+		if (n == 0) {
+			*len = 0;
+			return OTPC_OK;
+		}
+		have = have + n;
+		*nl = (in[have - 1] == '\n') ? TRUE : FALSE;
+		if (*nl)
+			have--;
+	}
+	if (!hasValidCharsn(in, have))
+		return OTPC_ECHARS;
+
+	size_t got = 0;
+	while (got < have) {
+		ssize_t n = pread(keyfd, key + got, have - got, keyoff + got);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		got = got + n;
+	}
+	char *end = memchr(key, '\n', got);
+	if (end)
+		got = end - key;
+	if (got < have)
+		return OTPC_EKEY;
+	if (!hasValidCharsn(key, have))
+		return OTPC_ECHARS;
+	*len = have;
+	return OTPC_OK;
+}
+
+
+/* NAME
+ *  otpc_pipe_resume
+ * SYNOPSYS
+ * 	receiving half of a stream: replaces a broken connection, for up
+ *  to p->resume seconds since the last reply, and has the sender send
+ *  the requests not yet answered again over the new one, so the stream
+ *  carries on from the last reply
+ *  returns OTPC_OK, OTPC_ERATE if a daemon refused the connection, or
+ *  OTPC_EIO if no daemon took them in time
+ */
+static int otpc_pipe_resume(otpc *c, otpc_pipe *p, otpc_ep **ep)
+{
+	// stop the sender, and wait until it is out of the old socket
+	pthread_mutex_lock(&p->lock);
+	p->broken = TRUE;
+	pthread_mutex_unlock(&p->lock);
+	shutdown(p->sockfd, SHUT_RDWR);
+	pthread_mutex_lock(&p->lock);
+	while (p->sending)
+		pthread_cond_wait(&p->cond, &p->lock);
+	pthread_mutex_unlock(&p->lock);
+	close(p->sockfd);
+	otpc_done(c, *ep, FALSE);
+
+	// a connection that breaks again before any reply does not restart
+	// the period
+	if (p->until == 0)
+		p->until = otpc_now() + p->resume;
+	int ms = OTPC_RESUME_MS;
+	while (otpc_now() < p->until) {
+		*ep = otpc_pick(c);
+		int sockfd = otpc_connect(c, *ep);
+		if (sockfd == OTPC_ERATE) {
+			otpc_done(c, *ep, TRUE);
+			*ep = NULL;
+			p->sockfd = -1;
+			return sockfd;
+		}
+		if (sockfd >= 0) {
+			pthread_mutex_lock(&p->lock);
+			p->sockfd = sockfd;
+			p->sent = p->acked;
+			p->broken = FALSE;
+			pthread_cond_broadcast(&p->cond);
+			pthread_mutex_unlock(&p->lock);
+			otpc_pipe_wake(p);
+			return OTPC_OK;
+		}
+		otpc_done(c, *ep, FALSE);
+		usleep(ms * 1000);
+		if (ms < OTPC_EJECT_MS)
+			ms = ms * 2;
+	}
+
+	*ep = NULL;
+	p->sockfd = -1;
+	return OTPC_EIO;
+}
+
+
+/* NAME
+ *  otpc_stream
+ * SYNOPSYS
+ * 	encrypts / decrypts everything read from infd to outfd, using key
+ *  from keyfd starting at keyoff, with bounded memory: one thread
+ *  sends input in chunks of up to OTPC_CHUNK while this one writes
+ *  results as they come back, so sending and receiving overlap; if the
+ *  connection breaks, the chunks not yet answered go again over a new
+ *  one (otpc_setresume)
+ *  sets used to the key characters sent; returns OTPC_OK or error
+ */
+int otpc_stream(otpc *c, int infd, int outfd, int keyfd, size_t keyoff, size_t *used)
+{
+	*used = 0;
+	if (c->local)
+		return otpc_stream_local(c, infd, outfd, keyfd, keyoff, used);
+
+	// a fresh connection, not a pooled one that may have gone stale
+	otpc_ep *ep = otpc_pick(c);
+	int sockfd = otpc_connect(c, ep);
+	if (sockfd < 0) {
+		otpc_done(c, ep, (sockfd == OTPC_ERATE) ? TRUE : FALSE);
+		return sockfd;
+	}
+
+	otpc_pipe p;
+	memset(&p, 0, sizeof(p));
+	p.sockfd = sockfd;
+	p.infd = infd;
+	p.keyfd = keyfd;
+	p.keyoff = keyoff;
+	p.resume = c->resume;
+	p.status = OTPC_OK;
+	p.wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	pthread_mutex_init(&p.lock, NULL);
+	pthread_cond_init(&p.cond, NULL);
+	bool held = (p.wake >= 0) ? TRUE : FALSE;
+	int i;
+	for (i = 0; i < OTPC_WINDOW; i++)
+		if (!(p.held[i] = (char *) malloc(OTPC_CHUNK)))
+			held = FALSE;
+
+	pthread_t sender;
+	if (!held || pthread_create(&sender, NULL, otpc_sender, &p) != 0) {
+		for (i = 0; i < OTPC_WINDOW; i++)
+			free(p.held[i]);
+		if (p.wake >= 0)
+			close(p.wake);
+		close(sockfd);
+		otpc_done(c, ep, TRUE);
+		return OTPC_EIO;
+	}
+
+	// receive one reply per request sent, in order, until input is
+	// finished and every request answered
+	while (1) {
+		pthread_mutex_lock(&p.lock);
+		while (p.status == OTPC_OK && p.acked == p.sent && !(p.eof && p.acked == p.queued) && !p.broken)
+			pthread_cond_wait(&p.cond, &p.lock);
+		bool broken = (p.broken && p.status == OTPC_OK) ? TRUE : FALSE;
+		bool more = (p.acked < p.sent && p.status == OTPC_OK) ? TRUE : FALSE;
+		pthread_mutex_unlock(&p.lock);
+		if (broken) {
+			int status = otpc_pipe_resume(c, &p, &ep);
+			if (status != OTPC_OK) {
+				otpc_pipe_fail(&p, status);
+				break;
+			}
+			continue;
+		}
+		if (!more)
+			break;
+
+		char *result = otp_recv(p.sockfd);
+		if (!result && p.resume > 0) {
+			pthread_mutex_lock(&p.lock);
+			p.broken = TRUE;
+			pthread_mutex_unlock(&p.lock);
+			continue;
+		}
+		if (!result) {
+			otpc_pipe_fail(&p, OTPC_EIO);
+			break;
+		}
+		int refused = otpc_refusal(result);
+		if (refused != OTPC_OK) {
+			otpbuf_free(result);
+			otpc_pipe_fail(&p, refused);
+			break;
+		}
+		size_t len = strlen(result);
+		size_t written = 0;
+		while (written < len) {
+			ssize_t n = write(outfd, result + written, len - written);
+			if (n == -1 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				break;
+			written = written + n;
+		}
+		otpbuf_free(result);
+		if (written < len) {
+			otpc_pipe_fail(&p, OTPC_EIO);
+			break;
+		}
+		pthread_mutex_lock(&p.lock);
+		p.acked++;
+		p.until = 0;
+		pthread_cond_broadcast(&p.cond);
+		pthread_mutex_unlock(&p.lock);
+	}
+
+	pthread_join(sender, NULL);
+	close(p.wake);
+	pthread_mutex_destroy(&p.lock);
+	pthread_cond_destroy(&p.cond);
+	for (i = 0; i < OTPC_WINDOW; i++) {
+		explicit_bzero(p.held[i], OTPC_CHUNK);
+		free(p.held[i]);
+	}
+
+	// key sent is spent, even if the stream failed part way
+	*used = p.used;
+	if (p.status == OTPC_OK)
+		otpc_put(c, ep, p.sockfd);
+	else if (p.sockfd >= 0)
+		close(p.sockfd);
+	if (ep)
+		otpc_done(c, ep, (p.status == OTPC_EIO) ? FALSE : TRUE);
+	return p.status;
+}
+
+
+/* NAME
+ *  otpc_stream_local
+ * SYNOPSYS
+ * 	otpc_stream for a local client: each chunk is run through the
+ *  cipher in place and written out before the next is read
+ */
+static int otpc_stream_local(otpc *c, int infd, int outfd, int keyfd, size_t keyoff, size_t *used)
+{
+	char *in = (char *) malloc(OTPC_CHUNK + 1);
+	char *key = (char *) malloc(OTPC_CHUNK);
+	bool nl = FALSE;
+	int status = (in && key) ? OTPC_OK : OTPC_EIO;
+
+	while (status == OTPC_OK) {
+		size_t len = 0;
+		status = otpc_chunk(infd, keyfd, keyoff + *used, in, key, &len, &nl);
+		if (status != OTPC_OK || len == 0)
+			break;
+		otpc_cipher(c, in, key, in, len);
+		*used = *used + len;
+
+		size_t written = 0;
+		while (written < len) {
+			ssize_t n = write(outfd, in + written, len - written);
+			if (n == -1 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				break;
+			written = written + n;
+		}
+		if (written < len)
+			status = OTPC_EIO;
+	}
+
+	if (in)
+		explicit_bzero(in, OTPC_CHUNK + 1);
+	if (key)
+		explicit_bzero(key, OTPC_CHUNK);
+	free(in);
+	free(key);
+	return status;
+}
+
+
+/* NAME
+ *  otpc_cipher
+ * SYNOPSYS
+ * 	runs the cipher engine for c's mode over len characters of in and
+ *  key into out, which may be in, and terminates it
+ */
+static void otpc_cipher(otpc *c, const char *in, const char *key, char *out, size_t len)
+{
+	if (c->mode == OTPC_ENC)
+		otpcipher_encode(in, key, out, len);
+	else
+		otpcipher_decode(in, key, out, len);
+}
+
+
+/* NAME
+ *  otpc_shm_new
+ * SYNOPSYS
+ * 	connects to the unix socket at path of a local daemon (started
+ *  with -U) and hands it a shared memory ring of OTPSHM_SLOTS slots
+ *  of up to maxlen characters each
+ *  returns NULL if the daemon is unreachable or refuses
+ */
+otpc_shm * otpc_shm_new(char *path, otpc_mode mode, size_t maxlen)
+{
+	if (mode == OTPC_KEY || mode == OTPC_STATS)
+		return NULL;
+	int sockfd = initialize(path, "0", CONNECT);
+	if (sockfd == -1)
+		return NULL;
+	otp_setcrc(sockfd, FALSE);
+	otp_setpack(sockfd, FALSE);
+
+	// ask for a ring in the handshake, then pass it
+	char id[8];
+	sprintf(id, "%s%s", (mode == OTPC_ENC) ? "enc" : "dec", OTPSHM_ID);
+	char *reply = NULL;
+	if (otp_send(sockfd, id) >= 0)
+		reply = otp_recv(sockfd);
+	bool ok = (reply && strcmp(reply, "OK") == 0) ? TRUE : FALSE;
+	otpbuf_free(reply);
+
+	otpc_shm *s = (otpc_shm *) calloc(1, sizeof(otpc_shm));
+	s->sockfd = sockfd;
+	if (!ok || otpshm_create(&s->ring, maxlen) == -1) {
+		close(sockfd);
+		free(s);
+		return NULL;
+	}
+	int fds[3] = {s->ring.memfd, s->ring.reqfd, s->ring.donefd};
+	if (otp_sendfds(sockfd, fds, 3) == -1) {
+		otpc_shm_free(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+
+/* NAME
+ *  otpc_shm_free
+ * SYNOPSYS
+ * 	hangs up on the daemon and releases the ring; results not yet
+ *  collected are lost
+ */
+void otpc_shm_free(otpc_shm *s)
+{
+	if (!s)
+		return;
+	close(s->sockfd);
+	otpshm_close(&s->ring);
+	free(s);
+}
+
+
+/* NAME
+ *  otpc_shm_reserve
+ * SYNOPSYS
+ * 	hands out the next slot for a request of len characters: the
+ *  caller writes input to *in and key to *key, in place, then calls
+ *  otpc_shm_submit
+ *  returns OTPC_OK, OTPC_ESIZE, or OTPC_EFULL if OTPSHM_SLOTS results
+ *  are waiting to be collected
+ */
+int otpc_shm_reserve(otpc_shm *s, size_t len, char **in, char **key)
+{
+	if (len > s->ring.maxlen)
+		return OTPC_ESIZE;
+	if (s->head - s->done >= s->ring.nslots)
+		return OTPC_EFULL;
+
+	otpshm_slot *slot = otpshm_slotat(&s->ring, s->head);
+	slot->len = len;
+	*in = slot->data;
+	*key = otpshm_key(&s->ring, slot);
+	s->reserved = TRUE;
+	return OTPC_OK;
+}
+
+
+/* NAME
+ *  otpc_shm_submit
+ * SYNOPSYS
+ * 	publishes the reserved slot to the daemon
+ */
+int otpc_shm_submit(otpc_shm *s)
+{
+	if (!s->reserved)
+		return OTPC_EFULL;
+	s->reserved = FALSE;
+	s->head++;
+	__atomic_store_n(&s->ring.ring->head, s->head, __ATOMIC_RELEASE);
+	otpshm_signal(s->ring.reqfd);
+	return OTPC_OK;
+}
+
+
+/* NAME
+ *  otpc_shm_result
+ * SYNOPSYS
+ * 	waits for the oldest submitted request; *out points at its result
+ *  inside the ring, valid until the slot is reserved again
+ *  returns OTPC_OK, the request's failure, or OTPC_EIO if the daemon
+ *  has gone
+ */
+int otpc_shm_result(otpc_shm *s, const char **out, size_t *len)
+{
+	if (s->done == s->head)
+		return OTPC_EIO;
+
+	struct pollfd pfd[2];
+	pfd[0].fd = s->ring.donefd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = s->sockfd;
+	pfd[1].events = POLLIN;
+	while (__atomic_load_n(&s->ring.ring->tail, __ATOMIC_ACQUIRE) <= s->done) {
+		if (poll(pfd, 2, -1) == -1 && errno != EINTR)
+			return OTPC_EIO;
+		if (pfd[0].revents & POLLIN)
+			otpshm_clear(s->ring.donefd);
+		else if (pfd[1].revents & (POLLIN | POLLHUP)) {
+			if (__atomic_load_n(&s->ring.ring->tail, __ATOMIC_ACQUIRE) > s->done)
+				break;
+			return OTPC_EIO;
+		}
+	}
+
+	otpshm_slot *slot = otpshm_slotat(&s->ring, s->done++);
+	*out = slot->data;
+	*len = slot->len;
+	switch (slot->status)
+	{
+		case SHM_OK:
+			return OTPC_OK;
+		case SHM_ECHARS:
+			return OTPC_ECHARS;
+		case SHM_ESIZE:
+			return OTPC_ESIZE;
+		case SHM_EREUSE:
+			return OTPC_EREUSE;
+		case SHM_ERATE:
+			return OTPC_ERATE;
+		default:
+			return OTPC_EIO;
+	}
+}
+
+
+/* NAME
+ *  otpc_shm_crypt
+ * SYNOPSYS
+ * 	otpc_crypt over a ring: copies in and the first len characters of
+ *  key into a slot and waits for the result, returned in *out (release
+ *  with otpbuf_free); no results may be waiting to be collected
+ */
+int otpc_shm_crypt(otpc_shm *s, const char *in, size_t len, const char *key, char **out)
+{
+	*out = NULL;
+	char *sin, *skey;
+	int status = otpc_shm_reserve(s, len, &sin, &skey);
+	if (status != OTPC_OK)
+		return status;
+	memcpy(sin, in, len);
+	memcpy(skey, key, len);
+	otpc_shm_submit(s);
+
+	const char *res;
+	size_t n;
+	status = otpc_shm_result(s, &res, &n);
+	if (status != OTPC_OK)
+		return status;
+	*out = otpbuf_alloc(len);
+	if (!*out)
+		return OTPC_EIO;
+	memcpy(*out, res, len);
+	return OTPC_OK;
+}
@@ -0,0 +1,124 @@
+#ifndef OTPCLIENT_H
+#define OTPCLIENT_H
+
+
+/*
+ * otpclient.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * embeddable client library (libotp) - header file
+ * encrypts / decrypts in-memory buffers through otp_enc_d / otp_dec_d,
+ * and claims pad from a keygen service, reusing pooled connections;
+ * requests are spread over one or more daemons, least outstanding
+ * requests first, and failing daemons are ejected for a while; a
+ * local client runs the daemons' cipher engine (otpcipher.h) in
+ * process instead, with no daemon at all; a request a daemon refuses
+ * (OTPC_ESIZE, OTPC_EBUSY, OTPC_ERATE, OTPC_EREUSE) fails at once,
+ * without retrying; all functions are thread-safe, except that an otpc_shm ring has a
+ * single producer and is used by one thread at a time
+ */
+
+
+/* LIBRARIES */
+#include <pthread.h>
+#include "otplib.h"
+#include "otpcomp.h"
+#include "otpshm.h"
+
+
+/* MACROS */
+#define OTPC_MAXIDLE 4					// idle connections kept per endpoint
+#define OTPC_MAXEPS 16					// endpoints per client
+#define OTPC_EJECT_MS 1000				// ejection after first failure, doubles
+#define OTPC_EJECT_MAX_MS 30000			// longest ejection
+#define OTPC_CHUNK (64 * 1024)			// largest request sent by otpc_stream
+#define OTPC_MAXREQ (16UL << 20)		// longer requests go as a series of this many characters
+#define OTPC_RESUME 10					// default seconds a broken request keeps reconnecting
+#define OTPC_RESUME_MS 100				// pause before the first reconnect, doubles
+#define OTPC_WINDOW 32					// otpc_stream requests awaiting replies, at most
+
+
+/* STRUCTS AND ENUMS */
+typedef enum otpc_mode {OTPC_ENC, OTPC_DEC, OTPC_KEY, OTPC_STATS} otpc_mode;
+
+// return codes, 0 on success
+typedef enum otpc_status {
+	OTPC_OK = 0,
+	OTPC_ECONNECT = -1,					// could not connect to daemon
+	OTPC_EREJECT = -2,					// daemon rejected our id
+	OTPC_EIO = -3,						// send / recv failed mid-request
+	OTPC_ECHARS = -4,					// invalid characters in input or key
+	OTPC_EKEY = -5,						// key shorter than input
+	OTPC_ECOMP = -6,					// decrypted text is not valid compressed data
+	OTPC_ESIZE = -7,					// request larger than a ring slot or -X
+	OTPC_EFULL = -8,					// every ring slot awaits collection
+	OTPC_EREUSE = -9,					// daemon refused reused key
+	OTPC_ERATE = -10,					// daemon refused request over our rate limit
+	OTPC_EBUSY = -11					// daemon had no memory or large request slot in time
+} otpc_status;
+
+// completion callback for async requests, takes ownership of result
+// (release with otpbuf_free)
+typedef void (*otpc_cb)(int status, char *result, size_t len, void *arg);
+
+// one daemon, with its pooled connections and health
+typedef struct otpc_ep {
+	char *host;
+	char *port;
+	int idle[OTPC_MAXIDLE];				// pooled connected sockets
+	int numidle;
+	int outstanding;					// requests in flight
+	int fails;							// consecutive failures
+	double ejected_until;				// skipped by balancer until then
+} otpc_ep;
+
+typedef struct otpc {
+	otpc_ep eps[OTPC_MAXEPS];
+	int neps;
+	int next;							// round robin start for ties
+	otpc_mode mode;
+	int maxidle;						// idle connections to keep open
+	bool compress;						// compress before enc / decompress after dec
+	bool keychecked;					// key characters already checked (otpkey.h)
+	int resume;							// seconds a broken request keeps reconnecting, 0 for none
+	bool local;							// run the cipher in process, no endpoints
+	pthread_mutex_t lock;				// guards endpoints and pools
+} otpc;
+
+
+// shared memory ring to a local daemon (otpshm.h)
+typedef struct otpc_shm {
+	otpshm ring;
+	int sockfd;							// unix socket, open while the ring is
+	uint64_t head;						// requests submitted
+	uint64_t done;						// results collected
+	bool reserved;						// next slot handed out, not yet submitted
+} otpc_shm;
+
+
+/* FUNCTION DECLARATIONS */
+otpc * otpc_new(char *host, char *port, otpc_mode mode);
+otpc * otpc_new_endpoints(const char *list, otpc_mode mode);
+otpc * otpc_new_local(otpc_mode mode);
+void otpc_free(otpc *c);
+int otpc_crypt(otpc *c, const char *in, size_t len, const char *key, size_t keylen, char **out);
+int otpc_batch(otpc *c, const char **ins, const size_t *lens, int n, const char *key, size_t keylen, char **out);
+int otpc_crypt_async(otpc *c, const char *in, size_t len, const char *key, size_t keylen, otpc_cb cb, void *arg);
+int otpc_stream(otpc *c, int infd, int outfd, int keyfd, size_t keyoff, size_t *used);
+void otpc_setcompress(otpc *c, bool on);
+void otpc_setkeychecked(otpc *c, bool on);
+void otpc_setresume(otpc *c, int seconds);
+int otpc_query(otpc *c, const char *req, char **out);
+int otpc_claimpad(otpc *c, size_t len, char **pad);
+otpc_shm * otpc_shm_new(char *path, otpc_mode mode, size_t maxlen);
+void otpc_shm_free(otpc_shm *s);
+int otpc_shm_reserve(otpc_shm *s, size_t len, char **in, char **key);
+int otpc_shm_submit(otpc_shm *s);
+int otpc_shm_result(otpc_shm *s, const char **out, size_t *len);
+int otpc_shm_crypt(otpc_shm *s, const char *in, size_t len, const char *key, char **out);
+const char * otpc_strerror(int status);
+
+#endif
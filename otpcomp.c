@@ -0,0 +1,394 @@
+/*
+ * otpcomp.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * compression within the 27-symbol alphabet
+ *
+ * an adaptive order-1 range coder over A-Z + space; the coded
+ * bytes are written back out as symbols of the same alphabet
+ * (14 bits -> 3 symbols, since 2^14 <= 27^3), so compressed text can
+ * be encrypted like any other message and uses proportionally less pad
+ *
+ * format: <mode symbol> <7 symbol length> <payload>
+ *  mode 'A' = stored (payload is the original text)
+ *  mode 'B' = coded
+ */
+
+
+/* LIBRARIES */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "otpbuf.h"
+#include "otpcomp.h"
+
+
+/* MACROS */
+#define NSYM 27
+#define HDRLEN OTPCOMP_OVERHEAD		// mode + length symbols
+#define LENSYMS 7						// 27^7 > 10^10
+#define GROUPBITS 14					// bits carried by 3 symbols
+#define RC_TOP (1U << 24)				// range coder renormalization bounds
+#define RC_BOT (1U << 16)
+#define MAXTOTAL RC_BOT					// rescale threshold for counts
+#define INC 24							// adaptation step
+#define MAXRATIO 8192					// bound on symbols decoded per payload symbol
+#define OUTSTART (64 * 1024)			// decoded symbols allocated at first, doubling
+
+
+/* STRUCTS AND ENUMS */
+// order-1 adaptive frequency model, context = previous symbol
+typedef struct model {
+	uint32_t freq[NSYM][NSYM];
+	uint32_t total[NSYM];
+} model;
+
+// byte sink that emits 3 symbols per 14 bits
+typedef struct symout {
+	char *buf;
+	size_t len;
+	size_t cap;
+	uint32_t acc;
+	int nbits;
+	int bad;							// set when buf could not grow
+} symout;
+
+// byte source reading 3 symbols per 14 bits
+typedef struct symin {
+	const char *buf;
+	size_t len;
+	size_t pos;
+	uint32_t acc;
+	int nbits;
+	int bad;							// set on a symbol group out of range, or past the end
+} symin;
+
+
+/* GLOBAL VARIABLES */
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ";
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  symval
+ * SYNOPSYS
+ * 	maps A-Z to 0-25, space to 26
+ */
+static inline int symval(char c)
+{
+	return (c == ' ') ? 26 : c - 'A';
+}
+
+
+/* NAME
+ *  model_init
+ * SYNOPSYS
+ * 	every symbol starts with count 1 in every context
+ */
+static void model_init(model *m)
+{
+	int i, j;
+	for (i = 0; i < NSYM; i++) {
+		for (j = 0; j < NSYM; j++)
+			m->freq[i][j] = 1;
+		m->total[i] = NSYM;
+	}
+}
+
+
+/* NAME
+ *  model_update
+ * SYNOPSYS
+ * 	bumps count of symbol s in context ctx, halving counts on overflow
+ */
+static inline void model_update(model *m, int ctx, int s)
+{
+	m->freq[ctx][s] += INC;
+	m->total[ctx] += INC;
+	if (m->total[ctx] > MAXTOTAL) {
+		int j;
+		m->total[ctx] = 0;
+		for (j = 0; j < NSYM; j++) {
+			m->freq[ctx][j] = (m->freq[ctx][j] + 1) / 2;
+			m->total[ctx] += m->freq[ctx][j];
+		}
+	}
+}
+
+
+/* NAME
+ *  put_group
+ * SYNOPSYS
+ * 	appends a 14 bit group as 3 symbols, growing buffer as needed;
+ *  drops it and sets o->bad if the buffer cannot grow
+ */
+static void put_group(symout *o, uint32_t v)
+{
+	if (o->bad)
+		return;
+	if (o->len + 4 >= o->cap) {
+		char *bigger = otpbuf_grow(o->buf, o->cap * 2);
+		if (!bigger) {
+			o->bad = 1;
+			return;
+		}
+		o->buf = bigger;
+		o->cap = o->cap * 2;
+	}
+	o->buf[o->len++] = alphabet[v / 729];
+	o->buf[o->len++] = alphabet[(v / 27) % 27];
+	o->buf[o->len++] = alphabet[v % 27];
+}
+
+
+/* NAME
+ *  put_byte
+ * SYNOPSYS
+ * 	appends one coded byte, flushing 3 symbols every 14 bits
+ */
+static inline void put_byte(symout *o, uint32_t byte)
+{
+	o->acc = (o->acc << 8) | (byte & 0xFF);
+	o->nbits += 8;
+	if (o->nbits >= GROUPBITS) {
+		o->nbits -= GROUPBITS;
+		put_group(o, (o->acc >> o->nbits) & 0x3FFF);
+		o->acc &= (1U << o->nbits) - 1;
+	}
+}
+
+
+/* NAME
+ *  get_byte
+ * SYNOPSYS
+ * 	reads one coded byte; the decoder reads exactly the bytes the
+ *  encoder wrote, so needing one past the end of input is malformed
+ *  and sets in->bad (the byte is then zero)
+ */
+static inline uint32_t get_byte(symin *in)
+{
+	if (in->nbits < 8) {
+		uint32_t v = 0;
+		if (in->pos + 3 <= in->len) {
+			v = symval(in->buf[in->pos]) * 729 +
+				symval(in->buf[in->pos + 1]) * 27 +
+				symval(in->buf[in->pos + 2]);
+			if (v >= (1 << GROUPBITS))
+				in->bad = 1;
+			in->pos += 3;
+		}
+		else
+			in->bad = 1;
+		in->acc = (in->acc << GROUPBITS) | (v & 0x3FFF);
+		in->nbits += GROUPBITS;
+	}
+
+	in->nbits -= 8;
+	return (in->acc >> in->nbits) & 0xFF;
+}
+
+
+/* NAME
+ *  put_header
+ * SYNOPSYS
+ * 	writes mode symbol and base 27 length
+ */
+static void put_header(char *buf, char mode, size_t len)
+{
+	int i;
+	buf[0] = mode;
+	for (i = LENSYMS; i >= 1; i--) {
+		buf[i] = alphabet[len % 27];
+		len = len / 27;
+	}
+}
+
+
+/* NAME
+ *  otp_compress
+ * SYNOPSYS
+ * 	compresses len symbols of in (A-Z or space) into a dynamically
+ *  allocated null-terminated string over the same alphabet
+ *  falls back to storing the input if coding would not shrink it
+ *  returns NULL if out of memory
+ */
+char * otp_compress(const char *in, size_t len, size_t *outlen)
+{
+	model *m = (model *) malloc(sizeof(model));
+	symout o = {0};
+	o.cap = len / 2 + 64;
+	o.buf = otpbuf_alloc(o.cap);
+	o.len = HDRLEN;
+	if (!m || !o.buf) {
+		free(m);
+		otpbuf_free(o.buf);
+		return NULL;
+	}
+	model_init(m);
+
+	// range code each symbol in context of the one before it
+	// (carryless range coder, 32 bit low / range)
+	uint32_t low = 0, range = 0xFFFFFFFF;
+	int ctx = 26;
+	size_t i;
+	int j;
+	for (i = 0; i < len && o.len < len + HDRLEN && !o.bad; i++) {
+		int s = symval(in[i]);
+		uint32_t *f = m->freq[ctx];
+		uint32_t cum = 0;
+		for (j = 0; j < s; j++)
+			cum += f[j];
+
+		range = range / m->total[ctx];
+		low = low + cum * range;
+		range = range * f[s];
+		while ((low ^ (low + range)) < RC_TOP ||
+			(range < RC_BOT && ((range = -low & (RC_BOT - 1)), 1))) {
+			put_byte(&o, low >> 24);
+			low = low << 8;
+			range = range << 8;
+		}
+
+		model_update(m, ctx, s);
+		ctx = s;
+	}
+	free(m);
+
+	// flush coder state and any partial bit group
+	for (j = 0; j < 4; j++) {
+		put_byte(&o, low >> 24);
+		low = low << 8;
+	}
+	if (o.nbits > 0)
+		put_group(&o, (o.acc << (GROUPBITS - o.nbits)) & 0x3FFF);
+
+	// store uncompressed if coding did not help, or ran out of room
+	if (i < len || o.len >= len + HDRLEN || o.bad) {
+		char *stored = otpbuf_grow(o.buf, len + HDRLEN);
+		if (!stored) {
+			otpbuf_free(o.buf);
+			return NULL;
+		}
+		o.buf = stored;
+		memcpy(o.buf + HDRLEN, in, len);
+		o.len = len + HDRLEN;
+		put_header(o.buf, 'A', len);
+	}
+	else
+		put_header(o.buf, 'B', len);
+
+	o.buf[o.len] = '\0';
+	*outlen = o.len;
+	return o.buf;
+}
+
+
+/* NAME
+ *  otp_decompress
+ * SYNOPSYS
+ * 	reverses otp_compress, returns dynamically allocated
+ *  null-terminated string, or NULL if input is malformed or out of
+ *  memory
+ */
+char * otp_decompress(const char *in, size_t len, size_t *outlen)
+{
+	if (len < HDRLEN || (in[0] != 'A' && in[0] != 'B'))
+		return NULL;
+
+	// read base 27 length
+	size_t n = 0;
+	int i;
+	for (i = 1; i <= LENSYMS; i++)
+		n = n * 27 + symval(in[i]);
+
+	// stored
+	if (in[0] == 'A') {
+		if (len - HDRLEN != n)
+			return NULL;
+		char *out = otpbuf_alloc(n);
+		if (!out)
+			return NULL;
+		memcpy(out, in + HDRLEN, n);
+		out[n] = '\0';
+		*outlen = n;
+		return out;
+	}
+
+	// coded; counts stay at least 1 in a total of at most MAXTOTAL,
+	// so a symbol costs at least -log2(1 - 26 / 65536) bits and three
+	// payload symbols (14 bits) hold under 3 * MAXRATIO; a claimed
+	// length beyond that is malformed. Even within it, the output
+	// grows as symbols are decoded, so a wrong key's random header
+	// fails once the payload runs out, not on a huge allocation
+	if (n / MAXRATIO > len)
+		return NULL;
+	size_t cap = (n < OUTSTART) ? n : OUTSTART;
+	char *out = otpbuf_alloc(cap);
+	model *m = (model *) malloc(sizeof(model));
+	if (!out || !m) {
+		otpbuf_free(out);
+		free(m);
+		return NULL;
+	}
+	model_init(m);
+
+	symin b = {0};
+	b.buf = in + HDRLEN;
+	b.len = len - HDRLEN;
+
+	uint32_t low = 0, range = 0xFFFFFFFF, code = 0;
+	for (i = 0; i < 4; i++)
+		code = (code << 8) | get_byte(&b);
+
+	int ctx = 26;
+	size_t k;
+	for (k = 0; k < n && !b.bad; k++) {
+		if (k == cap) {
+			cap = (cap * 2 < n) ? cap * 2 : n;
+			char *bigger = otpbuf_grow(out, cap);
+			if (!bigger) {
+				b.bad = 1;
+				break;
+			}
+			out = bigger;
+		}
+		uint32_t *f = m->freq[ctx];
+		range = range / m->total[ctx];
+		uint32_t count = (code - low) / range;
+
+		// find symbol whose cumulative interval holds count
+		uint32_t cum = 0;
+		int s;
+		for (s = 0; s < NSYM - 1; s++) {
+			if (cum + f[s] > count)
+				break;
+			cum += f[s];
+		}
+
+		low = low + cum * range;
+		range = range * f[s];
+		while ((low ^ (low + range)) < RC_TOP ||
+			(range < RC_BOT && ((range = -low & (RC_BOT - 1)), 1))) {
+			code = (code << 8) | get_byte(&b);
+			low = low << 8;
+			range = range << 8;
+		}
+
+		out[k] = alphabet[s];
+		model_update(m, ctx, s);
+		ctx = s;
+	}
+	free(m);
+
+	if (b.bad) {
+		otpbuf_free(out);
+		return NULL;
+	}
+
+	out[n] = '\0';
+	*outlen = n;
+	return out;
+}
@@ -0,0 +1,30 @@
+#ifndef OTPCOMP_H
+#define OTPCOMP_H
+
+
+/*
+ * otpcomp.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * compression within the 27-symbol alphabet (header file)
+ * results come from otpbuf_alloc, release them with otpbuf_free; both
+ * return NULL when out of memory
+ */
+
+
+/* LIBRARIES */
+#include <stddef.h>
+
+
+/* MACROS */
+#define OTPCOMP_OVERHEAD 8				// most symbols otp_compress adds to its input
+
+
+/* FUNCTION DECLARATIONS */
+char * otp_compress(const char *in, size_t len, size_t *outlen);
+char * otp_decompress(const char *in, size_t len, size_t *outlen);
+
+#endif
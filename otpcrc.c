@@ -0,0 +1,171 @@
+/*
+ * otpcrc.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * CRC32C checksums
+ *
+ * on x86-64 processors with SSE4.2 the crc32 instruction does eight
+ * bytes per step; elsewhere it is table driven, eight bytes per step
+ * (slicing by 8). Which one is chosen, and the tables built, once, on
+ * first use.
+ */
+
+
+/* LIBRARIES */
+#include <pthread.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+#include "otpcrc.h"
+
+
+/* MACROS */
+#define POLY 0x82f63b78					// Castagnoli, reflected
+
+
+/* GLOBAL VARIABLES */
+static uint32_t table[8][256];
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static int hardware = 0;				// crc32 instruction available
+
+
+/* FUNCTION DECLARATIONS */
+static void maketables();
+static uint32_t crcsoft(uint32_t crc, const unsigned char *p, size_t len);
+#if defined(__x86_64__)
+static uint32_t crchard(uint32_t crc, const unsigned char *p, size_t len);
+#endif
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  maketables
+ * SYNOPSYS
+ * 	table[0] is the byte at a time table, table[k] the same byte k
+ *  positions further back; also checks for the crc32 instruction
+ */
+static void maketables()
+{
+#if defined(__x86_64__)
+	hardware = __builtin_cpu_supports("sse4.2");
+#endif
+	int i, k;
+	for (i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (k = 0; k < 8; k++)
+			crc = (crc & 1) ? (crc >> 1) ^ POLY : crc >> 1;
+		table[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++)
+		for (k = 1; k < 8; k++)
+			table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+}
+
+
+/* NAME
+ *  otpcrc32c
+ * SYNOPSYS
+ * 	CRC32C of len bytes at buf, continuing from crc (0 to start)
+ */
+uint32_t otpcrc32c(uint32_t crc, const void *buf, size_t len)
+{
+	pthread_once(&once, maketables);
+#if defined(__x86_64__)
+	if (hardware)
+		return ~crchard(~crc, (const unsigned char *) buf, len);
+#endif
+	return ~crcsoft(~crc, (const unsigned char *) buf, len);
+}
+
+
+/* NAME
+ *  otpcrc32c_sw
+ * SYNOPSYS
+ * 	otpcrc32c, always table driven; for checking and timing the
+ *  hardware path against
+ */
+uint32_t otpcrc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+	pthread_once(&once, maketables);
+	return ~crcsoft(~crc, (const unsigned char *) buf, len);
+}
+
+
+/* NAME
+ *  otpcrc32c_hardware
+ * SYNOPSYS
+ * 	1 if otpcrc32c uses the crc32 instruction, 0 if tables
+ */
+int otpcrc32c_hardware()
+{
+	pthread_once(&once, maketables);
+	return hardware;
+}
+
+
+/* NAME
+ *  crcsoft
+ * SYNOPSYS
+ * 	slicing by 8 over len bytes at p, on the inverted crc
+ */
+static uint32_t crcsoft(uint32_t crc, const unsigned char *p, size_t len)
+{
+	// byte at a time up to 8 byte alignment, then 8 at a time
+	while (len > 0 && ((uintptr_t) p & 7) != 0) {
+		crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xff];
+		len--;
+	}
+	while (len >= 8) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		w ^= crc;
+		crc = table[7][w & 0xff] ^ table[6][(w >> 8) & 0xff]
+			^ table[5][(w >> 16) & 0xff] ^ table[4][(w >> 24) & 0xff]
+			^ table[3][(w >> 32) & 0xff] ^ table[2][(w >> 40) & 0xff]
+			^ table[1][(w >> 48) & 0xff] ^ table[0][w >> 56];
+		p += 8;
+		len -= 8;
+	}
+	while (len > 0) {
+		crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xff];
+		len--;
+	}
+	return crc;
+}
+
+
+#if defined(__x86_64__)
+/* NAME
+ *  crchard
+ * SYNOPSYS
+ * 	the crc32 instruction over len bytes at p, on the inverted crc;
+ *  compiled for SSE4.2 whatever the rest of the build targets, and
+ *  only called once the processor is known to have it
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crchard(uint32_t crc, const unsigned char *p, size_t len)
+{
+	while (len > 0 && ((uintptr_t) p & 7) != 0) {
+		crc = _mm_crc32_u8(crc, *p++);
+		len--;
+	}
+	uint64_t c = crc;
+	while (len >= 8) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		c = _mm_crc32_u64(c, w);
+		p += 8;
+		len -= 8;
+	}
+	crc = (uint32_t) c;
+	while (len > 0) {
+		crc = _mm_crc32_u8(crc, *p++);
+		len--;
+	}
+	return crc;
+}
+#endif
@@ -0,0 +1,31 @@
+#ifndef OTPCRC_H
+#define OTPCRC_H
+
+
+/*
+ * otpcrc.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * CRC32C checksums (header file)
+ *
+ * the Castagnoli polynomial, as used by iSCSI and ext4; otpcrc32c(0,
+ * buf, len) checksums a buffer, and passing the result back in as crc
+ * continues it over the next one. It uses the SSE4.2 crc32 instruction
+ * where the processor has it.
+ */
+
+
+/* LIBRARIES */
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* FUNCTION DECLARATIONS */
+uint32_t otpcrc32c(uint32_t crc, const void *buf, size_t len);
+uint32_t otpcrc32c_sw(uint32_t crc, const void *buf, size_t len);
+int otpcrc32c_hardware();
+
+#endif
@@ -0,0 +1,1283 @@
+/*
+ * otpd.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * daemon core shared by otp_enc_d and otp_dec_d
+ *
+ * the parent accepts connections and forks one child per connection.
+ * SIGCHLD is blocked and read through a signalfd polled alongside the
+ * listening socket, so a finished child frees its slot as soon as it
+ * exits rather than at the next accept.
+ *
+ * with -u <path> a new daemon takes the listening socket over from a
+ * running one through a unix socket at path (SCM_RIGHTS), so the port
+ * never stops accepting. The old daemon, like one sent SIGTERM, then
+ * drains: children finish the request in hand and exit, and any still
+ * busy after the grace period are killed.
+ *
+ * each child arms a timerfd for the phase it is in: handshake, idle
+ * between requests, or serving a request. otp_recv and otp_sendn poll
+ * it alongside the socket and give up when it fires, or when a large
+ * upload falls behind the minimum rate, so a slow or silent client
+ * loses its slot instead of holding it forever.
+ *
+ * the encryption daemon checks the key of every request against those
+ * of earlier ones (otpreuse.c) and, with -P, warns about or rejects a
+ * request whose key was used before. The filter is mapped before the
+ * first fork, so all children share it.
+ *
+ * with -U <path> the daemon also listens on a unix socket. Clients
+ * there may send "<id> shm" in the handshake and pass a shared memory
+ * ring (otpshm.h), which the child serves in place of the socket.
+ *
+ * a client that appends OTP_CRCID to its id gets a CRC32C trailer on
+ * every later message, both ways, and a request whose input or key
+ * fails its trailer is dropped before anything is done with it. One
+ * that appends OTP_PACKID (after OTP_CRCID, if both) gets every later
+ * message in the alphabet packed five characters to three bytes
+ * (otppack.h), both ways.
+ *
+ * with -C <file> every connection and request is recorded, without
+ * payloads, for otp_replay (otpcap.h).
+ *
+ * a child reads each request's length header before its body, so a
+ * large request can wait for a large lane slot (otplane.h) without
+ * holding up small ones. Large connections beyond the large lane slots
+ * do not count against MAXCXNS, so at least -Q connections are kept
+ * for small requests. Each request's input, key and output are held
+ * against a memory budget shared by all children (-M), and a request
+ * over -X characters is refused on its header, before any of it is
+ * read. A refused request gets a reply saying why (OTP_REFUSED), so
+ * the client does not take it for a lost connection and send it
+ * again. A client sending the id "stats" gets per lane latencies and
+ * budget use back.
+ *
+ * an input starting with OTP_BATCH is a batch: "#<count> " and the
+ * length of each entry followed by a space, then every entry's input,
+ * then one key range covering them all, in the same order. No key
+ * message follows. The codec runs once over all the inputs, in place,
+ * and the reply is the same header followed by the outputs.
+ *
+ * with -t and -T each client source, its address or, on the unix
+ * socket, its uid, may make only so many requests and send only so
+ * many characters a second (otprate.h), and with -N hold only so many
+ * connections. A request over its source's rates waits briefly for
+ * tokens or is refused before its body is read, and a source far over
+ * them, or at its connections, has new connections refused at accept,
+ * so one client's bursts cannot take every connection.
+ */
+
+
+/* LIBRARIES */
+#define _GNU_SOURCE						// ppoll
+#include <ctype.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "otpd.h"
+#include "otpcap.h"
+#include "otplane.h"
+#include "otppack.h"
+#include "otprate.h"
+#include "otpreuse.h"
+#include "otpshm.h"
+#include "otptrace.h"
+
+
+/* MACROS */
+#define SLOTS (1 << SLOTBITS)
+#define GRACE 30						// default drain deadline, seconds
+#define HANDSHAKE 10					// default deadlines, seconds (0 = none)
+#define IDLE 120
+#define REQUEST 600
+#define MINRATE 16384					// default minimum upload rate, bytes/second
+#define STATSID "stats"					// handshake id of a stats query
+#define STATSLEN 4096
+#define IDMAX 64						// longest handshake or stats message
+#define DROPLEN 65536					// bytes read at a time after a refusal
+
+
+/* STRUCTS AND ENUMS */
+// what a child is doing, each with its own deadline
+typedef enum phase {PH_HANDSHAKE, PH_IDLE, PH_REQUEST} phase;
+
+// pids of running children, open addressed by pid
+typedef struct slottab {
+	pid_t pid[SLOTS];					// 0 if empty
+	int used;
+} slottab;
+
+
+/* GLOBAL VARIABLES */
+static int listenfd = 0;
+static int sockfd = 0;					// file descriptor for socket
+static int sigfd = -1;					// signalfd for SIGCHLD and SIGTERM
+static int ctlfd = -1;					// handoff unix socket, if any
+static char *ctlpath = NULL;
+static int unixfd = -1;					// unix socket for local clients, if any
+static char *unixpath = NULL;
+static bool local = FALSE;				// child: client came over unixfd
+static char *cappath = NULL;			// capture file, if any
+static size_t lanemin = OTPLANE_THRESHOLD;	// shortest large request, 0 = no lanes
+static int reserve = OTPLANE_RESERVE;	// connections large requests may not take
+static size_t budgetmb = OTPLANE_BUDGET >> 20;	// memory all requests may hold, 0 = any
+static size_t maxreq = OTPLANE_MAXREQ;	// longest request, characters
+static double reqrate = 0;				// requests/second per source, 0 = any
+static double charrate = 0;				// characters/second per source, 0 = any
+static int srcconns = 0;				// connections per source, 0 = any
+static int grace = GRACE;				// seconds to drain before killing
+static sigset_t idlemask;				// child signal mask while idle
+static volatile sig_atomic_t draining = 0;	// child: exit when idle
+static int deadline[3] = {HANDSHAKE, IDLE, REQUEST};	// per phase, seconds
+static otp_limits limits = {-1, MINRATE, IDMAX};	// child: timerfd, minimum rate, longest id
+static otpreuse_policy reuse = RU_WARN;	// on key reuse, if conf->reuse
+static size_t reusemb = OTPREUSE_MB;	// reuse filter memory
+static char *id = NULL;					// id of connection, to be verified
+static char *in = NULL;					// received plaintext or ciphertext
+static char *key = NULL;				// contents of key
+static char *out = NULL;				// result of codec
+static slottab kids;					// current cxn proc ids
+
+
+/* FUNCTION DECLARATIONS */
+static void memclean();
+static void closesock();
+static void waitkids();
+static void catchSIGINT(int signo);
+static void catchSIGTERM(int signo);
+static int slot_add(slottab *t, pid_t pid);
+static int slot_del(slottab *t, pid_t pid);
+static bool reap();
+static int takeover(const char *path);
+static int ctlopen(const char *path);
+static void handoff();
+static void drain();
+static void arm(phase ph);
+static bool idlewait(int fd);
+static size_t charge(size_t len, bool pack);
+static bool keycheck(const otpd_conf *conf, const char *in, const char *k, size_t len);
+static void refuse(char *why);
+static otpshm_status shmcrypt(const otpd_conf *conf, otpshm *s, otpshm_slot *slot);
+static void shmserve(const otpd_conf *conf);
+static void stats(const otpd_conf *conf);
+static size_t batch(const otpd_conf *conf, char *frame, size_t framelen);
+static void serve(const otpd_conf *conf);
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  memclean
+ * SYNOPSYS
+ * 	frees dynamic memory
+ */
+static void memclean() {
+	if (id)
+		otpbuf_free(id);
+	if (in)
+		otpbuf_free(in);
+	if (key)
+		otpbuf_free(key);
+	if (out)
+		otpbuf_free(out);
+}
+
+
+/* NAME
+ *  closesock
+ * SYNOPSYS
+ * 	closes sockets
+ */
+static void closesock() {
+	if (listenfd > 0)
+		close(listenfd);
+	if (sockfd > 0)
+		close(sockfd);
+	if (sigfd >= 0)
+		close(sigfd);
+	if (ctlfd >= 0)
+		close(ctlfd);
+	if (unixfd >= 0)
+		close(unixfd);
+}
+
+
+/* NAME
+ *  waitkids
+ * SYNOPSYS
+ * 	waits for child processes
+ */
+static void waitkids() {
+	int method;
+	while (wait(&method) != -1);
+}
+
+
+/* NAME
+ *  catchSIGINT
+ * SYNOPSYS
+ * 	signal handler for SIGINT (Ctrl-C)
+ *	exit with cleanup
+ */
+static void catchSIGINT(int signo)
+{
+	(void) signo;
+	exit(130);
+}
+
+
+/* NAME
+ *  catchSIGTERM
+ * SYNOPSYS
+ * 	child signal handler for SIGTERM, only delivered while idle
+ *	between requests: finish up
+ */
+static void catchSIGTERM(int signo)
+{
+	(void) signo;
+	draining = 1;
+}
+
+
+/* NAME
+ *  slot_add
+ * SYNOPSYS
+ * 	records pid in the slot table, returns 0 or -1 if full
+ */
+static int slot_add(slottab *t, pid_t pid)
+{
+	if (t->used >= 2 * MAXCXNS)
+		return -1;
+
+	unsigned i = (unsigned) pid & (SLOTS - 1);
+	while (t->pid[i] != 0)
+		i = (i + 1) & (SLOTS - 1);
+	t->pid[i] = pid;
+	t->used++;
+	return 0;
+}
+
+
+/* NAME
+ *  slot_del
+ * SYNOPSYS
+ * 	removes pid from the slot table, returns 0 or -1 if not found;
+ *  later entries of the probe run shift back so lookups stay short
+ */
+static int slot_del(slottab *t, pid_t pid)
+{
+	unsigned i = (unsigned) pid & (SLOTS - 1);
+	while (t->pid[i] != pid) {
+		if (t->pid[i] == 0)
+			return -1;
+		i = (i + 1) & (SLOTS - 1);
+	}
+
+	// backward shift deletion
+	unsigned j = i;
+	while (1) {
+		j = (j + 1) & (SLOTS - 1);
+		if (t->pid[j] == 0)
+			break;
+		unsigned home = (unsigned) t->pid[j] & (SLOTS - 1);
+		// move entry j into hole i unless its home lies in (i, j]
+		if (((j - home) & (SLOTS - 1)) >= ((j - i) & (SLOTS - 1))) {
+			t->pid[i] = t->pid[j];
+			i = j;
+		}
+	}
+	t->pid[i] = 0;
+	t->used--;
+	return 0;
+}
+
+
+/* NAME
+ *  reap
+ * SYNOPSYS
+ * 	drains pending signal notifications and frees the slot of every
+ *  finished child; signals coalesce, so waitpid decides who is done
+ *  returns TRUE if SIGTERM arrived
+ */
+static bool reap()
+{
+	bool term = FALSE;
+	struct signalfd_siginfo si;
+	while (read(sigfd, &si, sizeof(si)) == sizeof(si)) {
+		if (si.ssi_signo == SIGTERM)
+			term = TRUE;
+	}
+
+	int method = -5;
+	pid_t check;
+	while ((check = waitpid(-1, &method, WNOHANG)) > 0) {
+		slot_del(&kids, check);
+		otplane_reap(check);
+		otprate_reap(check);
+	}
+	return term;
+}
+
+
+/* NAME
+ *  takeover
+ * SYNOPSYS
+ * 	asks a running daemon at unix socket path for its listening socket
+ *  returns the listening socket, or -1 if no daemon answered
+ */
+static int takeover(const char *path)
+{
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strncpy(sa.sun_path, path, sizeof(sa.sun_path) - 1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	int lfd = -1;
+	if (otp_recvfds(fd, &lfd, 1) == -1)
+		lfd = -1;
+	close(fd);
+	return lfd;
+}
+
+
+/* NAME
+ *  ctlopen
+ * SYNOPSYS
+ * 	listens on unix socket path for a successor daemon
+ *  returns socket or -1 (error)
+ */
+static int ctlopen(const char *path)
+{
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sa.sun_path)) {
+		fprintf(stderr, "Handoff path too long.\n");
+		return -1;
+	}
+	strcpy(sa.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		perror("socket()");
+		return -1;
+	}
+
+	// replace the socket of a daemon that has handed off or died
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == -1 || listen(fd, 1) == -1) {
+		perror("bind() handoff");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+
+/* NAME
+ *  handoff
+ * SYNOPSYS
+ * 	passes the listening socket to a successor on the handoff socket,
+ *  then drains; keeps serving if the handoff fails
+ */
+static void handoff()
+{
+	int fd = accept(ctlfd, NULL, NULL);
+	if (fd == -1)
+		return;
+
+	if (otp_sendfds(fd, &listenfd, 1) == -1) {
+		perror("Error: handoff sendmsg()");
+		close(fd);
+		return;
+	}
+	close(fd);
+
+	// the successor owns the handoff path (and unix socket path) now
+	close(ctlfd);
+	ctlfd = -1;
+	ctlpath = NULL;
+	unixpath = NULL;
+	drain();
+}
+
+
+/* NAME
+ *  drain
+ * SYNOPSYS
+ * 	stops accepting, lets children finish the request in hand, kills
+ *  those still busy after the grace period, and exits
+ */
+static void drain()
+{
+	close(listenfd);
+	listenfd = 0;
+	if (ctlfd >= 0) {
+		close(ctlfd);
+		ctlfd = -1;
+		unlink(ctlpath);
+	}
+	if (unixfd >= 0) {
+		close(unixfd);
+		unixfd = -1;
+		if (unixpath)
+			unlink(unixpath);
+	}
+
+	// idle children exit at once, busy ones after their reply
+	int i;
+	for (i = 0; i < SLOTS; i++) {
+		if (kids.pid[i] != 0)
+			kill(kids.pid[i], SIGTERM);
+	}
+
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	struct pollfd pfd;
+	pfd.fd = sigfd;
+	pfd.events = POLLIN;
+	while (kids.used > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long left = grace * 1000L - ((now.tv_sec - start.tv_sec) * 1000L + (now.tv_nsec - start.tv_nsec) / 1000000L);
+		if (left <= 0) {
+			fprintf(stderr, "Drain deadline passed, killing %d connections.\n", kids.used);
+			for (i = 0; i < SLOTS; i++) {
+				if (kids.pid[i] != 0)
+					kill(kids.pid[i], SIGKILL);
+			}
+			break;
+		}
+		if (poll(&pfd, 1, left) > 0)
+			reap();
+	}
+
+	exit(0);
+}
+
+
+/* NAME
+ *  arm
+ * SYNOPSYS
+ * 	child: restarts the deadline timer for phase ph
+ */
+static void arm(phase ph)
+{
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = deadline[ph];
+	timerfd_settime(limits.timerfd, 0, &its, NULL);
+}
+
+
+/* NAME
+ *  idlewait
+ * SYNOPSYS
+ * 	child: waits for fd (the socket, or a ring's eventfd) to signal the
+ *  next request, the only time SIGTERM is let in, so a drain never
+ *  cuts a request short; while waiting on a ring, the socket only
+ *  tells that the client has gone
+ *  returns FALSE if the child should exit
+ */
+static bool idlewait(int fd)
+{
+	struct pollfd pfd[3];
+	pfd[0].fd = fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = limits.timerfd;
+	pfd[1].events = POLLIN;
+	pfd[2].fd = (fd == sockfd) ? -1 : sockfd;	// ignored by poll if -1
+	pfd[2].events = POLLIN;
+	while (!draining) {
+		int n = ppoll(pfd, 3, NULL, &idlemask);
+		if (n > 0 && ((pfd[1].revents | pfd[2].revents) & (POLLIN | POLLHUP)))
+			return FALSE;
+		if (n >= 0 || errno != EINTR)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+
+/* NAME
+ *  charge
+ * SYNOPSYS
+ * 	bytes a request of len characters holds while it is served: its
+ *  input, key and output as otpbuf maps them, and on a connection that
+ *  packs, the packed copy of the output
+ */
+static size_t charge(size_t len, bool pack)
+{
+	size_t bytes = 3 * otpbuf_size(len + OTPPACK_GROUP);
+	if (pack)
+		bytes = bytes + otpbuf_size(OTPPACK_LEN(len));
+	return bytes;
+}
+
+
+/* NAME
+ *  keycheck
+ * SYNOPSYS
+ * 	applies the key reuse policy to the len characters of key k, used
+ *  on input in
+ *  returns FALSE if the request must be refused
+ */
+static bool keycheck(const otpd_conf *conf, const char *in, const char *k, size_t len)
+{
+	if (!conf->reuse || reuse == RU_OFF || !otpreuse_seen(in, k, len))
+		return TRUE;
+	if (reuse == RU_REJECT) {
+		fprintf(stderr, "Error: Key reuse detected, rejecting request.\n");
+		return FALSE;
+	}
+	fprintf(stderr, "Warning: Key reuse detected.\n");
+	return TRUE;
+}
+
+
+/* NAME
+ *  refuse
+ * SYNOPSYS
+ * 	child: tells the client why its request is refused, with one of
+ *  the OTP_REFUSED replies, then drops whatever it still sends until
+ *  it hangs up, falls under the minimum rate or the request deadline
+ *  passes, so the reply is read rather than lost to a reset; exits
+ */
+static void refuse(char *why)
+{
+	otp_send(sockfd, why);
+	shutdown(sockfd, SHUT_WR);
+
+	char buf[DROPLEN];
+	size_t dropped = 0;
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	struct pollfd pfd[2];
+	pfd[0].fd = sockfd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = limits.timerfd;
+	pfd[1].events = POLLIN;
+	while (1) {
+		int n = poll(pfd, 2, 1000);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1 || (pfd[1].revents & POLLIN))
+			break;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		double secs = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+		if (limits.minrate > 0 && secs > OTP_RATEGRACE && dropped < limits.minrate * secs)
+			break;
+		if (n == 0)
+			continue;
+		ssize_t r = recv(sockfd, buf, sizeof(buf), 0);
+		if (r == 0 || (r == -1 && errno != EINTR))
+			break;
+		if (r > 0)
+			dropped = dropped + r;
+	}
+	exit(1);
+}
+
+
+/* NAME
+ *  shmcrypt
+ * SYNOPSYS
+ * 	child: validates one ring slot and runs the codec on it in place
+ *  returns the slot's status
+ */
+static otpshm_status shmcrypt(const otpd_conf *conf, otpshm *s, otpshm_slot *slot)
+{
+	// read once: the client could change it under us
+	size_t len = __atomic_load_n(&slot->len, __ATOMIC_RELAXED);
+	if (len > s->maxlen || len > maxreq)
+		return SHM_ESIZE;
+	if (otprate_take(len) == -1)
+		return SHM_ERATE;
+
+	char *sin = slot->data;
+	char *skey = otpshm_key(s, slot);
+	if (!(hasValidCharsn(sin, len) && hasValidCharsn(skey, len)))
+		return SHM_ECHARS;
+	if (!keycheck(conf, sin, skey, len))
+		return SHM_EREUSE;
+
+	conf->codec(sin, skey, sin, len);
+	return SHM_OK;
+}
+
+
+/* NAME
+ *  shmserve
+ * SYNOPSYS
+ * 	child: serves the shared memory ring passed by a local client,
+ *  running the codec on each submitted slot in place, until the client
+ *  hangs up or breaks the ring
+ */
+static void shmserve(const otpd_conf *conf)
+{
+	int fds[3];
+	otpshm s;
+	if (otp_recvfds(sockfd, fds, 3) == -1 || otpshm_attach(&s, fds) == -1) {
+		fprintf(stderr, "Error: Did not receive ring.\n");
+		exit(1);
+	}
+
+	uint64_t tail = 0;
+	while (1) {
+		arm(PH_IDLE);
+		otpcap_flush();
+		if (!idlewait(s.reqfd))
+			break;
+		otpshm_clear(s.reqfd);
+		uint64_t start = otpcap_now();
+
+		// everything submitted so far, then one wakeup for the batch
+		uint64_t head = __atomic_load_n(&s.ring->head, __ATOMIC_ACQUIRE);
+		if (head - tail > s.nslots) {
+			fprintf(stderr, "Error: Invalid ring.\n");
+			break;
+		}
+		arm(PH_REQUEST);
+		for (; tail != head; tail++) {
+			TRACE_REQ();
+			otpshm_slot *slot = otpshm_slotat(&s, tail);
+			slot->status = shmcrypt(conf, &s, slot);
+			__atomic_store_n(&s.ring->tail, tail + 1, __ATOMIC_RELEASE);
+			TRACE(TR_CODEC, slot->len);
+			otpcap_req(start, slot->len);
+		}
+		otpshm_signal(s.donefd);
+	}
+	otpshm_close(&s);
+}
+
+
+/* NAME
+ *  stats
+ * SYNOPSYS
+ * 	child: answers a stats query with per lane counts and latencies,
+ *  and key reuse counts for the encryption daemon
+ */
+static void stats(const otpd_conf *conf)
+{
+	otp_send(sockfd, "OK");
+	char *req = otp_recv(sockfd);
+	if (!req)
+		exit(2);
+	otpbuf_free(req);
+
+	char buf[STATSLEN];
+	int n = otplane_report(buf, sizeof(buf));
+	if (conf->reuse && n < (int) sizeof(buf)) {
+		uint64_t checked, flagged;
+		otpreuse_stats(&checked, &flagged);
+		snprintf(buf + n, sizeof(buf) - n, "reuse  checked %lu  flagged %lu\n",
+			(unsigned long) checked, (unsigned long) flagged);
+		n += strlen(buf + n);
+	}
+	if (n < (int) sizeof(buf))
+		otprate_report(buf + n, sizeof(buf) - n);
+	otp_send(sockfd, buf);
+}
+
+
+/* NAME
+ *  batch
+ * SYNOPSYS
+ * 	child: checks a batch request's header against its length, runs
+ *  the codec over all its entries in one pass and sends the reply
+ *  returns characters encoded, exits on a bad batch
+ */
+static size_t batch(const otpd_conf *conf, char *frame, size_t framelen)
+{
+	// "#<count> <len> <len> ... " then inputs, then key
+	char *p = frame + 1;
+	char *end;
+	unsigned long count = strtoul(p, &end, 10);
+	size_t total = 0;
+	unsigned long i;
+	bool ok = (isdigit(*p) && *end == ' ') ? TRUE : FALSE;
+	for (i = 0, p = end + 1; ok && i < count; i++, p = end + 1) {
+		unsigned long n = strtoul(p, &end, 10);
+		ok = (isdigit(*p) && *end == ' ' && n <= framelen - total) ? TRUE : FALSE;
+		total += n;
+	}
+	size_t hdrlen = p - frame;
+	if (!ok || hdrlen > framelen || framelen - hdrlen != 2 * total) {
+		fprintf(stderr, "Error: Malformed batch request.\n");
+		exit(1);
+	}
+	TRACE(TR_RECV_KEY, total);
+
+	char *bin = frame + hdrlen;
+	char *bkey = bin + total;
+	if (!(hasValidCharsn(bin, total) && hasValidCharsn(bkey, total))) {
+		fprintf(stderr, "Error: Invalid characters in file.\n");
+		exit(1);
+	}
+	TRACE(TR_VALIDATE, 0);
+	if (!keycheck(conf, bin, bkey, total))
+		refuse(OTP_RREUSE);
+
+	// the key follows the inputs, so the codec's terminator lands on
+	// key already used
+	conf->codec(bin, bkey, bin, total);
+	TRACE(TR_CODEC, total);
+	if (otp_sendn(sockfd, frame, hdrlen + total) < 0)
+		exit(1);
+	return total;
+}
+
+
+/* NAME
+ *  serve
+ * SYNOPSYS
+ * 	child process - verifies client, then runs codec on each received
+ *  input and key until the client closes the connection, so pooled
+ *  clients can reuse it
+ */
+static void serve(const otpd_conf *conf)
+{
+	int status = -5;
+
+	// every transfer from here on is bounded
+	limits.timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (limits.timerfd == -1) {
+		perror("timerfd_create()");
+		exit(2);
+	}
+	otp_setlimits(&limits);
+	arm(PH_HANDSHAKE);
+
+	// get and verify connection id
+	id = otp_recv(sockfd);
+	if (!id) {
+		exit(2);
+	}
+	TRACE(TR_ID, 0);
+
+	// a client may ask for packing and CRC32C trailers on every message
+	// after the handshake reply
+	bool pack = FALSE;
+	size_t packlen = strlen(OTP_PACKID);
+	if (strlen(id) > packlen && strcmp(id + strlen(id) - packlen, OTP_PACKID) == 0) {
+		id[strlen(id) - packlen] = '\0';
+		pack = TRUE;
+	}
+	bool crc = FALSE;
+	size_t crclen = strlen(OTP_CRCID);
+	if (strlen(id) > crclen && strcmp(id + strlen(id) - crclen, OTP_CRCID) == 0) {
+		id[strlen(id) - crclen] = '\0';
+		crc = TRUE;
+	}
+	if (strcmp(id, STATSID) == 0) {
+		stats(conf);
+		return;
+	}
+	status = strcmp(id, conf->acceptid);
+
+	// local clients may ask for a shared memory ring instead
+	bool shm = FALSE;
+	size_t idlen = strlen(conf->acceptid);
+	if (status != 0 && local && strncmp(id, conf->acceptid, idlen) == 0
+			&& strcmp(id + idlen, OTPSHM_ID) == 0) {
+		status = 0;
+		shm = TRUE;
+	}
+	if (status == 0) {
+		if (otp_send(sockfd, "OK") < 1 || (crc && otp_setcrc(sockfd, TRUE) == -1)
+				|| (pack && otp_setpack(sockfd, TRUE) == -1))
+			exit(2);
+		TRACE(TR_HANDSHAKE, 0);
+	}
+	else {
+		otp_send(sockfd, "INVALID ID");
+		exit(2);
+	}
+	otpcap_start(shm ? CAP_RING : local ? CAP_UNIX : CAP_TCP);
+	if (shm) {
+		shmserve(conf);
+		return;
+	}
+
+	bool first = TRUE;
+	while (1) {
+		// recv input
+		if (!first) {
+			arm(PH_IDLE);
+			otpcap_flush();
+			if (!idlewait(sockfd))
+				break;
+			TRACE_REQ();
+		}
+		arm(PH_REQUEST);
+		uint64_t start = otpcap_now();
+		long inlen = otp_recvlen(sockfd);
+		if (inlen < 0) {
+			if (!first)
+				break;
+			fprintf(stderr, "Error: Did not receive %s file.\n", conf->inname);
+			exit(1);
+		}
+		if ((size_t) inlen > maxreq) {
+			otplane_toolarge();
+			fprintf(stderr, "Error: %ld character %s over the %zu limit, rejecting request.\n",
+				inlen, conf->inname, maxreq);
+			refuse(OTP_RSIZE);
+		}
+		if (otprate_take(inlen) == -1) {
+			fprintf(stderr, "Error: Client over its rate limit, rejecting request.\n");
+			refuse(OTP_RRATE);
+		}
+
+		// wait for memory for input, key and output, and large requests
+		// for their turn, before reading the body
+		uint64_t hdrts = otpcap_now();
+		int lane = otplane_enter(inlen, charge(inlen, pack), deadline[PH_REQUEST]);
+		if (lane == -1) {
+			fprintf(stderr, "Error: No memory or large request slot in time, rejecting request.\n");
+			refuse(OTP_RBUSY);
+		}
+		uint64_t admitted = otpcap_now();
+		errno = 0;
+		if (!(in = otp_recvbody(sockfd, inlen))) {
+			if (errno == ENOMEM)
+				refuse(OTP_RBUSY);
+			fprintf(stderr, "Error: Did not receive %s file.\n", conf->inname);
+			exit(1);
+		}
+		TRACE(TR_RECV_IN, strlen(in));
+		if (inlen > 0 && in[0] == OTP_BATCH) {
+			size_t n = batch(conf, in, inlen);
+			TRACE(TR_SEND, 0);
+			otplane_leave(lane, hdrts, admitted);
+			otpcap_req(start, n);
+			otpbuf_free(in);
+			in = NULL;
+			first = FALSE;
+			continue;
+		}
+
+		// recv key; only as much as the input needs is kept, so a whole
+		// key file sent by an older client costs no memory
+		long keylen = otp_recvlen(sockfd);
+		errno = 0;
+		if (keylen < 0 || !(key = otp_recvpart(sockfd, keylen, inlen))) {
+			if (keylen >= 0 && errno == ENOMEM)
+				refuse(OTP_RBUSY);
+			fprintf(stderr, "Error: Did not receive key file.\n");
+			exit(1);
+		}
+		TRACE(TR_RECV_KEY, strlen(key));
+
+		// error checking: valid characters, length
+		if (!(hasValidChars(in) && hasValidChars(key))) {
+			fprintf(stderr, "Error: Invalid characters in file.\n");
+			exit(1);
+		}
+		if (strlen(in) > strlen(key)) {
+			fprintf(stderr, "Error: Key too short.\n");
+			exit(1);
+		}
+		TRACE(TR_VALIDATE, 0);
+
+		// key reuse: the codec consumes strlen(in) characters of key
+		size_t len = strlen(in);
+		if (!keycheck(conf, in, key, len))
+			refuse(OTP_RREUSE);
+
+		// send result
+		if (!(out = otpbuf_alloc(len))) {
+			fprintf(stderr, "Error: Out of memory for %zu character result, rejecting request.\n", len);
+			refuse(OTP_RBUSY);
+		}
+		conf->codec(in, key, out, len);
+		TRACE(TR_CODEC, strlen(out));
+		if (otp_send(sockfd, out) < 0)
+			exit(1);
+		TRACE(TR_SEND, 0);
+		otplane_leave(lane, hdrts, admitted);
+		otpcap_req(start, len);
+
+		otpbuf_free(in);
+		otpbuf_free(key);
+		otpbuf_free(out);
+		in = key = out = NULL;
+		first = FALSE;
+	}
+}
+
+
+/* NAME
+ *  otpd_main
+ * SYNOPSYS
+ * 	parses daemon arguments, listens, and forks a child per
+ *  connection, up to MAXCXNS at once
+ * USAGE
+ *  otp_enc_d | otp_dec_d [-b <bind address>] [-m <buffer mode>]
+ *      [-u <handoff path>] [-U <unix socket path>] [-g <grace seconds>]
+ *      [-H <handshake seconds>]
+ *      [-I <idle seconds>] [-R <request seconds>] [-r <min bytes/second>]
+ *      [-S <socket options>] [-P off|warn|reject] [-F <filter MB>]
+ *      [-C <capture file>] [-L <large request chars>] [-Q <small connections>]
+ *      [-M <budget MB>] [-X <max request chars>] [-t <requests/second>]
+ *      [-T <chars/second>] [-N <connections>] <port num>
+ *  bind address may be a host name (its first address), IPv4 or IPv6
+ *  address, or * for all (default 127.0.0.1); with a handoff path,
+ *  takes the port over from the daemon listening there, if any; a
+ *  deadline or rate of 0 is none; -P and -F set what otp_enc_d does
+ *  about reused key and the memory it remembers key in (default warn,
+ *  16 MB; 0 MB is off); -C appends request metadata to a capture file
+ *  for otp_replay; requests of -L characters or more (default 1M, 0 is
+ *  no lanes) are large, and may not use the last -Q connections
+ *  (default 1); requests hold their buffers, as mapped, against -M
+ *  (default 512 MB, 0 is any) and may be at most -X characters long
+ *  (default 64M); -t, -T and -N limit each
+ *  client address (unix socket: uid) to so many requests and
+ *  characters a second and connections at once (default, and 0, no
+ *  limit)
+ */
+int otpd_main(const otpd_conf *conf, int argc, char *argv[])
+{
+	// register cleanup functions
+	atexit(memclean);
+	atexit(closesock);
+	atexit(waitkids);
+	TRACE_INIT();
+
+	// SIGINT cleanup
+	struct sigaction SIGINT_action = {0};
+	SIGINT_action.sa_handler = catchSIGINT;
+	sigfillset(&SIGINT_action.sa_mask);
+	SIGINT_action.sa_flags = SA_RESTART;
+	sigaction(SIGINT, &SIGINT_action, NULL);
+
+	int status = -5;
+	char port[8];
+	memset(port, '\0', sizeof(port));
+
+	// options
+	char *bindaddr = "127.0.0.1";
+	int opt;
+	while ((opt = getopt(argc, argv, "b:m:u:U:g:H:I:R:r:S:P:F:C:L:Q:M:X:t:T:N:")) != -1) {
+		switch (opt)
+		{
+			case 'b':		// address to listen on
+				bindaddr = optarg;
+				break;
+			case 'm':		// buffer pool mode
+				if (otpbuf_setmode(optarg) == -1) {
+					fprintf(stderr, "Invalid buffer mode %s.\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'S':		// socket options
+				if (otp_setsockopts(optarg) == -1) {
+					fprintf(stderr, "Invalid socket options %s.\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'u':		// handoff socket path
+				ctlpath = optarg;
+				break;
+			case 'L':		// shortest large request
+				if (!isdigit(optarg[0])) {
+					fprintf(stderr, "Invalid lane threshold %s.\n", optarg);
+					exit(1);
+				}
+				lanemin = strtoul(optarg, NULL, 10);
+				break;
+			case 'Q':		// connections kept for small requests
+				reserve = atoi(optarg);
+				if (!isdigit(optarg[0]) || reserve >= MAXCXNS) {
+					fprintf(stderr, "Invalid reservation %s, must be 0 to %d.\n", optarg, MAXCXNS - 1);
+					exit(1);
+				}
+				break;
+			case 'C':		// capture file
+				cappath = optarg;
+				break;
+			case 'M':		// memory budget
+				if (!isdigit(optarg[0])) {
+					fprintf(stderr, "Invalid memory budget %s.\n", optarg);
+					exit(1);
+				}
+				budgetmb = strtoul(optarg, NULL, 10);
+				break;
+			case 'X':		// longest request
+				if (!isdigit(optarg[0]) || strtoul(optarg, NULL, 10) == 0) {
+					fprintf(stderr, "Invalid request limit %s.\n", optarg);
+					exit(1);
+				}
+				maxreq = strtoul(optarg, NULL, 10);
+				break;
+			case 't':		// requests per second per source
+			case 'T':		// characters per second per source
+				if (!isdigit(optarg[0])) {
+					fprintf(stderr, "Invalid rate limit %s.\n", optarg);
+					exit(1);
+				}
+				*(opt == 't' ? &reqrate : &charrate) = atof(optarg);
+				break;
+			case 'N':		// connections per source
+				srcconns = atoi(optarg);
+				if (!isdigit(optarg[0]) || srcconns > MAXCXNS) {
+					fprintf(stderr, "Invalid connection limit %s, must be 0 to %d.\n", optarg, MAXCXNS);
+					exit(1);
+				}
+				break;
+			case 'U':		// unix socket path for local clients
+				if (optarg[0] != '/') {
+					fprintf(stderr, "Unix socket path must be absolute.\n");
+					exit(1);
+				}
+				unixpath = optarg;
+				break;
+			case 'g':		// drain deadline
+				grace = atoi(optarg);
+				if (grace <= 0) {
+					fprintf(stderr, "Invalid grace period %s.\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'H':		// handshake deadline
+			case 'I':		// idle deadline
+			case 'R':		// request deadline
+				if (!isdigit(optarg[0])) {
+					fprintf(stderr, "Invalid deadline %s.\n", optarg);
+					exit(1);
+				}
+				deadline[opt == 'H' ? PH_HANDSHAKE : opt == 'I' ? PH_IDLE : PH_REQUEST] = atoi(optarg);
+				break;
+			case 'r':		// minimum upload rate
+				if (!isdigit(optarg[0])) {
+					fprintf(stderr, "Invalid rate %s.\n", optarg);
+					exit(1);
+				}
+				limits.minrate = atol(optarg);
+				break;
+			case 'P':		// key reuse policy
+				if (strcmp(optarg, "off") == 0)
+					reuse = RU_OFF;
+				else if (strcmp(optarg, "warn") == 0)
+					reuse = RU_WARN;
+				else if (strcmp(optarg, "reject") == 0)
+					reuse = RU_REJECT;
+				else {
+					fprintf(stderr, "Invalid reuse policy %s.\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'F':		// key reuse filter memory
+				if (!isdigit(optarg[0])) {
+					fprintf(stderr, "Invalid filter size %s.\n", optarg);
+					exit(1);
+				}
+				reusemb = atol(optarg);
+				break;
+			default:
+				exit(1);
+		}
+	}
+	argc = argc - (optind - 1);
+	argv = argv + (optind - 1);
+
+	// check that program was executed with one positional argument
+	if (argc != 2) {
+		fprintf(stderr, "Incorrect number of arguments.\n");
+		exit(1);
+	}
+
+	// get port as string
+	strncpy(port, argv[1], sizeof(port) - 1);
+
+	// check for valid port number
+	if (!isValidPort(strtol(port, NULL, 10))) {
+		fprintf(stderr, "Invalid port number.\n");
+		exit(1);
+	}
+
+	// take SIGCHLD and SIGTERM through a file descriptor instead of
+	// handlers; children keep SIGTERM blocked outside idlewait
+	sigset_t sigs, oldmask;
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGCHLD);
+	sigaddset(&sigs, SIGTERM);
+	sigprocmask(SIG_BLOCK, &sigs, &oldmask);
+	idlemask = oldmask;
+	sigdelset(&idlemask, SIGTERM);
+	sigfd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (sigfd == -1) {
+		perror("signalfd()");
+		exit(1);
+	}
+
+	// get listening socket from a running daemon, or make one
+	listenfd = ctlpath ? takeover(ctlpath) : -1;
+	if (listenfd == -1) {
+		listenfd = initialize(bindaddr, port, BIND);
+		if (listenfd == -1) {
+			exit(1);
+		}
+
+		status = listen(listenfd, BACKLOG);
+		if (status == -1) {
+			perror("listen()");
+			exit(1);
+		}
+	}
+	if (ctlpath && (ctlfd = ctlopen(ctlpath)) == -1)
+		exit(1);
+	if (unixpath) {
+		unixfd = initialize(unixpath, NULL, BIND);
+		if (unixfd == -1 || listen(unixfd, BACKLOG) == -1) {
+			perror("listen() unix");
+			exit(1);
+		}
+	}
+
+	// shared by all children, so open / map before the first fork
+	if (cappath && otpcap_open(cappath, conf->acceptid) == -1)
+		exit(1);
+	if (budgetmb > 0 && charge(maxreq, TRUE) > (budgetmb << 20)) {
+		fprintf(stderr, "A %zu character request needs %zu MB of budget, more than -M %zu.\n",
+			maxreq, ((charge(maxreq, TRUE) - 1) >> 20) + 1, budgetmb);
+		exit(1);
+	}
+	if (otplane_init(lanemin, MAXCXNS - reserve, budgetmb << 20) == -1)
+		exit(1);
+	if (conf->reuse && reuse != RU_OFF && otpreuse_init(reusemb) == -1)
+		exit(1);
+	if (otprate_init(reqrate, charrate, srcconns) == -1)
+		exit(1);
+
+	// initialize variables for use in loop
+	struct sockaddr_storage caddr = {0};	// holds info about client address (IPv4 or IPv6)
+	socklen_t caddr_size = sizeof(caddr);	// needed for getnameinfo()
+	int childPid;							// process ID for forked connection
+	struct pollfd fds[4];
+	fds[0].fd = listenfd;
+	fds[0].events = POLLIN;
+	fds[1].fd = sigfd;
+	fds[1].events = POLLIN;
+	fds[2].fd = ctlfd;						// ignored by poll if -1
+	fds[2].events = POLLIN;
+	fds[3].fd = unixfd;
+	fds[3].events = POLLIN;
+
+	// loop to accept connections, reap finished children, hand off
+	while (1) {
+		if (poll(fds, 4, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("poll()");
+			exit(1);
+		}
+		if ((fds[1].revents & POLLIN) && reap())
+			drain();
+		if (fds[2].revents & POLLIN)
+			handoff();
+		if (!((fds[0].revents | fds[3].revents) & POLLIN))
+			continue;
+
+		// accept client connection, TCP first if both are waiting
+		local = (fds[0].revents & POLLIN) ? FALSE : TRUE;
+		memset(&caddr, 0, sizeof(caddr));
+		caddr_size = sizeof(caddr);
+		sockfd = accept(local ? unixfd : listenfd, (struct sockaddr *)&caddr, &caddr_size);
+		if (sockfd == -1) {
+			perror("accept()");
+			continue;
+		}
+		TRACE_STAMP(acceptts);
+		otp_applysockopts(sockfd);
+
+		// a source far over its rates, or at its connections, gets no child
+		// with a refusal in place of the handshake reply, so the
+		// client does not try again at once
+		if (otprate_accept((struct sockaddr *)&caddr, sockfd) == -1) {
+			fprintf(stderr, "Error: Client over its rate limit, rejecting new connection.\n");
+			otp_send(sockfd, OTP_RRATE);
+			close(sockfd);
+			sockfd = 0;
+			continue;
+		}
+
+		// if connections > MAXCXNS, reject new connection; large ones
+		// beyond the large lane slots don't count, up to twice as many
+		if (kids.used - otplane_excess() >= MAXCXNS)
+			reap();
+		if (kids.used - otplane_excess() >= MAXCXNS || kids.used >= 2 * MAXCXNS) {
+			fprintf(stderr, "Error: %d connections, rejecting new connection.\n", MAXCXNS);
+			close(sockfd);
+			sockfd = 0;
+			continue;
+		}
+
+		// fork child process to serve connection
+		childPid = fork();
+		switch (childPid)
+		{
+			case -1:
+			{
+				perror("fork()");
+				break;
+			}
+			case 0:		// child process
+				close(sigfd);
+				sigfd = -1;
+				close(listenfd);
+				listenfd = 0;
+				if (ctlfd >= 0) {
+					close(ctlfd);
+					ctlfd = -1;
+				}
+				if (unixfd >= 0) {
+					close(unixfd);
+					unixfd = -1;
+				}
+				// a cached buffer stays resident after its request
+				// has given its memory back to the budget
+				if (budgetmb > 0)
+					otpbuf_setcache(0);
+				struct sigaction SIGTERM_action = {0};
+				SIGTERM_action.sa_handler = catchSIGTERM;
+				sigfillset(&SIGTERM_action.sa_mask);
+				sigaction(SIGTERM, &SIGTERM_action, NULL);
+				sigdelset(&sigs, SIGTERM);
+				sigprocmask(SIG_UNBLOCK, &sigs, NULL);
+				TRACE_FORK();
+				TRACE_REQ();
+				TRACE_AT(TR_ACCEPT, acceptts, 0);
+
+				serve(conf);
+
+				// cleanup
+				exit(0);
+				break;
+			default:
+			{
+				// add current connection
+				slot_add(&kids, childPid);
+				otprate_fork(childPid);
+			}
+		}
+
+		close(sockfd);
+		sockfd = 0;
+	}
+
+	return 0;
+}
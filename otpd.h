@@ -0,0 +1,43 @@
+#ifndef OTPD_H
+#define OTPD_H
+
+
+/*
+ * otpd.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * daemon core shared by otp_enc_d and otp_dec_d (header file)
+ */
+
+
+/* LIBRARIES */
+#include "otplib.h"
+
+
+/* MACROS */
+#define BACKLOG 5
+#define MAXCXNS 5
+#define SLOTBITS 4						// slot table holds 1 << SLOTBITS pids, at least 2 * MAXCXNS
+
+
+/* STRUCTS AND ENUMS */
+// codec applied to each request: writes len characters and a
+// terminator to out, which may be in itself
+typedef void (*otpd_codec)(const char *in, const char *key, char *out, size_t len);
+
+// what distinguishes one daemon from the other
+typedef struct otpd_conf {
+	const char *acceptid;				// id clients must send
+	const char *inname;					// name of input in messages, e.g. "plaintext"
+	otpd_codec codec;
+	bool reuse;							// check keys for reuse (decryption reuses by design)
+} otpd_conf;
+
+
+/* FUNCTION DECLARATIONS */
+int otpd_main(const otpd_conf *conf, int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,322 @@
+/*
+ * otpkey.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * key containers
+ *
+ * the writer checks each character as it is written, so a container
+ * flagged OTPKEY_CHECKED never needs a character scan. Block sums are
+ * verified lazily, the first time a window touches a block, and the
+ * header, which holds its own checksum, is written last so a container
+ * cut short is never taken for a whole one. The header checksum leaves
+ * out the block sums, so opening a large key stays cheap; a damaged
+ * sum just fails its block.
+ */
+
+
+/* LIBRARIES */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "otpcrc.h"
+#include "otpkey.h"
+
+
+/* FUNCTION DECLARATIONS */
+static int readhdr(otpkey *k, const char *path);
+static int pwriteall(int fd, const void *buf, size_t n, off_t offset);
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  otpkey_open
+ * SYNOPSYS
+ * 	maps key file path, a container or a plain key (everything before
+ *  a final newline)
+ *  returns the open key, release with otpkey_close, or NULL (error)
+ */
+otpkey * otpkey_open(char *path)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		fprintf(stderr, "File Not Found: %s.\n", path);
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+		fprintf(stderr, "Error: key %s is not a regular file.\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	otpkey *k = (otpkey *) calloc(1, sizeof(otpkey));
+	if (!k) {
+		close(fd);
+		return NULL;
+	}
+	k->fd = fd;
+	k->maplen = st.st_size;
+	if (k->maplen > 0) {
+		k->map = mmap(NULL, k->maplen, PROT_READ, MAP_SHARED, fd, 0);
+		if (k->map == MAP_FAILED) {
+			perror("mmap() key");
+			k->map = NULL;
+			otpkey_close(k);
+			return NULL;
+		}
+	}
+
+	if (k->maplen >= sizeof(otpkey_hdr) && memcmp(k->map, OTPKEY_MAGIC, sizeof(OTPKEY_MAGIC)) == 0) {
+		if (readhdr(k, path) == -1) {
+			otpkey_close(k);
+			return NULL;
+		}
+		return k;
+	}
+
+	k->data = k->map;
+	k->length = k->maplen;
+	if (k->length > 0 && k->data[k->length - 1] == '\n')
+		k->length--;
+	return k;
+}
+
+
+/* NAME
+ *  readhdr
+ * SYNOPSYS
+ * 	checks a container's header against its checksum, and that it
+ *  describes the mapped file
+ *  returns 0 or -1 (error)
+ */
+static int readhdr(otpkey *k, const char *path)
+{
+	otpkey_hdr h;
+	memcpy(&h, k->map, sizeof(h));
+	if (h.alphabet != OTPKEY_AZSP || h.block == 0 || h.data > k->maplen || h.length > k->maplen - h.data) {
+		fprintf(stderr, "Error: key %s is not a valid container.\n", path);
+		return -1;
+	}
+	size_t nblocks = (h.length + h.block - 1) / h.block;
+	if (h.data < sizeof(h) + nblocks * sizeof(uint32_t)) {
+		fprintf(stderr, "Error: key %s is not a valid container.\n", path);
+		return -1;
+	}
+
+	uint32_t crc = h.crc;
+	h.crc = 0;
+	if (otpcrc32c(0, &h, sizeof(h)) != crc) {
+		fprintf(stderr, "Error: key %s header fails its checksum.\n", path);
+		return -1;
+	}
+
+	k->verified = (uint8_t *) calloc(nblocks ? nblocks : 1, 1);
+	if (!k->verified)
+		return -1;
+	k->container = TRUE;
+	k->checked = (h.flags & OTPKEY_CHECKED) ? TRUE : FALSE;
+	k->data = k->map + h.data;
+	k->length = h.length;
+	k->sums = (const uint32_t *) (k->map + sizeof(h));
+	k->block = h.block;
+	return 0;
+}
+
+
+/* NAME
+ *  otpkey_window
+ * SYNOPSYS
+ * 	the len key characters from offset, fewer if the key ends first;
+ *  sets got to how many. A container's blocks under the window are
+ *  verified against their sums, each only the first time
+ *  returns pointer into the mapped key, or NULL if a block is corrupt
+ */
+const char * otpkey_window(otpkey *k, size_t offset, size_t len, size_t *got)
+{
+	*got = 0;
+	if (offset >= k->length)
+		return "";
+	size_t n = (len < k->length - offset) ? len : k->length - offset;
+
+	if (k->container && n > 0) {
+		size_t b;
+		for (b = offset / k->block; b <= (offset + n - 1) / k->block; b++) {
+			if (k->verified[b])
+				continue;
+			size_t start = b * k->block;
+			size_t blen = (k->length - start < k->block) ? k->length - start : k->block;
+			if (otpcrc32c(0, k->data + start, blen) != k->sums[b]) {
+				fprintf(stderr, "Error: key block %zu fails its checksum.\n", b);
+				return NULL;
+			}
+			k->verified[b] = 1;
+		}
+	}
+
+	*got = n;
+	return k->data + offset;
+}
+
+
+/* NAME
+ *  otpkey_close
+ * SYNOPSYS
+ * 	unmaps and closes a key
+ */
+void otpkey_close(otpkey *k)
+{
+	if (!k)
+		return;
+	if (k->map)
+		munmap(k->map, k->maplen);
+	close(k->fd);
+	free(k->verified);
+	free(k);
+}
+
+
+/* NAME
+ *  pwriteall
+ * SYNOPSYS
+ * 	writes all n bytes of buf at offset
+ *  returns 0 or -1 (error)
+ */
+static int pwriteall(int fd, const void *buf, size_t n, off_t offset)
+{
+	const char *p = (const char *) buf;
+	while (n > 0) {
+		ssize_t w = pwrite(fd, p, n, offset);
+		if (w == -1 && errno == EINTR)
+			continue;
+		if (w == -1) {
+			perror("pwrite() key");
+			return -1;
+		}
+		p += w;
+		n -= w;
+		offset += w;
+	}
+	return 0;
+}
+
+
+/* NAME
+ *  otpkey_create
+ * SYNOPSYS
+ * 	starts a container of length key characters at path, replacing
+ *  any file there
+ *  returns the writer, finish with otpkey_finish, or NULL (error)
+ */
+otpkey_writer * otpkey_create(char *path, size_t length)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd == -1) {
+		perror("open() key");
+		return NULL;
+	}
+
+	size_t nblocks = (length + OTPKEY_BLOCK - 1) / OTPKEY_BLOCK;
+	otpkey_writer *w = (otpkey_writer *) calloc(1, sizeof(otpkey_writer));
+	uint32_t *sums = (uint32_t *) calloc(nblocks ? nblocks : 1, sizeof(uint32_t));
+	if (!w || !sums) {
+		fprintf(stderr, "Error: out of memory for key %s.\n", path);
+		free(w);
+		free(sums);
+		close(fd);
+		return NULL;
+	}
+	w->fd = fd;
+	w->path = path;
+	w->sums = sums;
+	strcpy(w->hdr.magic, OTPKEY_MAGIC);
+	w->hdr.alphabet = OTPKEY_AZSP;
+	w->hdr.block = OTPKEY_BLOCK;
+	w->hdr.length = length;
+	w->hdr.flags = OTPKEY_CHECKED;
+	size_t table = sizeof(otpkey_hdr) + nblocks * sizeof(uint32_t);
+	w->hdr.data = (table + OTPKEY_ALIGN - 1) / OTPKEY_ALIGN * OTPKEY_ALIGN;
+
+	if (ftruncate(fd, w->hdr.data + length) == -1) {
+		perror("ftruncate() key");
+		free(sums);
+		free(w);
+		close(fd);
+		unlink(path);
+		return NULL;
+	}
+	return w;
+}
+
+
+/* NAME
+ *  otpkey_write
+ * SYNOPSYS
+ * 	appends n key characters, which must be A to Z or space, summing
+ *  each block as it fills
+ *  returns 0 or -1 (error)
+ */
+int otpkey_write(otpkey_writer *w, const char *chars, size_t n)
+{
+	if (n > w->hdr.length - w->written) {
+		fprintf(stderr, "Error: key %s longer than its %lu characters.\n", w->path,
+			(unsigned long) w->hdr.length);
+		return -1;
+	}
+	if (!hasValidCharsn(chars, n)) {
+		fprintf(stderr, "Error: invalid characters for key %s.\n", w->path);
+		return -1;
+	}
+	if (pwriteall(w->fd, chars, n, w->hdr.data + w->written) == -1)
+		return -1;
+
+	while (n > 0) {
+		size_t room = w->hdr.block - w->written % w->hdr.block;
+		size_t m = (n < room) ? n : room;
+		w->crc = otpcrc32c(w->crc, chars, m);
+		chars += m;
+		n -= m;
+		w->written += m;
+		if (w->written % w->hdr.block == 0 || w->written == w->hdr.length) {
+			w->sums[(w->written - 1) / w->hdr.block] = w->crc;
+			w->crc = 0;
+		}
+	}
+	return 0;
+}
+
+
+/* NAME
+ *  otpkey_finish
+ * SYNOPSYS
+ * 	writes the block sums and the header, closes the container and
+ *  frees the writer; a container that is short or failed is removed
+ *  returns 0 or -1 (error)
+ */
+int otpkey_finish(otpkey_writer *w)
+{
+	int status = -1;
+	size_t nblocks = (w->hdr.length + w->hdr.block - 1) / w->hdr.block;
+
+	if (w->written != w->hdr.length)
+		fprintf(stderr, "Error: key %s short, %zu of %lu characters written.\n", w->path,
+			w->written, (unsigned long) w->hdr.length);
+	else {
+		w->hdr.crc = 0;
+		w->hdr.crc = otpcrc32c(0, &w->hdr, sizeof(w->hdr));
+		if (pwriteall(w->fd, w->sums, nblocks * sizeof(uint32_t), sizeof(otpkey_hdr)) == 0
+				&& pwriteall(w->fd, &w->hdr, sizeof(w->hdr), 0) == 0)
+			status = 0;
+	}
+
+	if (close(w->fd) == -1) {
+		perror("close() key");
+		status = -1;
+	}
+	if (status == -1)
+		unlink(w->path);
+	free(w->sums);
+	free(w);
+	return status;
+}
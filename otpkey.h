@@ -0,0 +1,83 @@
+#ifndef OTPKEY_H
+#define OTPKEY_H
+
+
+/*
+ * otpkey.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * key containers (header file)
+ *
+ * keygen -k writes a key as a container: a header giving the alphabet,
+ * the length and whether every character was checked when written, a
+ * CRC32C (otpcrc.h) per block of key, then the key itself, page
+ * aligned. A client maps it and verifies only the blocks a request
+ * uses, once each, instead of reading and scanning the key. Plain key
+ * files open the same way, unchecked, so callers need not care which
+ * they were given.
+ */
+
+
+/* LIBRARIES */
+#include <stddef.h>
+#include <stdint.h>
+#include "otplib.h"
+
+
+/* MACROS */
+#define OTPKEY_MAGIC "OTPKEY1"			// first bytes of a container
+#define OTPKEY_AZSP 1					// alphabet: A to Z and space
+#define OTPKEY_CHECKED 1				// flag: every character checked when written
+#define OTPKEY_BLOCK 4096				// key characters per checksum
+#define OTPKEY_ALIGN 4096				// key starts on this boundary
+
+
+/* STRUCTS AND ENUMS */
+// start of a container, followed by one uint32_t CRC32C per block
+typedef struct otpkey_hdr {
+	char magic[8];
+	uint32_t alphabet;
+	uint32_t block;						// characters per checksum
+	uint64_t length;					// key characters
+	uint64_t data;						// file offset of the key
+	uint32_t flags;
+	uint32_t crc;						// of this header, with crc 0
+} otpkey_hdr;
+
+// an open key file, container or plain
+typedef struct otpkey {
+	char *map;
+	size_t maplen;
+	int fd;
+	const char *data;					// first key character
+	size_t length;						// key characters
+	bool container;
+	bool checked;						// characters need no scan
+	const uint32_t *sums;				// container: per block CRC32C
+	size_t block;
+	uint8_t *verified;					// container: per block, sum matched
+} otpkey;
+
+// a container being written
+typedef struct otpkey_writer {
+	int fd;
+	char *path;
+	otpkey_hdr hdr;
+	uint32_t *sums;
+	size_t written;						// key characters so far
+	uint32_t crc;						// of the block being written
+} otpkey_writer;
+
+
+/* FUNCTION DECLARATIONS */
+otpkey * otpkey_open(char *path);
+const char * otpkey_window(otpkey *k, size_t offset, size_t len, size_t *got);
+void otpkey_close(otpkey *k);
+otpkey_writer * otpkey_create(char *path, size_t length);
+int otpkey_write(otpkey_writer *w, const char *chars, size_t n);
+int otpkey_finish(otpkey_writer *w);
+
+#endif
@@ -0,0 +1,495 @@
+/*
+ * otplane.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * request lanes and memory budget
+ *
+ * lane state is mapped shared before the parent forks. A process
+ * shared, robust mutex guards it, so a child killed while holding the
+ * lock cannot wedge the others, and the parent releases whatever a
+ * reaped child still held: a large lane slot, or memory.
+ */
+
+
+/* LIBRARIES */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "otplane.h"
+
+
+/* STRUCTS AND ENUMS */
+// a large request waiting for a slot
+typedef struct waiter {
+	pid_t pid;
+	size_t len;
+	uint64_t since;						// nanoseconds, CLOCK_MONOTONIC
+} waiter;
+
+// memory granted to a child for its request
+typedef struct charge {
+	pid_t pid;
+	size_t bytes;
+} charge;
+
+// per lane counters
+typedef struct lanestat {
+	uint64_t requests;
+	uint64_t wait[OTPLANE_BUCKETS];		// header to admission
+	uint64_t serve[OTPLANE_BUCKETS];	// admission to reply sent
+} lanestat;
+
+// shared by the parent and all children
+typedef struct lanes {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;				// a slot freed or a waiter left
+	size_t threshold;
+	int slots;							// large lane slots
+	pid_t busy[OTPLANE_WAITERS];		// children holding a slot, 0 if free
+	int nbusy;
+	waiter waiting[OTPLANE_WAITERS];
+	int nwaiting;
+	pid_t member[OTPLANE_WAITERS];		// children whose last request was large
+	int nmember;
+	size_t budget;						// bytes requests may hold at once, 0 for any
+	size_t used;
+	size_t peak;
+	charge held[OTPLANE_WAITERS];		// children holding part of the budget
+	int nheld;
+	uint64_t memwaits;					// requests that waited for memory
+	uint64_t timeouts;					// requests that gave up waiting
+	uint64_t toolarge;					// requests refused for their length
+	lanestat stat[NLANES];
+} lanes;
+
+
+/* GLOBAL VARIABLES */
+static lanes *ln = NULL;				// NULL until otplane_init
+static int ismember = 0;				// child: in ln->member
+
+
+/* FUNCTION DECLARATIONS */
+static uint64_t lanenow();
+static void lanelock();
+static int best();
+static void dropwaiter(pid_t pid);
+static void dropbusy(pid_t pid);
+static void dropmember(pid_t pid);
+static void release(pid_t pid);
+static int admissible(int lane, pid_t me, size_t bytes);
+static void histadd(uint64_t *hist, uint64_t ns);
+static double histpct(const uint64_t *hist, double pct);
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  otplane_init
+ * SYNOPSYS
+ * 	parent: maps lane state; requests of threshold characters or more
+ *  (0 for none) are large, and at most slots of them are served at
+ *  once; all requests together may hold budget bytes (0 for any)
+ *  returns 0 or -1 (error)
+ */
+int otplane_init(size_t threshold, int slots, size_t budget)
+{
+	void *base = mmap(NULL, sizeof(lanes), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		perror("mmap() lanes");
+		return -1;
+	}
+	ln = (lanes *) base;
+	ln->threshold = threshold;
+	ln->slots = (slots > OTPLANE_WAITERS) ? OTPLANE_WAITERS : slots;
+	ln->budget = budget;
+
+	pthread_mutexattr_t ma;
+	pthread_mutexattr_init(&ma);
+	pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&ln->lock, &ma);
+	pthread_mutexattr_destroy(&ma);
+
+	pthread_condattr_t ca;
+	pthread_condattr_init(&ca);
+	pthread_condattr_setpshared(&ca, PTHREAD_PROCESS_SHARED);
+	pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+	pthread_cond_init(&ln->cond, &ca);
+	pthread_condattr_destroy(&ca);
+	return 0;
+}
+
+
+/* NAME
+ *  lanenow
+ * SYNOPSYS
+ * 	monotonic time in nanoseconds
+ */
+static uint64_t lanenow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/* NAME
+ *  lanelock
+ * SYNOPSYS
+ * 	takes the lane lock, recovering it from a child that died holding it
+ */
+static void lanelock()
+{
+	if (pthread_mutex_lock(&ln->lock) == EOWNERDEAD)
+		pthread_mutex_consistent(&ln->lock);
+}
+
+
+/* NAME
+ *  best
+ * SYNOPSYS
+ * 	waiter to admit next: shortest request, its length divided by one
+ *  plus the seconds it has waited so large jobs are not starved
+ *  returns index into ln->waiting, -1 if none
+ */
+static int best()
+{
+	uint64_t t = lanenow();
+	int pick = -1;
+	double pickw = 0;
+	int i;
+	for (i = 0; i < ln->nwaiting; i++) {
+		waiter *w = &ln->waiting[i];
+		double weight = w->len / (1.0 + (t - w->since) / 1e9);
+		if (pick == -1 || weight < pickw) {
+			pick = i;
+			pickw = weight;
+		}
+	}
+	return pick;
+}
+
+
+/* NAME
+ *  dropwaiter
+ * SYNOPSYS
+ * 	removes pid from the waiters, lock held
+ */
+static void dropwaiter(pid_t pid)
+{
+	int i;
+	for (i = 0; i < ln->nwaiting; i++) {
+		if (ln->waiting[i].pid == pid) {
+			ln->waiting[i] = ln->waiting[--ln->nwaiting];
+			return;
+		}
+	}
+}
+
+
+/* NAME
+ *  dropbusy
+ * SYNOPSYS
+ * 	frees the large lane slot of pid, if any, lock held
+ */
+static void dropbusy(pid_t pid)
+{
+	int i;
+	for (i = 0; i < OTPLANE_WAITERS; i++) {
+		if (ln->busy[i] == pid) {
+			ln->busy[i] = 0;
+			ln->nbusy--;
+			return;
+		}
+	}
+}
+
+
+/* NAME
+ *  dropmember
+ * SYNOPSYS
+ * 	removes pid from the large connections, lock held
+ */
+static void dropmember(pid_t pid)
+{
+	int i;
+	for (i = 0; i < ln->nmember; i++) {
+		if (ln->member[i] == pid) {
+			ln->member[i] = ln->member[--ln->nmember];
+			return;
+		}
+	}
+}
+
+
+/* NAME
+ *  release
+ * SYNOPSYS
+ * 	returns the memory pid holds to the budget, lock held
+ */
+static void release(pid_t pid)
+{
+	int i;
+	for (i = 0; i < ln->nheld; i++) {
+		if (ln->held[i].pid == pid) {
+			ln->used -= ln->held[i].bytes;
+			ln->held[i] = ln->held[--ln->nheld];
+			return;
+		}
+	}
+}
+
+
+/* NAME
+ *  admissible
+ * SYNOPSYS
+ * 	whether me may go ahead with bytes of memory, in lane, lock held
+ */
+static int admissible(int lane, pid_t me, size_t bytes)
+{
+	if (ln->budget > 0 && ln->used + bytes > ln->budget)
+		return 0;
+	if (lane == LANE_SMALL)
+		return 1;
+	int b = best();
+	return ln->nbusy < ln->slots && b >= 0 && ln->waiting[b].pid == me;
+}
+
+
+/* NAME
+ *  otplane_enter
+ * SYNOPSYS
+ * 	child: admits a request of len characters needing bytes of memory,
+ *  waiting up to timeout seconds (0 is forever) for the memory, and for
+ *  a large lane slot if it needs one
+ *  returns its lane, or -1 if it timed out or too many are waiting
+ */
+int otplane_enter(size_t len, size_t bytes, int timeout)
+{
+	if (!ln)
+		return LANE_SMALL;
+	pid_t me = getpid();
+	int lane = (ln->threshold > 0 && len >= ln->threshold) ? LANE_LARGE : LANE_SMALL;
+	if (lane == LANE_SMALL && ln->budget == 0 && !ismember)
+		return LANE_SMALL;
+
+	lanelock();
+	if (lane == LANE_SMALL && ismember) {
+		dropmember(me);
+		ismember = 0;
+	}
+	if (ln->nheld == OTPLANE_WAITERS || (lane == LANE_LARGE && (ln->nwaiting == OTPLANE_WAITERS
+			|| (!ismember && ln->nmember == OTPLANE_WAITERS)))) {
+		pthread_mutex_unlock(&ln->lock);
+		return -1;
+	}
+	if (lane == LANE_LARGE) {
+		if (!ismember) {
+			ln->member[ln->nmember++] = me;
+			ismember = 1;
+		}
+		waiter *w = &ln->waiting[ln->nwaiting++];
+		w->pid = me;
+		w->len = len;
+		w->since = lanenow();
+	}
+	if (ln->budget > 0 && ln->used + bytes > ln->budget)
+		ln->memwaits++;
+
+	struct timespec due;
+	clock_gettime(CLOCK_MONOTONIC, &due);
+	due.tv_sec += timeout;
+	while (!admissible(lane, me, bytes)) {
+		int rc = timeout ? pthread_cond_timedwait(&ln->cond, &ln->lock, &due)
+			: pthread_cond_wait(&ln->cond, &ln->lock);
+		if (rc == EOWNERDEAD)
+			pthread_mutex_consistent(&ln->lock);
+		else if (rc == ETIMEDOUT) {
+			if (lane == LANE_LARGE) {
+				dropwaiter(me);
+				dropmember(me);
+				ismember = 0;
+			}
+			ln->timeouts++;
+			pthread_cond_broadcast(&ln->cond);
+			pthread_mutex_unlock(&ln->lock);
+			return -1;
+		}
+	}
+
+	if (ln->budget > 0) {
+		ln->held[ln->nheld].pid = me;
+		ln->held[ln->nheld++].bytes = bytes;
+		ln->used += bytes;
+		if (ln->used > ln->peak)
+			ln->peak = ln->used;
+	}
+	if (lane == LANE_LARGE) {
+		dropwaiter(me);
+		int i;
+		for (i = 0; ln->busy[i] != 0; i++)
+			;
+		ln->busy[i] = me;
+		ln->nbusy++;
+
+		// another slot may be free for the next waiter
+		pthread_cond_broadcast(&ln->cond);
+	}
+	pthread_mutex_unlock(&ln->lock);
+	return lane;
+}
+
+
+/* NAME
+ *  histadd
+ * SYNOPSYS
+ * 	counts ns in its power of 2 microseconds bucket
+ */
+static void histadd(uint64_t *hist, uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	int b = us ? 64 - __builtin_clzll(us) : 0;
+	if (b >= OTPLANE_BUCKETS)
+		b = OTPLANE_BUCKETS - 1;
+	__atomic_add_fetch(&hist[b], 1, __ATOMIC_RELAXED);
+}
+
+
+/* NAME
+ *  otplane_leave
+ * SYNOPSYS
+ * 	child: a request in lane, whose header arrived at start and which
+ *  was admitted at admitted (lanenow() nanoseconds), has been answered;
+ *  frees its slot and memory
+ */
+void otplane_leave(int lane, uint64_t start, uint64_t admitted)
+{
+	if (!ln)
+		return;
+	lanestat *st = &ln->stat[lane];
+	__atomic_add_fetch(&st->requests, 1, __ATOMIC_RELAXED);
+	histadd(st->wait, admitted - start);
+	histadd(st->serve, lanenow() - admitted);
+
+	if (lane == LANE_LARGE || ln->budget > 0) {
+		lanelock();
+		dropbusy(getpid());
+		release(getpid());
+		pthread_cond_broadcast(&ln->cond);
+		pthread_mutex_unlock(&ln->lock);
+	}
+}
+
+
+/* NAME
+ *  otplane_toolarge
+ * SYNOPSYS
+ * 	child: counts a request refused for its length
+ */
+void otplane_toolarge()
+{
+	if (ln)
+		__atomic_add_fetch(&ln->toolarge, 1, __ATOMIC_RELAXED);
+}
+
+
+/* NAME
+ *  otplane_excess
+ * SYNOPSYS
+ * 	parent: large connections (waiting, served or idle since a large
+ *  request) beyond the large lane slots; they do not count against
+ *  MAXCXNS, as no more than slots of them are ever served at once
+ */
+int otplane_excess()
+{
+	if (!ln)
+		return 0;
+	int n = __atomic_load_n(&ln->nmember, __ATOMIC_RELAXED);
+	return (n > ln->slots) ? n - ln->slots : 0;
+}
+
+
+/* NAME
+ *  otplane_reap
+ * SYNOPSYS
+ * 	parent: releases whatever child pid, now gone, held
+ */
+void otplane_reap(pid_t pid)
+{
+	if (!ln)
+		return;
+	lanelock();
+	dropwaiter(pid);
+	dropbusy(pid);
+	dropmember(pid);
+	release(pid);
+	pthread_cond_broadcast(&ln->cond);
+	pthread_mutex_unlock(&ln->lock);
+}
+
+
+/* NAME
+ *  histpct
+ * SYNOPSYS
+ * 	upper bound of the bucket holding percentile pct, in milliseconds
+ */
+static double histpct(const uint64_t *hist, double pct)
+{
+	uint64_t total = 0, seen = 0;
+	int b;
+	for (b = 0; b < OTPLANE_BUCKETS; b++)
+		total += hist[b];
+	for (b = 0; b < OTPLANE_BUCKETS; b++) {
+		seen += hist[b];
+		if (total && seen >= total * pct)
+			break;
+	}
+	return (b == OTPLANE_BUCKETS) ? 0 : (double) (1ULL << b) / 1000;
+}
+
+
+/* NAME
+ *  otplane_report
+ * SYNOPSYS
+ * 	writes per lane counts and latency percentiles, and memory budget
+ *  use, to buf
+ *  returns length written
+ */
+int otplane_report(char *buf, size_t size)
+{
+	if (!ln)
+		return snprintf(buf, size, "lanes off, no memory budget\n");
+
+	const char *names[NLANES] = {"small", "large"};
+	char conf[64] = "no large lane";
+	if (ln->threshold > 0)
+		snprintf(conf, sizeof(conf), "large >= %zu characters, %d slots", ln->threshold, ln->slots);
+	int n = snprintf(buf, size, "lane   requests  busy  waiting  wait p50/p99 ms  serve p50/p99 ms  (%s)\n", conf);
+	int i;
+	for (i = 0; i < NLANES && n < (int) size; i++) {
+		lanestat *st = &ln->stat[i];
+		char busy[16] = "-", waiting[16] = "-";
+		if (i == LANE_LARGE) {
+			sprintf(busy, "%d", ln->nbusy);
+			sprintf(waiting, "%d", ln->nwaiting);
+		}
+		n += snprintf(buf + n, size - n, "%-6s %8lu  %4s  %7s  %7.3f/%-7.3f  %8.3f/%-8.3f\n", names[i],
+			(unsigned long) st->requests, busy, waiting, histpct(st->wait, 0.5), histpct(st->wait, 0.99),
+			histpct(st->serve, 0.5), histpct(st->serve, 0.99));
+	}
+
+	char budget[24] = "any";
+	if (ln->budget > 0)
+		snprintf(budget, sizeof(budget), "%zu", ln->budget);
+	if (n < (int) size)
+		n += snprintf(buf + n, size - n, "memory used %zu / %s bytes  peak %zu  waited %lu  timed out %lu  too large %lu\n",
+			ln->used, budget, ln->peak, (unsigned long) ln->memwaits, (unsigned long) ln->timeouts,
+			(unsigned long) ln->toolarge);
+	return n;
+}
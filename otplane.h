@@ -0,0 +1,59 @@
+#ifndef OTPLANE_H
+#define OTPLANE_H
+
+
+/*
+ * otplane.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * request lanes and memory budget (header file)
+ *
+ * a daemon reads the length header of each request before its body
+ * and sorts it into a lane: small requests go straight through, large
+ * ones need one of a limited number of large lane slots, so bulk work
+ * can never hold every connection. A connection stays large from its
+ * first large request until it sends a small one; large connections
+ * beyond the slots don't count as connections. Large requests waiting
+ * for a slot are admitted shortest first, weighted by how long they
+ * have waited.
+ *
+ * every request also holds its memory (input, key and output) against
+ * a budget shared by all children from when its header arrives until
+ * it is answered; a request waits for memory rather than pushing the
+ * host into swap. Per lane latency histograms and budget use live in
+ * the same shared memory.
+ */
+
+
+/* LIBRARIES */
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/* MACROS */
+#define OTPLANE_THRESHOLD (1024 * 1024)	// default: requests this long are large
+#define OTPLANE_RESERVE 1				// default connections kept from large requests
+#define OTPLANE_WAITERS 16				// large requests waiting at once, at most
+#define OTPLANE_BUCKETS 32				// histogram buckets, powers of 2 microseconds
+#define OTPLANE_BUDGET (512UL << 20)	// default bytes all requests may hold
+#define OTPLANE_MAXREQ (64UL << 20)		// default longest request, characters
+
+
+/* STRUCTS AND ENUMS */
+typedef enum otplane_id {LANE_SMALL, LANE_LARGE, NLANES} otplane_id;
+
+
+/* FUNCTION DECLARATIONS */
+int otplane_init(size_t threshold, int slots, size_t budget);
+int otplane_enter(size_t len, size_t bytes, int timeout);
+void otplane_leave(int lane, uint64_t start, uint64_t admitted);
+void otplane_toolarge();
+int otplane_excess();
+void otplane_reap(pid_t pid);
+int otplane_report(char *buf, size_t size);
+
+#endif
@@ -11,6 +11,41 @@
  
 /* LIBRARIES */
 #include "otplib.h"
+#include <ctype.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "otpcrc.h"
+#include "otppack.h"
+
+
+/* MACROS */
+#define FD_CRC 1						// messages on the socket carry trailers
+#define FD_PACK 2						// messages on the socket may be packed
+#define FD_PACKED 4						// the body after the last header is packed
+#define PACKCHUNK 4096					// packed groups received at a time
+
+
+/* GLOBAL VARIABLES */
+static otp_limits *limits = NULL;		// applied to every transfer, if set
+// defaults from otp_bench net on loopback: nodelay and more cut a
+// 32 byte request from 44 ms (Nagle + delayed ack) to 26 us; 1 MB
+// buffers lift 16 MB requests from 60 to 70 MB/s; quickack and drain
+// only added latency
+static otp_sockopts sockopts = {1, 1, 0, 1048576, 1048576, 0, 0, 0};
+static unsigned char fdflags[OTP_FDFLAGS];	// FD_ flags of each socket
+
+
+/* FUNCTION DECLARATIONS */
+static int initunix(char *path, socktype st);
+static int otp_wait(int sockfd, short events, const struct timespec *start, size_t done);
+static long otp_sendv(int sockfd, const char *msg, size_t msglen, int flags);
+static void otp_drain(int sockfd);
+static int otp_recvcrc(int sockfd, uint32_t crc);
+static char * otp_recvpacked(int sockfd, size_t length, size_t keep, bool check);
+static int otp_setflag(int sockfd, unsigned char flag, bool on);
 
 
 /* FUNCTION DEFINITIONS */
@@ -28,10 +63,59 @@ bool isValidPort(int p)
 		return TRUE;
 }
 
+/* NAME
+ *  initunix
+ * SYNOPSYS 
+ * 	unix socket counterpart of initialize: binds (replacing a stale
+ *  socket file) or connects to path
+ *  returns socket or -1 (error)
+ */
+static int initunix(char *path, socktype st)
+{
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sa.sun_path))
+	{
+		fprintf(stderr, "Error: Socket path %s too long.\n", path);
+		return -1;
+	}
+	strcpy(sa.sun_path, path);
+	
+	int sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sockfd == -1)
+	{
+		perror("Error: socket()");
+		return -1;
+	}
+	otp_applysockopts(sockfd);
+	
+	int status;
+	if (st == BIND)
+	{
+		unlink(path);
+		status = bind(sockfd, (struct sockaddr *)&sa, sizeof(sa));
+	}
+	else
+		status = connect(sockfd, (struct sockaddr *)&sa, sizeof(sa));
+	if (status == -1)
+	{
+		fprintf(stderr, "Error: Failed to connect on %s.\n", path);
+		close(sockfd);
+		return -1;
+	}
+	return sockfd;
+}
+
+
 /* NAME
  *  initialize
  * SYNOPSYS 
  * 	returns valid socket file descriptor
+ *  host may be a name (bound to its first address, connected to on
+ *  each in turn), an IPv4 or IPv6 address, or NULL / "*" to
+ *  bind to all addresses (dual-stack IPv6 where available), or a
+ *  path starting with / for a unix socket (port is then ignored)
  */
 int initialize(char *host, char *port, socktype st)
 {
@@ -40,8 +124,16 @@ int initialize(char *host, char *port, socktype st)
 	struct addrinfo *p;						// for iterating through linked list
 	int status, sockfd;
 	
+	// unix socket
+	if (host && host[0] == '/')
+		return initunix(host, st);
+	
+	// wildcard
+	if (host && strcmp(host, "*") == 0)
+		host = NULL;
+	
 	memset(&hints, '\0', sizeof(hints));	// ensure the struct is empty
-	hints.ai_family = AF_INET; 				// IPv4
+	hints.ai_family = AF_UNSPEC; 			// IPv4 or IPv6
 	hints.ai_socktype = SOCK_STREAM;		// TCP
 	hints.ai_flags = AI_PASSIVE;			// fills in IP address automatically
 	
@@ -53,31 +145,52 @@ int initialize(char *host, char *port, socktype st)
 		return -1;
 	}
 	
-	// iterate through linkedlist to find valid addrinfo
-	for (p = res; p != NULL; p = p->ai_next)
+	// iterate through linkedlist to find valid addrinfo; when binding
+	// the wildcard, try IPv6 first so one socket serves both families
+	bool wild = (host == NULL && st == BIND) ? TRUE : FALSE;
+	int pass;
+	p = NULL;
+	for (pass = 0; pass < (wild ? 2 : 1) && p == NULL; pass++)
 	{
-		// get the socket file descriptor, error check
-		sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-		if (sockfd == -1)
-		{
-			// perror("Error: socket()");
-			continue;
-		}
-		
-		// bind socket (as server) or connect (as client), error check
-		if (st == BIND)
-			status = bind(sockfd, p->ai_addr, p->ai_addrlen);
-		else if (st == CONNECT)
-			status = connect(sockfd, p->ai_addr, p->ai_addrlen);
-		if (status == -1)
+		for (p = res; p != NULL; p = p->ai_next)
 		{
-			close(sockfd);
-			// perror("Error: bind()");
-			continue;
+			if (wild && (p->ai_family == AF_INET6) != (pass == 0))
+				continue;
+			
+			// get the socket file descriptor, error check
+			sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+			if (sockfd == -1)
+			{
+				// perror("Error: socket()");
+				continue;
+			}
+			
+			// buffer sizes must be set before the handshake to take
+			// effect; accepted sockets inherit the listener's
+			otp_applysockopts(sockfd);
+			
+			// bind socket (as server) or connect (as client), error check
+			if (st == BIND)
+			{
+				int v6only = (host != NULL);
+				int reuse = 1;
+				setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+				if (p->ai_family == AF_INET6)
+					setsockopt(sockfd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+				status = bind(sockfd, p->ai_addr, p->ai_addrlen);
+			}
+			else if (st == CONNECT)
+				status = connect(sockfd, p->ai_addr, p->ai_addrlen);
+			if (status == -1)
+			{
+				close(sockfd);
+				// perror("Error: bind()");
+				continue;
+			}
+			
+			// exit the loop if successful
+			break;
 		}
-		
-		// exit the loop if successful
-		break;
 	}
 	
 	// free linked list
@@ -96,92 +209,370 @@ int initialize(char *host, char *port, socktype st)
 
 
 /* NAME
- *  checkBg
+ *  otp_send
  * SYNOPSYS 
- * 	checks for completed child processes
- *  updates array and number
+ * 	sends string to file descriptor in format "<msg length> <msg>"
+ *  returns bytes sent or -1 (error)
  */
-void checkBg(int arr[], int *num)
+long otp_send(int sockfd, char *msg)
 {
-	int method = -5;
-	pid_t check;
-	while ((check = waitpid(-1, &method, WNOHANG)) > 0)
-	{
-		// remove returned pid from array
-		int i;
-		for (i = 0; i < *num; i++)
-		{
-			if (arr[i] == check)
-			{
-				arr[i] = arr[*num - 1];
-				arr[*num - 1] = 0;
-				break;
-			}
-		}
-		(*num)--;
-	}
+	return otp_sendn(sockfd, msg, strlen(msg));
 }
 
 
 /* NAME
- *  otp_send
+ *  otp_sendn
  * SYNOPSYS 
- * 	sends string to file descriptor in format "<msg length> <msg>"
+ * 	sends msglen bytes of buffer to file descriptor in format
+ *  "<msg length> <msg>", buffer need not be null-terminated
+ *  header and message go out together without copying the message
+ *  returns bytes sent or -1 (error)
+ */
+long otp_sendn(int sockfd, const char *msg, size_t msglen)
+{
+	return otp_sendv(sockfd, msg, msglen, 0);
+}
+
+
+/* NAME
+ *  otp_sendn_more
+ * SYNOPSYS 
+ * 	like otp_sendn, for a message that another immediately follows:
+ *  with the more option the kernel holds a partial segment back so
+ *  both leave together (as with TCP_CORK)
  *  returns bytes sent or -1 (error)
  */
-int otp_send(int sockfd, char *msg)
+long otp_sendn_more(int sockfd, const char *msg, size_t msglen)
 {
+	return otp_sendv(sockfd, msg, msglen, sockopts.more ? MSG_MORE : 0);
+}
+
+
+/* NAME
+ *  otp_sendv
+ * SYNOPSYS 
+ * 	sends header and message as one gathered write with send flags,
+ *  and the message's CRC32C after it if the socket carries trailers;
+ *  on a socket that packs, a message wholly in the alphabet goes
+ *  packed as "<msg length>:<packed msg>", the length in characters
+ *  returns bytes sent or -1 (error)
+ */
+static long otp_sendv(int sockfd, const char *msg, size_t msglen, int flags)
+{
+	unsigned char fl = (sockfd >= 0 && sockfd < OTP_FDFLAGS) ? fdflags[sockfd] : 0;
+	
+	// pack if the socket packs and every character is in the alphabet;
+	// anything else, such as a batch header, goes as it is
+	char *packed = NULL;
+	if ((fl & FD_PACK) && msglen > 0 && (packed = otpbuf_alloc(OTPPACK_LEN(msglen))))
+	{
+		if (otppack(msg, msglen, (unsigned char *) packed) == -1)
+		{
+			otpbuf_free(packed);
+			packed = NULL;
+		}
+	}
+	
 	// get original message length as string
-	int msglen = strlen(msg);
-	char msglen_str[11];
+	char msglen_str[24];
 	memset(msglen_str, '\0', sizeof(msglen_str));
-	sprintf(msglen_str, "%d ", strlen(msg));
-	
-	// get total length of message, including prepended character count
-	int msglen_strlen = strlen(msglen_str);
-	int tosend = msglen_strlen + msglen;
+	sprintf(msglen_str, packed ? "%zu:" : "%zu ", msglen);
 	
-	// allocate and copy header-ed message
-	char *str = (char *) calloc(tosend + 1, sizeof(char));
-	sprintf(str, "%s%s", msglen_str, msg);
-	str[tosend] = '\0';
+	// header and message as one gathered write
+	struct iovec iov[3];
+	iov[0].iov_base = msglen_str;
+	iov[0].iov_len = strlen(msglen_str);
+	iov[1].iov_base = packed ? packed : (char *) msg;
+	iov[1].iov_len = packed ? OTPPACK_LEN(msglen) : msglen;
+	struct msghdr mh;
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = iov;
+	mh.msg_iovlen = 2;
+	char trailer[OTP_CRCLEN + 1];
+	if (fl & FD_CRC)
+	{
+		sprintf(trailer, "%08x", otpcrc32c(0, msg, msglen));
+		iov[2].iov_base = trailer;
+		iov[2].iov_len = OTP_CRCLEN;
+		mh.msg_iovlen = 3;
+	}
 	
 	// loop to send
-	int sent_total = 0;
-	int sent = 0;
-	while (sent_total < tosend)
+	long sent_total = 0;
+	ssize_t sent = 0;
+	while (mh.msg_iovlen > 0)
 	{
-		sent = send(sockfd, str + sent_total, tosend, 0);
+		if (otp_wait(sockfd, POLLOUT, NULL, 0) == -1)
+		{
+			perror("Error: send()");
+			otpbuf_free(packed);
+			return -1;
+		}
+		sent = sendmsg(sockfd, &mh, MSG_NOSIGNAL | flags);
 		if (sent == -1)
 		{
+			if (errno == EINTR)
+				continue;
 			perror("Error: send()");
+			otpbuf_free(packed);
 			return -1;
 		}
 		else if (sent == 0)
 		{
 			fprintf(stderr, "Connection closed: incomplete send().\n");
+			otpbuf_free(packed);
 			return -1;
 		}
 		else
 		{
-			// loop until bytes leave buffer
-			int bytes_left = -5;
-			do
+			// update variables, skipping fully sent pieces
+			sent_total = sent_total + sent;
+			while (mh.msg_iovlen > 0 && (size_t) sent >= mh.msg_iov[0].iov_len)
 			{
-			  ioctl(sockfd, TIOCOUTQ, &bytes_left); 
-			} while (bytes_left > 0);
+				sent = sent - mh.msg_iov[0].iov_len;
+				mh.msg_iov++;
+				mh.msg_iovlen--;
+			}
+			if (mh.msg_iovlen > 0)
+			{
+				mh.msg_iov[0].iov_base = (char *) mh.msg_iov[0].iov_base + sent;
+				mh.msg_iov[0].iov_len = mh.msg_iov[0].iov_len - sent;
+			}
+		}
+	}
+	
+	otpbuf_free(packed);
+	
+	// optionally wait until bytes leave buffer
+	if (sockopts.drain)
+		otp_drain(sockfd);
+	
+	return sent_total;
+}
 
-			if (bytes_left < 0)
-			  error("ioctl error");
 
-			// update variables
-			sent_total = sent_total + sent;
-			tosend = tosend - sent;
+/* NAME
+ *  otp_drain
+ * SYNOPSYS 
+ * 	waits until the peer has acknowledged everything sent on sockfd,
+ *  or the connection is gone
+ */
+static void otp_drain(int sockfd)
+{
+	int bytes_left = -5;
+	struct tcp_info ti;
+	socklen_t tilen = sizeof(ti);
+	while (ioctl(sockfd, TIOCOUTQ, &bytes_left) == 0 && bytes_left > 0)
+	{
+		// unacknowledged bytes never drain once the peer has reset
+		if (getsockopt(sockfd, IPPROTO_TCP, TCP_INFO, &ti, &tilen) == 0 && ti.tcpi_state == TCP_CLOSE)
+			break;
+		sched_yield();
+	}
+}
+
+
+/* NAME
+ *  otp_setsockopts
+ * SYNOPSYS 
+ * 	sets socket options for later sockets from a comma separated list
+ *  of name[=value], value defaulting to 1: nodelay, more, quickack,
+ *  sndbuf, rcvbuf, drain, crc, pack
+ *  returns 0, or -1 on an unknown name
+ */
+int otp_setsockopts(const char *spec)
+{
+	char *copy = strdup(spec);
+	char *save = NULL;
+	char *word;
+	int status = 0;
+	
+	for (word = strtok_r(copy, ",", &save); word; word = strtok_r(NULL, ",", &save))
+	{
+		char *eq = strchr(word, '=');
+		int value = 1;
+		if (eq)
+		{
+			*eq = '\0';
+			value = atoi(eq + 1);
 		}
+		
+		if (strcmp(word, "nodelay") == 0)
+			sockopts.nodelay = value;
+		else if (strcmp(word, "more") == 0)
+			sockopts.more = value;
+		else if (strcmp(word, "quickack") == 0)
+			sockopts.quickack = value;
+		else if (strcmp(word, "sndbuf") == 0)
+			sockopts.sndbuf = value;
+		else if (strcmp(word, "rcvbuf") == 0)
+			sockopts.rcvbuf = value;
+		else if (strcmp(word, "drain") == 0)
+			sockopts.drain = value;
+		else if (strcmp(word, "crc") == 0)
+			sockopts.crc = value;
+		else if (strcmp(word, "pack") == 0)
+			sockopts.pack = value;
+		else
+			status = -1;
 	}
 	
-	free(str);
-	return sent_total;
+	free(copy);
+	return status;
+}
+
+
+/* NAME
+ *  otp_applysockopts
+ * SYNOPSYS 
+ * 	applies socket options to sockfd; failures are not fatal, the
+ *  system defaults stay in place
+ */
+void otp_applysockopts(int sockfd)
+{
+	int one = 1;
+	if (sockopts.nodelay)
+		setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (sockopts.sndbuf > 0)
+		setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &sockopts.sndbuf, sizeof(int));
+	if (sockopts.rcvbuf > 0)
+		setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &sockopts.rcvbuf, sizeof(int));
+}
+
+
+/* NAME
+ *  otp_setlimits
+ * SYNOPSYS 
+ * 	makes otp_recv and otp_sendn give up, with errno ETIMEDOUT, when
+ *  l->timerfd fires or a message body falls behind l->minrate, and
+ *  otp_recv refuse messages over l->maxlen; NULL turns limits off
+ */
+void otp_setlimits(otp_limits *l)
+{
+	limits = l;
+}
+
+
+/* NAME
+ *  otp_wantcrc
+ * SYNOPSYS 
+ * 	TRUE if the crc socket option asks clients to negotiate trailers
+ */
+bool otp_wantcrc()
+{
+	return sockopts.crc ? TRUE : FALSE;
+}
+
+
+/* NAME
+ *  otp_setcrc
+ * SYNOPSYS 
+ * 	turns CRC32C trailers on or off for every later message sent or
+ *  received on sockfd: "<msg length> <msg><crc>", crc OTP_CRCLEN hex
+ *  digits; both ends must agree, which the handshake settles
+ *  returns 0, or -1 if sockfd cannot carry trailers
+ */
+int otp_setcrc(int sockfd, bool on)
+{
+	return otp_setflag(sockfd, FD_CRC, on);
+}
+
+
+/* NAME
+ *  otp_wantpack
+ * SYNOPSYS 
+ * 	TRUE if the pack socket option asks clients to negotiate packing
+ */
+bool otp_wantpack()
+{
+	return sockopts.pack ? TRUE : FALSE;
+}
+
+
+/* NAME
+ *  otp_setpack
+ * SYNOPSYS 
+ * 	turns base 27 packing (otppack.h) on or off for every later message
+ *  sent or received on sockfd; a packed message is "<msg length>:" and
+ *  the packed characters, any other keeps "<msg length> ", so each
+ *  message may go either way; both ends must agree, which the
+ *  handshake settles
+ *  returns 0, or -1 if sockfd cannot carry packing
+ */
+int otp_setpack(int sockfd, bool on)
+{
+	if (!on)
+		otp_setflag(sockfd, FD_PACKED, FALSE);
+	return otp_setflag(sockfd, FD_PACK, on);
+}
+
+
+/* NAME
+ *  otp_setflag
+ * SYNOPSYS 
+ * 	sets or clears one FD_ flag of sockfd
+ *  returns 0, or -1 if sockfd is past the flag table
+ */
+static int otp_setflag(int sockfd, unsigned char flag, bool on)
+{
+	if (sockfd < 0 || sockfd >= OTP_FDFLAGS)
+		return on ? -1 : 0;
+	if (on)
+		fdflags[sockfd] |= flag;
+	else
+		fdflags[sockfd] &= ~flag;
+	return 0;
+}
+
+
+/* NAME
+ *  otp_wait
+ * SYNOPSYS 
+ * 	waits until sockfd is ready for events, unless limits say to give
+ *  up first; start (NULL for none) is when a body began arriving and
+ *  done how much of it has
+ *  returns 0 when ready or -1 (errno ETIMEDOUT)
+ */
+static int otp_wait(int sockfd, short events, const struct timespec *start, size_t done)
+{
+	if (!limits)
+		return 0;
+	
+	struct pollfd pfd[2];
+	pfd[0].fd = sockfd;
+	pfd[0].events = events;
+	pfd[1].fd = limits->timerfd;		// ignored by poll if -1
+	pfd[1].events = POLLIN;
+	
+	while (1)
+	{
+		// body must average minrate after a short grace period
+		int timeout = -1;
+		if (start && limits->minrate > 0)
+		{
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			double elapsed = (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+			double allowed = OTP_RATEGRACE + (double) done / limits->minrate;
+			if (elapsed >= allowed)
+			{
+				errno = ETIMEDOUT;
+				return -1;
+			}
+			timeout = (int) ((allowed - elapsed) * 1000) + 1;
+		}
+		
+		int n = poll(pfd, 2, timeout);
+		if (n == -1 && errno != EINTR)
+			return -1;
+		if (n > 0 && (pfd[1].revents & POLLIN))
+		{
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		if (n > 0)
+			return 0;
+	}
 }
 
 
@@ -189,60 +580,183 @@ int otp_send(int sockfd, char *msg)
  *  otp_recv
  * SYNOPSYS 
  * 	receives string from file descriptor in format "<msg length> <msg>"
- *  returns <msg> as dynamically allocated string
+ *  returns <msg> as string from otpbuf_alloc, release with otpbuf_free
  */
 char * otp_recv(int sockfd)
 {
-	int numbytes = -5;
-	char strlen_buf[11];
-	int strlen_rcvd = 0;
+	long length = otp_recvlen(sockfd);
+	if (length < 0)
+		return NULL;
+	if (limits && limits->maxlen > 0 && (size_t) length > limits->maxlen)
+	{
+		fprintf(stderr, "Error: %ld character message over the %zu limit\n", length, limits->maxlen);
+		return NULL;
+	}
+	return otp_recvbody(sockfd, length);
+}
+
+
+/* NAME
+ *  otp_recvlen
+ * SYNOPSYS 
+ * 	receives the "<msg length> " header of a message, so the caller
+ *  can decide what to do before the body arrives; on a socket that
+ *  packs, "<msg length>:" marks the body packed for otp_recvpart
+ *  returns length, or -1 on error, a malformed header, or if the
+ *  connection closed
+ */
+long otp_recvlen(int sockfd)
+{
+	ssize_t numbytes = -5;
+	char strlen_buf[24];
+	size_t strlen_rcvd = 0;
+	bool pack = (sockfd >= 0 && sockfd < OTP_FDFLAGS && (fdflags[sockfd] & FD_PACK)) ? TRUE : FALSE;
 	
 	memset(strlen_buf, '\0', sizeof(strlen_buf));
 	
 	// loop to recv prepended msg length single char at a time
-	while (strlen_rcvd == 0 || strlen_buf[strlen_rcvd - 1] != ' ')
+	while (strlen_rcvd == 0 || !(strlen_buf[strlen_rcvd - 1] == ' '
+			|| (pack && strlen_buf[strlen_rcvd - 1] == ':')))
 	{
+		if (strlen_rcvd == sizeof(strlen_buf) - 1)
+		{
+			fprintf(stderr, "Error: recv() msg length too long\n");
+			return -1;
+		}
+		
 		// printf("Starting recv loop %d\n", loopnum);
+		if (otp_wait(sockfd, POLLIN, NULL, 0) == -1)
+		{
+			perror("Error: recv() msg length");
+			return -1;
+		}
 		numbytes = recv(sockfd, strlen_buf + strlen_rcvd, 1, 0);
 		if (numbytes == -1)
 		{
 			perror("Error: recv() msg length");
-			return NULL;
+			return -1;
 		}
 		// check connection closed
 		else if (numbytes == 0)
 		{
-			return NULL;
+			return -1;
 		}
 		
 		strlen_rcvd = strlen_rcvd + numbytes;
 		strlen_buf[strlen_rcvd] = '\0';
 	}
 	
-	// remove trailing space, convert length to int value, allocate memory
+	// remove trailing space, convert length to int value; anything but
+	// digits, or a length past LONG_MAX, is a broken or hostile peer
+	if (pack)
+		otp_setflag(sockfd, FD_PACKED, strlen_buf[strlen_rcvd - 1] == ':');
 	strlen_buf[strlen_rcvd - 1] = '\0';
-	int length = strtol(strlen_buf, NULL, 10);
-	char *str = (char *) calloc(length + 1, sizeof(char));
+	char *end;
+	errno = 0;
+	long length = strtol(strlen_buf, &end, 10);
+	if (!isdigit(strlen_buf[0]) || *end != '\0' || errno == ERANGE)
+	{
+		fprintf(stderr, "Error: recv() bad msg length \"%.8s\"\n", strlen_buf);
+		return -1;
+	}
+	return length;
+}
+
+
+/* NAME
+ *  otp_recvbody
+ * SYNOPSYS 
+ * 	receives the length characters following otp_recvlen
+ *  returns them as string from otpbuf_alloc, release with otpbuf_free
+ */
+char * otp_recvbody(int sockfd, size_t length)
+{
+	return otp_recvpart(sockfd, length, length);
+}
+
+
+/* NAME
+ *  otp_recvpart
+ * SYNOPSYS 
+ * 	receives the length characters following otp_recvlen, keeping only
+ *  the first keep of them, so the rest never needs memory; on a socket
+ *  carrying trailers, checks them all against the CRC32C that follows
+ *  returns them as string from otpbuf_alloc, release with otpbuf_free,
+ *  or NULL, with errno ENOMEM if there was no memory for them
+ */
+char * otp_recvpart(int sockfd, size_t length, size_t keep)
+{
+	ssize_t numbytes = -5;
+	size_t strlen_rcvd = 0;
+	char discard[4096];
+	unsigned char fl = (sockfd >= 0 && sockfd < OTP_FDFLAGS) ? fdflags[sockfd] : 0;
+	bool check = (fl & FD_CRC) ? TRUE : FALSE;
+	uint32_t crc = 0;
+	
+	if (keep > length)
+		keep = length;
+	if (fl & FD_PACKED)
+	{
+		otp_setflag(sockfd, FD_PACKED, FALSE);
+		return otp_recvpacked(sockfd, length, keep, check);
+	}
 	
-	strlen_rcvd = 0;
+	// allocate memory
+	char *str = otpbuf_alloc(keep);
+	if (!str)
+	{
+		fprintf(stderr, "Error: out of memory for %zu byte message\n", keep);
+		errno = ENOMEM;
+		return NULL;
+	}
+	
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	while (strlen_rcvd < length)
 	{
-		numbytes = recv(sockfd, str + strlen_rcvd, length - strlen_rcvd, 0);
+		if (otp_wait(sockfd, POLLIN, &start, strlen_rcvd) == -1)
+		{
+			perror("Error: recv() message");
+			otpbuf_free(str);
+			return NULL;
+		}
+		if (strlen_rcvd < keep)
+			numbytes = recv(sockfd, str + strlen_rcvd, keep - strlen_rcvd, 0);
+		else
+			numbytes = recv(sockfd, discard, (length - strlen_rcvd < sizeof(discard)) ?
+				length - strlen_rcvd : sizeof(discard), 0);
 		// check failed
 		if (numbytes == -1)
 		{
 			perror("Error: recv() message");
+			otpbuf_free(str);
 			return NULL;
 		}
 		// check connection closed
 		else if (numbytes == 0)
 		{
-			printf("Connection closed by server.\n");
+			fprintf(stderr, "Connection closed by server.\n");
+			otpbuf_free(str);
 			return NULL;
 		}
-			
+		
+		// checksum each piece as it lands, while it is in cache
+		if (check)
+			crc = otpcrc32c(crc, (strlen_rcvd < keep) ? str + strlen_rcvd : discard, numbytes);
 		strlen_rcvd = strlen_rcvd + numbytes;
-		str[strlen_rcvd] = '\0';
+	}
+	str[keep] = '\0';
+	if (check && otp_recvcrc(sockfd, crc) == -1)
+	{
+		otpbuf_free(str);
+		return NULL;
+	}
+	
+	// ack at once rather than waiting to piggyback on the reply
+	if (sockopts.quickack)
+	{
+		int one = 1;
+		setsockopt(sockfd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
 	}
 		
 	// successful receive
@@ -250,6 +764,238 @@ char * otp_recv(int sockfd)
 }
 
 
+/* NAME
+ *  otp_recvpacked
+ * SYNOPSYS 
+ * 	otp_recvpart for a packed body: receives OTPPACK_LEN(length) bytes
+ *  a chunk at a time and unpacks each chunk's whole groups straight
+ *  into the message, or into a scratch buffer once past keep, so the
+ *  trailer's CRC32C covers the characters, not the packed bytes
+ *  returns the characters as string from otpbuf_alloc, or NULL
+ */
+static char * otp_recvpacked(int sockfd, size_t length, size_t keep, bool check)
+{
+	unsigned char chunk[PACKCHUNK * OTPPACK_BYTES];
+	char scratch[PACKCHUNK * OTPPACK_GROUP];
+	size_t packedlen = OTPPACK_LEN(length);
+	size_t bytes_rcvd = 0;
+	size_t have = 0;						// bytes in chunk, not yet unpacked
+	size_t done = 0;						// characters unpacked
+	uint32_t crc = 0;
+	
+	// the group that crosses keep spills up to a group past it
+	char *str = otpbuf_alloc(keep + OTPPACK_GROUP);
+	if (!str)
+	{
+		fprintf(stderr, "Error: out of memory for %zu byte message\n", keep);
+		errno = ENOMEM;
+		return NULL;
+	}
+	
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (bytes_rcvd < packedlen)
+	{
+		if (otp_wait(sockfd, POLLIN, &start, bytes_rcvd) == -1)
+		{
+			perror("Error: recv() message");
+			otpbuf_free(str);
+			return NULL;
+		}
+		size_t want = sizeof(chunk) - have;
+		if (want > packedlen - bytes_rcvd)
+			want = packedlen - bytes_rcvd;
+		ssize_t numbytes = recv(sockfd, chunk + have, want, 0);
+		if (numbytes == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("Error: recv() message");
+			otpbuf_free(str);
+			return NULL;
+		}
+		else if (numbytes == 0)
+		{
+			fprintf(stderr, "Connection closed by server.\n");
+			otpbuf_free(str);
+			return NULL;
+		}
+		bytes_rcvd = bytes_rcvd + numbytes;
+		have = have + numbytes;
+		
+		// unpack whole groups: into the message while they start before
+		// keep, the rest into scratch only if the trailer needs them
+		size_t groups = have / OTPPACK_BYTES;
+		size_t into = 0;
+		if (done < keep)
+		{
+			into = (keep - done + OTPPACK_GROUP - 1) / OTPPACK_GROUP;
+			if (into > groups)
+				into = groups;
+		}
+		int bad = 0;
+		if (into > 0)
+		{
+			bad |= otpunpack(chunk, into, str + done);
+			size_t n = into * OTPPACK_GROUP;
+			if (n > length - done)
+				n = length - done;
+			if (check)
+				crc = otpcrc32c(crc, str + done, n);
+			done = done + n;
+		}
+		if (groups > into && check)
+		{
+			bad |= otpunpack(chunk + into * OTPPACK_BYTES, groups - into, scratch);
+			size_t n = (groups - into) * OTPPACK_GROUP;
+			if (n > length - done)
+				n = length - done;
+			crc = otpcrc32c(crc, scratch, n);
+		}
+		if (bad)
+		{
+			fprintf(stderr, "Error: recv() bad packed message\n");
+			errno = EBADMSG;
+			otpbuf_free(str);
+			return NULL;
+		}
+		if (groups > into)
+			done = (done + (groups - into) * OTPPACK_GROUP < length) ?
+				done + (groups - into) * OTPPACK_GROUP : length;
+		
+		// keep a partial group for the next recv
+		memmove(chunk, chunk + groups * OTPPACK_BYTES, have - groups * OTPPACK_BYTES);
+		have = have - groups * OTPPACK_BYTES;
+	}
+	str[keep] = '\0';
+	if (check && otp_recvcrc(sockfd, crc) == -1)
+	{
+		otpbuf_free(str);
+		return NULL;
+	}
+	
+	if (sockopts.quickack)
+	{
+		int one = 1;
+		setsockopt(sockfd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+	}
+	return str;
+}
+
+
+/* NAME
+ *  otp_recvcrc
+ * SYNOPSYS 
+ * 	receives a message's trailer and compares it with crc, the CRC32C
+ *  of what arrived
+ *  returns 0, or -1 (error, errno EBADMSG on a mismatch)
+ */
+static int otp_recvcrc(int sockfd, uint32_t crc)
+{
+	char trailer[OTP_CRCLEN + 1];
+	size_t got = 0;
+	while (got < OTP_CRCLEN)
+	{
+		if (otp_wait(sockfd, POLLIN, NULL, 0) == -1)
+		{
+			perror("Error: recv() trailer");
+			return -1;
+		}
+		ssize_t n = recv(sockfd, trailer + got, OTP_CRCLEN - got, 0);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			fprintf(stderr, "Error: recv() trailer, connection closed\n");
+			return -1;
+		}
+		got = got + n;
+	}
+	trailer[OTP_CRCLEN] = '\0';
+	
+	char expect[OTP_CRCLEN + 1];
+	sprintf(expect, "%08x", crc);
+	if (strcmp(trailer, expect) != 0)
+	{
+		fprintf(stderr, "Error: recv() message fails its CRC32C (%.8s, expected %s)\n", trailer, expect);
+		errno = EBADMSG;
+		return -1;
+	}
+	return 0;
+}
+
+
+/* NAME
+ *  otp_sendfds
+ * SYNOPSYS 
+ * 	passes n file descriptors over unix socket sockfd (SCM_RIGHTS)
+ *  returns 0 or -1 (error)
+ */
+int otp_sendfds(int sockfd, const int *fds, int n)
+{
+	char byte = 'F';
+	struct iovec iov = {&byte, 1};
+	char cbuf[CMSG_SPACE(OTP_MAXFDS * sizeof(int))];
+	memset(cbuf, 0, sizeof(cbuf));
+	struct msghdr mh;
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cbuf;
+	mh.msg_controllen = CMSG_SPACE(n * sizeof(int));
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(n * sizeof(int));
+	memcpy(CMSG_DATA(cm), fds, n * sizeof(int));
+
+	return (sendmsg(sockfd, &mh, MSG_NOSIGNAL) == 1) ? 0 : -1;
+}
+
+
+/* NAME
+ *  otp_recvfds
+ * SYNOPSYS 
+ * 	receives exactly n file descriptors from unix socket sockfd
+ *  returns 0 or -1 (error, none kept)
+ */
+int otp_recvfds(int sockfd, int *fds, int n)
+{
+	char byte;
+	struct iovec iov = {&byte, 1};
+	char cbuf[CMSG_SPACE(OTP_MAXFDS * sizeof(int))];
+	struct msghdr mh;
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cbuf;
+	mh.msg_controllen = sizeof(cbuf);
+
+	if (recvmsg(sockfd, &mh, MSG_CMSG_CLOEXEC) != 1)
+		return -1;
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+	if (!cm || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+		return -1;
+
+	// close whatever arrived if it is not what was asked for
+	int got = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+	int i;
+	memcpy(fds, CMSG_DATA(cm), ((got < n) ? got : n) * sizeof(int));
+	if (got != n || (mh.msg_flags & MSG_CTRUNC))
+	{
+		int *all = (int *) CMSG_DATA(cm);
+		for (i = 0; i < got; i++)
+		{
+			int fd;
+			memcpy(&fd, all + i, sizeof(int));
+			close(fd);
+		}
+		return -1;
+	}
+	return 0;
+}
+
+
 /* NAME
  *  hasValidChars
  * SYNOPSYS 
@@ -259,9 +1005,21 @@ bool hasValidChars(char *str)
 {
 	if (str == NULL)
 		return FALSE;
-	int length = strlen(str);
-	int i;
-	for (i = 0; i < length; i++)
+	return hasValidCharsn(str, strlen(str));
+}
+
+
+/* NAME
+ *  hasValidCharsn
+ * SYNOPSYS 
+ * 	checks first len characters of buffer are ASCII A to Z or space
+ */
+bool hasValidCharsn(const char *str, size_t len)
+{
+	if (str == NULL)
+		return FALSE;
+	size_t i;
+	for (i = 0; i < len; i++)
 	{
 		int c = str[i];
 		// check that the char is A-Z or space
@@ -276,17 +1034,14 @@ bool hasValidChars(char *str)
 /* NAME
  *  f_tostring
  * SYNOPSYS 
- * 	reads from file and stores in dynamically allocated string
+ * 	reads from file and stores in string from otpbuf_alloc,
+ *  sized from the file up front; release with otpbuf_free
  */
 char * f_tostring(char *filename)
 {
-	int bin = -5;				// bytes read in to buffer each loop
-	int totalread = 0;			// total read so far
-	int msglen = 4096;			// length of dynamically allocated, resizing string
-	char *msg = (char *) calloc(msglen, sizeof(char));
-	msg[0] = '\0';				// msg must be null-terminated to perform string lib functions
-	char buff[msglen];			// buffer to hold read contents each loop
-	memset(buff, '\0', sizeof(buff));
+	ssize_t bin = -5;			// bytes read in to buffer each loop
+	size_t totalread = 0;		// total read so far
+	size_t msglen = 4096;		// capacity of string, grows for pipes
 	
 	// open file, set file pointer to start
 	int fd = open(filename, O_RDONLY);
@@ -297,33 +1052,178 @@ char * f_tostring(char *filename)
 	}
 	lseek(fd, 0, SEEK_SET);
 	
+	// regular files are read straight into a buffer of their size,
+	// plus one byte so end of file is seen without growing
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+		msglen = st.st_size + 1;
+	char *msg = otpbuf_alloc(msglen);
+	if (!msg)
+	{
+		fprintf(stderr, "Error: out of memory reading %s.\n", filename);
+		close(fd);
+		return NULL;
+	}
+	
 	// loop to read from file
-	while ((bin = read(fd, buff, sizeof(buff) - 1)) > 0)
+	while (1)
 	{	
+		// resize msg string by doubling
+		if (totalread == msglen)
+		{
+			msglen = msglen * 2;
+			char *bigger = otpbuf_grow(msg, msglen);
+			if (!bigger)
+			{
+				fprintf(stderr, "Error: out of memory reading %s.\n", filename);
+				otpbuf_free(msg);
+				close(fd);
+				return NULL;
+			}
+			msg = bigger;
+		}
+		
+		bin = read(fd, msg + totalread, msglen - totalread);
+		if (bin == 0)
+			break;
 		if (bin == -1)
 		{
+			if (errno == EINTR)
+				continue;
 			fprintf(stderr, "Error: read()\n");
+			otpbuf_free(msg);
+			close(fd);
 			return NULL;
 		}
-		buff[bin] = '\0';
 		totalread = totalread + bin;
-		
-		// resize msg string by doubling
-		if (totalread >= msglen)
+	}
+	close(fd);
+	msg[totalread] = '\0';
+	
+	// strip off last newline
+	if (totalread > 0 && msg[totalread - 1] == '\n')
+		msg[totalread - 1] = '\0';
+	
+	return msg;
+}
+
+
+/* NAME
+ *  f_tostringn
+ * SYNOPSYS 
+ * 	reads at most len bytes starting at offset from file into string
+ *  from otpbuf_alloc, so only the part of a large file that is needed
+ *  is read; shorter if the file ends first; release with otpbuf_free
+ */
+char * f_tostringn(char *filename, size_t offset, size_t len)
+{
+	ssize_t bin = -5;			// bytes read in to buffer each loop
+	size_t totalread = 0;		// total read so far
+	
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1) 
+	{
+		fprintf(stderr, "File Not Found: %s.\n", filename);
+		return NULL;
+	}
+	
+	char *msg = otpbuf_alloc(len);
+	if (!msg)
+	{
+		fprintf(stderr, "Error: out of memory reading %s.\n", filename);
+		close(fd);
+		return NULL;
+	}
+	
+	// loop to read window from file
+	while (totalread < len)
+	{
+		bin = pread(fd, msg + totalread, len - totalread, offset + totalread);
+		if (bin == 0)
+			break;
+		if (bin == -1)
 		{
-			msglen = msglen * 2;
-			msg = (char *)realloc(msg, msglen);
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Error: read()\n");
+			otpbuf_free(msg);
+			close(fd);
+			return NULL;
 		}
-		
-		// append newly read characters
-		strcat(msg, buff);
-		
-		memset(buff, '\0', sizeof(buff));
+		totalread = totalread + bin;
 	}
+	close(fd);
+	msg[totalread] = '\0';
 	
-	// strip off last newline
-	if (msg[totalread - 1] == '\n')
+	// strip off last newline, if the window reached it
+	if (totalread > 0 && msg[totalread - 1] == '\n')
 		msg[totalread - 1] = '\0';
 	
 	return msg;
 }
+
+
+/* NAME
+ *  ledger_open
+ * SYNOPSYS 
+ * 	opens and locks offset ledger file, creating it if needed, and
+ *  reads the next unused key offset (0 if empty); the lock is held
+ *  until ledger_close so concurrent clients never share key
+ *  returns file descriptor or -1 (error)
+ */
+int ledger_open(char *filename, size_t *offset)
+{
+	int fd = open(filename, O_RDWR | O_CREAT, 0600);
+	if (fd == -1)
+	{
+		fprintf(stderr, "Error: Unable to open ledger %s.\n", filename);
+		return -1;
+	}
+	if (flock(fd, LOCK_EX) == -1)
+	{
+		perror("Error: flock()");
+		close(fd);
+		return -1;
+	}
+	
+	char buf[24];
+	memset(buf, '\0', sizeof(buf));
+	if (pread(fd, buf, sizeof(buf) - 1, 0) == -1)
+	{
+		perror("Error: read() ledger");
+		close(fd);
+		return -1;
+	}
+	
+	char *end;
+	*offset = strtoull(buf, &end, 10);
+	if (end == buf && buf[0] != '\0')
+	{
+		fprintf(stderr, "Error: Invalid ledger %s.\n", filename);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+
+/* NAME
+ *  ledger_close
+ * SYNOPSYS 
+ * 	records offset as the next unused key offset, then unlocks and
+ *  closes ledger (to give up without recording, just close fd)
+ *  returns 0 or -1 (error)
+ */
+int ledger_close(int fd, size_t offset)
+{
+	int status = 0;
+	char buf[24];
+	int n = sprintf(buf, "%zu\n", offset);
+	if (pwrite(fd, buf, n, 0) != n || ftruncate(fd, n) == -1 || fsync(fd) == -1)
+	{
+		perror("Error: write() ledger");
+		status = -1;
+	}
+	close(fd);
+	return status;
+}
@@ -23,23 +23,78 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/file.h>
 #include <sys/ioctl.h>
 #include <sys/types.h> 
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/tcp.h>
+#include "otpbuf.h"
+
+
+/* MACROS */
+#define OTP_RATEGRACE 2					// seconds before the minimum rate applies
+#define OTP_MAXFDS 4					// most file descriptors passed at once
+#define OTP_BATCH '#'					// first character of a batch request
+#define OTP_REFUSED '!'					// first character of a refusal reply
+#define OTP_RSIZE "!SIZE"				// refusal: request over the daemon's -X
+#define OTP_RBUSY "!BUSY"				// refusal: no memory or large request slot in time
+#define OTP_RRATE "!RATE"				// refusal: client over its rate or connection limit
+#define OTP_RREUSE "!REUSE"				// refusal: key used before, under -P reject
+#define OTP_CRCID " crc"				// appended to the handshake id for CRC trailers
+#define OTP_CRCLEN 8					// trailer: CRC32C of the message, hex
+#define OTP_PACKID " pack"				// appended to the handshake id for base 27 packing
+#define OTP_FDFLAGS 65536				// sockets that can carry trailers or packing: fds below this
 
 
 /* STRUCTS AND ENUMS */
 typedef enum bool {FALSE, TRUE} bool;
 typedef enum socktype {CONNECT, BIND} socktype;
 
+// limits on otp_recv / otp_sendn, see otp_setlimits
+typedef struct otp_limits {
+	int timerfd;						// fires at the caller's deadline, -1 for none
+	long minrate;						// bytes/second a message body must keep up, 0 for none
+	size_t maxlen;						// longest message otp_recv takes, 0 for any
+} otp_limits;
+
+// socket tuning, see otp_setsockopts; defaults measured with otp_bench net
+typedef struct otp_sockopts {
+	int nodelay;						// TCP_NODELAY: no Nagle delay on small messages
+	int more;							// MSG_MORE: batch a request's messages into full segments
+	int quickack;						// TCP_QUICKACK after each message received
+	int sndbuf;							// SO_SNDBUF bytes, 0 for system default
+	int rcvbuf;							// SO_RCVBUF bytes, 0 for system default
+	int drain;							// wait for each send to leave the socket queue
+	int crc;							// ask for CRC32C trailers, see otp_setcrc
+	int pack;							// ask for base 27 packing, see otp_setpack
+} otp_sockopts;
+
 
 /* FUNCTION DECLARATIONS */
 bool isValidPort(int p);
 int initialize(char *host, char *port, socktype st);
-void checkBg(int arr[], int *num);
-int otp_send(int sockfd, char *msg);
+int otp_setsockopts(const char *spec);
+void otp_applysockopts(int sockfd);
+void otp_setlimits(otp_limits *l);
+bool otp_wantcrc();
+int otp_setcrc(int sockfd, bool on);
+bool otp_wantpack();
+int otp_setpack(int sockfd, bool on);
+long otp_send(int sockfd, char *msg);
+long otp_sendn(int sockfd, const char *msg, size_t msglen);
+long otp_sendn_more(int sockfd, const char *msg, size_t msglen);
 char * otp_recv(int sockfd);
+long otp_recvlen(int sockfd);
+char * otp_recvbody(int sockfd, size_t length);
+char * otp_recvpart(int sockfd, size_t length, size_t keep);
+int otp_sendfds(int sockfd, const int *fds, int n);
+int otp_recvfds(int sockfd, int *fds, int n);
 bool hasValidChars(char *str);
+bool hasValidCharsn(const char *str, size_t len);
 char * f_tostring(char *filename);
+char * f_tostringn(char *filename, size_t offset, size_t len);
+int ledger_open(char *filename, size_t *offset);
+int ledger_close(int fd, size_t offset);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,357 @@
+/*
+ * otppack.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * base 27 packing
+ *
+ * a group is the base 27 number of its five characters, most
+ * significant first, in three bytes, big endian. On x86-64 processors
+ * with SSE4.1 four groups are done per step: packing maps twenty
+ * characters to values at once and sums them with multiply-adds,
+ * unpacking splits each group with one float division by 27^2 and the
+ * rest with multiplies by the reciprocal of 27. Elsewhere, and for
+ * the last few groups, packing looks each character up once and
+ * unpacking copies a group's first three and last two characters from
+ * tables. Which one is chosen, and the tables built, once, on first
+ * use.
+ */
+
+
+/* LIBRARIES */
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <smmintrin.h>
+#endif
+#include "otppack.h"
+
+
+/* MACROS */
+#define BAD 0xff						// value of a character outside the alphabet
+#define TRI (27 * 27 * 27)				// three character values
+#define DUO (27 * 27)					// two character values
+#define GROUPS (TRI * DUO)				// five character values, 27^5
+
+
+/* GLOBAL VARIABLES */
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ";
+static uint8_t value[256];				// character to 0 to 26, or BAD
+static char tri[TRI][4];				// three characters of a value < 27^3
+static char duo[DUO][2];				// two characters of a value < 27^2
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static int vector = 0;					// SSE4.1 available
+
+
+/* FUNCTION DECLARATIONS */
+static void maketables();
+static unsigned packsoft(const unsigned char *p, size_t n, unsigned char *out);
+static uint32_t unpacksoft(const unsigned char *in, size_t groups, char *out);
+#if defined(__x86_64__)
+static size_t packvec(const unsigned char *p, size_t groups, unsigned char *out, int *bad);
+static size_t unpackvec(const unsigned char *in, size_t groups, char *out, int *bad);
+#endif
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  maketables
+ * SYNOPSYS
+ * 	fills the character values and the three and two character tables;
+ *  also checks for SSE4.1
+ */
+static void maketables()
+{
+#if defined(__x86_64__)
+	vector = __builtin_cpu_supports("sse4.1");
+#endif
+	int i;
+	memset(value, BAD, sizeof(value));
+	for (i = 0; i < 27; i++)
+		value[(unsigned char) alphabet[i]] = i;
+	for (i = 0; i < TRI; i++) {
+		tri[i][0] = alphabet[i / DUO];
+		tri[i][1] = alphabet[i / 27 % 27];
+		tri[i][2] = alphabet[i % 27];
+	}
+	for (i = 0; i < DUO; i++) {
+		duo[i][0] = alphabet[i / 27];
+		duo[i][1] = alphabet[i % 27];
+	}
+}
+
+
+/* NAME
+ *  otppack
+ * SYNOPSYS
+ * 	packs the n characters at in into OTPPACK_LEN(n) bytes at out
+ *  returns 0, or -1 if a character is outside the alphabet
+ */
+int otppack(const char *in, size_t n, unsigned char *out)
+{
+	pthread_once(&once, maketables);
+	const unsigned char *p = (const unsigned char *) in;
+	int bad = 0;
+#if defined(__x86_64__)
+	if (vector) {
+		size_t done = packvec(p, n / OTPPACK_GROUP, out, &bad);
+		p += done * OTPPACK_GROUP;
+		out += done * OTPPACK_BYTES;
+		n -= done * OTPPACK_GROUP;
+	}
+#endif
+	return (bad || packsoft(p, n, out)) ? -1 : 0;
+}
+
+
+/* NAME
+ *  otpunpack
+ * SYNOPSYS
+ * 	unpacks groups groups of three bytes at in into five characters
+ *  each at out, including any padding of a last group
+ *  returns 0, or -1 if a group is not a base 27 number of five digits
+ */
+int otpunpack(const unsigned char *in, size_t groups, char *out)
+{
+	pthread_once(&once, maketables);
+	int bad = 0;
+#if defined(__x86_64__)
+	if (vector) {
+		size_t done = unpackvec(in, groups, out, &bad);
+		in += done * OTPPACK_BYTES;
+		out += done * OTPPACK_GROUP;
+		groups -= done;
+	}
+#endif
+	return (bad || unpacksoft(in, groups, out) >= GROUPS) ? -1 : 0;
+}
+
+
+/* NAME
+ *  otppack_sw
+ * SYNOPSYS
+ * 	otppack by table lookups only, for otp_bench to check the SSE4.1
+ *  path against
+ */
+int otppack_sw(const char *in, size_t n, unsigned char *out)
+{
+	pthread_once(&once, maketables);
+	return packsoft((const unsigned char *) in, n, out) ? -1 : 0;
+}
+
+
+/* NAME
+ *  otpunpack_sw
+ * SYNOPSYS
+ * 	otpunpack by table lookups only
+ */
+int otpunpack_sw(const unsigned char *in, size_t groups, char *out)
+{
+	pthread_once(&once, maketables);
+	return (unpacksoft(in, groups, out) >= GROUPS) ? -1 : 0;
+}
+
+
+/* NAME
+ *  otppack_vector
+ * SYNOPSYS
+ * 	1 if otppack and otpunpack use SSE4.1, 0 if tables only
+ */
+int otppack_vector()
+{
+	pthread_once(&once, maketables);
+	return vector;
+}
+
+
+/* NAME
+ *  packsoft
+ * SYNOPSYS
+ * 	packs n characters a group at a time, the last group padded with
+ *  the value 0
+ *  returns nonzero if a character is outside the alphabet
+ */
+static unsigned packsoft(const unsigned char *p, size_t n, unsigned char *out)
+{
+	unsigned bad = 0;
+	size_t whole = n / OTPPACK_GROUP;
+	size_t g;
+	for (g = 0; g < whole; g++, p += OTPPACK_GROUP, out += OTPPACK_BYTES) {
+		unsigned a = value[p[0]], b = value[p[1]], c = value[p[2]], d = value[p[3]], e = value[p[4]];
+		bad |= a | b | c | d | e;
+		uint32_t v = (((a * 27 + b) * 27 + c) * 27 + d) * 27 + e;
+		out[0] = v >> 16;
+		out[1] = v >> 8;
+		out[2] = v;
+	}
+
+	size_t rest = n - whole * OTPPACK_GROUP;
+	if (rest > 0) {
+		uint32_t v = 0;
+		size_t i;
+		for (i = 0; i < OTPPACK_GROUP; i++) {
+			unsigned x = (i < rest) ? value[p[i]] : 0;
+			bad |= x;
+			v = v * 27 + x;
+		}
+		out[0] = v >> 16;
+		out[1] = v >> 8;
+		out[2] = v;
+	}
+
+	// every value is under 32 unless a character was BAD
+	return bad & 0xe0;
+}
+
+
+/* NAME
+ *  unpacksoft
+ * SYNOPSYS
+ * 	unpacks groups a group at a time; a group's first three characters
+ *  come from tri, its last two from duo
+ *  returns the largest group, at least GROUPS if one was invalid
+ */
+static uint32_t unpacksoft(const unsigned char *in, size_t groups, char *out)
+{
+	uint32_t worst = 0;
+	size_t g;
+	for (g = 0; g < groups; g++, in += OTPPACK_BYTES, out += OTPPACK_GROUP) {
+		uint32_t v = ((uint32_t) in[0] << 16) | ((uint32_t) in[1] << 8) | in[2];
+		worst = (v > worst) ? v : worst;
+		if (v >= GROUPS)
+			v = 0;
+		uint32_t hi = v / DUO;
+		memcpy(out, tri[hi], 3);
+		memcpy(out + 3, duo[v - hi * DUO], 2);
+	}
+	return worst;
+}
+
+
+#if defined(__x86_64__)
+/* NAME
+ *  packvec
+ * SYNOPSYS
+ * 	packs four groups per step: twenty characters, loaded as two
+ *  overlapping sixteen byte halves, become values 0 to 26, are spread
+ *  to one group per eight bytes, then multiply-adds form each group's
+ *  first three and last two digits (a*27 + b, then *27 + c; d*27 + e)
+ *  and one more joins them (*729 +); a shuffle writes the twelve bytes
+ *  big endian. Loads run up to six characters past the four groups,
+ *  so it stops while at least two more groups are left
+ *  compiled for SSE4.1 whatever the rest of the build targets, and
+ *  only called when the processor has it
+ *  returns groups packed, sets *bad if a character was outside the
+ *  alphabet
+ */
+__attribute__((target("sse4.1")))
+static size_t packvec(const unsigned char *p, size_t groups, unsigned char *out, int *bad)
+{
+	const __m128i big = _mm_set1_epi8('A'), space = _mm_set1_epi8(' ');
+	const __m128i v25 = _mm_set1_epi8(25), v26 = _mm_set1_epi8(26);
+	const __m128i used = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0);
+	const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, -1, -1, 5, 6, 7, -1, 8, 9, -1, -1);
+	const __m128i w1 = _mm_setr_epi8(27, 1, 1, 0, 27, 1, 0, 0, 27, 1, 1, 0, 27, 1, 0, 0);
+	const __m128i w2 = _mm_setr_epi16(27, 1, 1, 0, 27, 1, 1, 0);
+	const __m128i w3 = _mm_setr_epi16(729, 1, 729, 1, 729, 1, 729, 1);
+	const __m128i bytes = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	__m128i wrong = _mm_setzero_si128();
+	size_t g = 0;
+
+	for (; g + 6 <= groups; g += 4, p += 4 * OTPPACK_GROUP, out += 4 * OTPPACK_BYTES) {
+		__m128i half[2];
+		int k;
+		for (k = 0; k < 2; k++) {
+			__m128i c = _mm_loadu_si128((const __m128i *) (p + 2 * OTPPACK_GROUP * k));
+			__m128i sp = _mm_cmpeq_epi8(c, space);
+			__m128i x = _mm_sub_epi8(c, big);
+			__m128i ok = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(x, v25), x), sp);
+			wrong = _mm_or_si128(wrong, _mm_andnot_si128(ok, used));
+			x = _mm_blendv_epi8(x, v26, sp);
+			x = _mm_shuffle_epi8(x, spread);
+			half[k] = _mm_madd_epi16(_mm_maddubs_epi16(x, w1), w2);
+		}
+		__m128i v = _mm_madd_epi16(_mm_packs_epi32(half[0], half[1]), w3);
+		v = _mm_shuffle_epi8(v, bytes);
+		_mm_storel_epi64((__m128i *) out, v);
+		uint32_t last = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+		memcpy(out + 8, &last, 4);
+	}
+
+	*bad = _mm_movemask_epi8(wrong) ? 1 : 0;
+	return g;
+}
+
+
+/* NAME
+ *  unpackvec
+ * SYNOPSYS
+ * 	unpacks four groups per step: each group's value v (exact in a
+ *  float) splits into q = v / 729 and r = v % 729 by a float multiply
+ *  and a correction of at most one, then q and r, as 16 bit lanes,
+ *  give up their base 27 digits through multiplies by the reciprocal
+ *  of 27 (19419 / 2^19, exact below 27^3); digits become characters
+ *  and two shuffles put each group's five in order. Loads run four
+ *  bytes past the four groups, so it stops while at least two more
+ *  groups are left
+ *  compiled for SSE4.1 whatever the rest of the build targets, and
+ *  only called when the processor has it
+ *  returns groups unpacked, sets *bad if a group was invalid
+ */
+__attribute__((target("sse4.1")))
+static size_t unpackvec(const unsigned char *in, size_t groups, char *out, int *bad)
+{
+	const __m128i be = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	const __m128i most = _mm_set1_epi32(GROUPS - 1);
+	const __m128 inv = _mm_set1_ps(1.0f / DUO);
+	const __m128i v729 = _mm_set1_epi32(DUO), v728 = _mm_set1_epi32(DUO - 1);
+	const __m128i recip = _mm_set1_epi16(19419), v27 = _mm_set1_epi16(27);
+	const __m128i big = _mm_set1_epi8('A'), space = _mm_set1_epi8(' '), v26 = _mm_set1_epi8(26);
+	const __m128i lox = _mm_setr_epi8(0, 8, -1, 12, -1, 1, 9, -1, 13, -1, 2, 10, -1, 14, -1, 3);
+	const __m128i loy = _mm_setr_epi8(-1, -1, 0, -1, 4, -1, -1, 1, -1, 5, -1, -1, 2, -1, 6, -1);
+	const __m128i hix = _mm_setr_epi8(11, -1, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i hiy = _mm_setr_epi8(-1, 3, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	__m128i wrong = _mm_setzero_si128();
+	size_t g = 0;
+
+	for (; g + 6 <= groups; g += 4, in += 4 * OTPPACK_BYTES, out += 4 * OTPPACK_GROUP) {
+		__m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) in), be);
+		wrong = _mm_or_si128(wrong, _mm_cmpgt_epi32(v, most));
+
+		// q = v / 729, r = v % 729
+		__m128i q = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(v), inv));
+		__m128i r = _mm_sub_epi32(v, _mm_mullo_epi32(q, v729));
+		__m128i under = _mm_cmplt_epi32(r, _mm_setzero_si128());
+		q = _mm_add_epi32(q, under);
+		r = _mm_add_epi32(r, _mm_and_si128(under, v729));
+		__m128i over = _mm_cmpgt_epi32(r, v728);
+		q = _mm_sub_epi32(q, over);
+		r = _mm_sub_epi32(r, _mm_and_si128(over, v729));
+
+		// lanes q0..q3 r0..r3: divided by 27 once they give c and e as
+		// remainders, twice a as quotient and b and d as remainders
+		__m128i qr = _mm_packus_epi32(q, r);
+		__m128i d1 = _mm_srli_epi16(_mm_mulhi_epu16(qr, recip), 3);
+		__m128i ce = _mm_sub_epi16(qr, _mm_mullo_epi16(d1, v27));
+		__m128i a = _mm_srli_epi16(_mm_mulhi_epu16(d1, recip), 3);
+		__m128i bd = _mm_sub_epi16(d1, _mm_mullo_epi16(a, v27));
+
+		// x: a0..a3, 0 x 4, b0..b3, d0..d3; y: c0..c3, e0..e3
+		__m128i x = _mm_packus_epi16(a, bd);
+		__m128i y = _mm_packus_epi16(ce, _mm_setzero_si128());
+		x = _mm_blendv_epi8(_mm_add_epi8(x, big), space, _mm_cmpeq_epi8(x, v26));
+		y = _mm_blendv_epi8(_mm_add_epi8(y, big), space, _mm_cmpeq_epi8(y, v26));
+		_mm_storeu_si128((__m128i *) out,
+			_mm_or_si128(_mm_shuffle_epi8(x, lox), _mm_shuffle_epi8(y, loy)));
+		uint32_t last = _mm_cvtsi128_si32(
+			_mm_or_si128(_mm_shuffle_epi8(x, hix), _mm_shuffle_epi8(y, hiy)));
+		memcpy(out + 16, &last, 4);
+	}
+
+	*bad = _mm_movemask_epi8(wrong) ? 1 : 0;
+	return g;
+}
+#endif
@@ -0,0 +1,39 @@
+#ifndef OTPPACK_H
+#define OTPPACK_H
+
+
+/*
+ * otppack.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * base 27 packing (header file)
+ *
+ * text in the 27 character alphabet (A to Z and space) carries under
+ * 4.76 bits a character, so five characters fit the 24 bits of three
+ * bytes (27^5 < 2^24): 40% fewer bytes than one per character. A text
+ * whose length is not a multiple of five has its last group padded;
+ * the receiver knows the length from the message header.
+ */
+
+
+/* LIBRARIES */
+#include <stddef.h>
+
+
+/* MACROS */
+#define OTPPACK_GROUP 5					// characters per group
+#define OTPPACK_BYTES 3					// bytes per group
+#define OTPPACK_LEN(n) (((n) + OTPPACK_GROUP - 1) / OTPPACK_GROUP * OTPPACK_BYTES)
+
+
+/* FUNCTION DECLARATIONS */
+int otppack(const char *in, size_t n, unsigned char *out);
+int otpunpack(const unsigned char *in, size_t groups, char *out);
+int otppack_sw(const char *in, size_t n, unsigned char *out);
+int otpunpack_sw(const unsigned char *in, size_t groups, char *out);
+int otppack_vector();
+
+#endif
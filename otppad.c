@@ -0,0 +1,480 @@
+/*
+ * otppad.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * parallel pad writer
+ *
+ * a pad of length characters is length + 1 bytes with its newline.
+ * Shards hold share bytes each, a whole number of chunks, and the last
+ * one the rest; regions hold a whole number of chunks too, so every
+ * chunk a thread writes lands in one file at a chunk aligned offset,
+ * which is what O_DIRECT needs. The newline is written last.
+ *
+ * a thread syncs the files it wrote to before it records its progress,
+ * so a record never runs ahead of the disk; on a resumed run a chunk
+ * that was written but not yet recorded is simply written again with
+ * new characters.
+ */
+
+
+/* LIBRARIES */
+#define _GNU_SOURCE						// fallocate, O_DIRECT
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include "otppad.h"
+
+
+/* MACROS */
+#define ALIGN 4096						// O_DIRECT buffer and offset alignment
+#define ACCEPT 243						// 9 * 27: random bytes at or over this are dropped
+
+
+/* STRUCTS AND ENUMS */
+// one pad being written
+typedef struct padjob {
+	int files;
+	int fds[OTPPAD_FILES];
+	int dfds[OTPPAD_FILES];				// O_DIRECT descriptors, -1 for none
+	size_t length;
+	size_t share;
+	size_t region;
+	int regions;
+	uint64_t *done;						// per region, characters on disk
+	int partfd;
+	int failed;
+} padjob;
+
+// a thread's part of it
+typedef struct padthread {
+	padjob *job;
+	int r;								// region
+	pthread_t tid;
+} padthread;
+
+
+/* GLOBAL VARIABLES */
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ";
+static char charof[256];				// random byte to character, 0 if dropped
+static pthread_once_t mapped = PTHREAD_ONCE_INIT;
+
+
+/* FUNCTION DECLARATIONS */
+static void mapchars(void);
+static void * filler(void *arg);
+static int generate(char *buf, size_t n, unsigned char *raw, size_t *pos);
+static int record(padjob *j, int r);
+static int openpart(padjob *j, char *part, bool *resume);
+static int openfiles(padjob *j, char **paths, bool resume, bool direct);
+static int pwriteall(int fd, const void *buf, size_t n, off_t offset);
+static void closeall(padjob *j);
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  otppad_write
+ * SYNOPSYS
+ * 	writes a pad of length characters and its newline across files
+ *  shard files with threads threads, O_DIRECT if direct, carrying on
+ *  from the progress record of an interrupted run
+ *  returns 0 or -1 (error)
+ */
+int otppad_write(char **paths, int files, size_t length, int threads, bool direct)
+{
+	if (files < 1 || files > OTPPAD_FILES) {
+		fprintf(stderr, "Error: 1 to %d pad files.\n", OTPPAD_FILES);
+		return -1;
+	}
+	if (threads < 1 || threads > OTPPAD_THREADS) {
+		fprintf(stderr, "Error: 1 to %d threads.\n", OTPPAD_THREADS);
+		return -1;
+	}
+	if (length == 0) {
+		fprintf(stderr, "Error: Keylength must be positive integer.\n");
+		return -1;
+	}
+	pthread_once(&mapped, mapchars);
+	int i;
+
+	// geometry: whole chunks per shard and per region
+	padjob j;
+	memset(&j, 0, sizeof(j));
+	j.files = files;
+	j.length = length;
+	j.share = ((length + 1 + files - 1) / files + OTPPAD_CHUNK - 1) / OTPPAD_CHUNK * OTPPAD_CHUNK;
+	j.region = ((length + threads - 1) / threads + OTPPAD_CHUNK - 1) / OTPPAD_CHUNK * OTPPAD_CHUNK;
+	j.regions = (length + j.region - 1) / j.region;
+	j.partfd = -1;
+	for (i = 0; i < OTPPAD_FILES; i++)
+		j.fds[i] = j.dfds[i] = -1;
+
+	char *part = (char *) malloc(strlen(paths[0]) + strlen(OTPPAD_PART) + 1);
+	sprintf(part, "%s%s", paths[0], OTPPAD_PART);
+	bool resume = FALSE;
+	if (openpart(&j, part, &resume) == -1 || openfiles(&j, paths, resume, direct) == -1) {
+		closeall(&j);
+		free(j.done);
+		free(part);
+		return -1;
+	}
+
+	// one thread per region
+	padthread *t = (padthread *) calloc(j.regions, sizeof(padthread));
+	int started = 0;
+	for (i = 0; i < j.regions; i++) {
+		t[i].job = &j;
+		t[i].r = i;
+		if (pthread_create(&t[i].tid, NULL, filler, &t[i]) != 0) {
+			fprintf(stderr, "Error: could not start pad thread.\n");
+			j.failed = 1;
+			break;
+		}
+		started++;
+	}
+	for (i = 0; i < started; i++)
+		pthread_join(t[i].tid, NULL);
+	free(t);
+
+	// newline last, then everything to disk before the record goes
+	int status = j.failed ? -1 : 0;
+	if (status == 0) {
+		int f = length / j.share;
+		if (pwriteall(j.fds[f], "\n", 1, length - f * j.share) == -1)
+			status = -1;
+	}
+	for (i = 0; i < files && status == 0; i++)
+		if (fsync(j.fds[i]) == -1) {
+			perror("fsync() pad");
+			status = -1;
+		}
+	closeall(&j);
+	if (status == 0 && unlink(part) == -1)
+		perror("unlink() pad progress");
+	free(j.done);
+	free(part);
+	return status;
+}
+
+
+/* NAME
+ *  otppad_fill
+ * SYNOPSYS
+ * 	fills buf with n characters from the kernel's CSPRNG, as the
+ *  pad writer does; raw holds OTPPAD_RAW random bytes kept between
+ *  calls, *pos how many of them are used
+ *  returns 0 or -1 (error)
+ */
+int otppad_fill(char *buf, size_t n, unsigned char *raw, size_t *pos)
+{
+	pthread_once(&mapped, mapchars);
+	return generate(buf, n, raw, pos);
+}
+
+
+/* NAME
+ *  mapchars
+ * SYNOPSYS
+ * 	maps each random byte under ACCEPT to its character
+ */
+static void mapchars(void)
+{
+	int i;
+	for (i = 0; i < 256; i++)
+		charof[i] = (i < ACCEPT) ? alphabet[i % 27] : 0;
+}
+
+
+/* NAME
+ *  filler
+ * SYNOPSYS
+ * 	thread: fills its region from where its record left off, a chunk
+ *  at a time, syncing and recording every OTPPAD_SYNC chunks and at
+ *  the end; stops early once any thread has failed
+ */
+static void * filler(void *arg)
+{
+	padthread *t = (padthread *) arg;
+	padjob *j = t->job;
+	size_t start = t->r * j->region;
+	size_t end = (start + j->region < j->length) ? start + j->region : j->length;
+	size_t at = start + j->done[t->r];
+
+	char *buf = NULL;
+	if (posix_memalign((void **) &buf, ALIGN, OTPPAD_CHUNK) != 0) {
+		fprintf(stderr, "Error: out of memory for pad.\n");
+		__atomic_store_n(&j->failed, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	unsigned char raw[OTPPAD_RAW];
+	size_t pos = OTPPAD_RAW;
+	bool dirty[OTPPAD_FILES];
+	memset(dirty, 0, sizeof(dirty));
+	int since = 0;
+	int status = 0;
+
+	while (at < end && status == 0 && !__atomic_load_n(&j->failed, __ATOMIC_RELAXED))
+	{
+		size_t n = (end - at < OTPPAD_CHUNK) ? end - at : OTPPAD_CHUNK;
+		int f = at / j->share;
+		int fd = (n == OTPPAD_CHUNK && j->dfds[f] != -1) ? j->dfds[f] : j->fds[f];
+		if (generate(buf, n, raw, &pos) == -1 || pwriteall(fd, buf, n, at - f * j->share) == -1) {
+			status = -1;
+			break;
+		}
+		dirty[f] = TRUE;
+		at = at + n;
+
+		// on disk first, then recorded
+		if (++since == OTPPAD_SYNC || at == end) {
+			int k;
+			for (k = 0; k < j->files && status == 0; k++)
+				if (dirty[k]) {
+					if (fdatasync(j->fds[k]) == -1) {
+						perror("fdatasync() pad");
+						status = -1;
+					}
+					dirty[k] = FALSE;
+				}
+			j->done[t->r] = at - start;
+			if (status == 0)
+				status = record(j, t->r);
+			since = 0;
+		}
+	}
+
+	if (status == -1)
+		__atomic_store_n(&j->failed, 1, __ATOMIC_RELAXED);
+	explicit_bzero(buf, OTPPAD_CHUNK);
+	explicit_bzero(raw, sizeof(raw));
+	free(buf);
+	return NULL;
+}
+
+
+/* NAME
+ *  generate
+ * SYNOPSYS
+ * 	fills buf with n characters from random bytes, refilling raw from
+ *  getrandom as *pos reaches its end; bytes of ACCEPT or more are
+ *  dropped so every character is equally likely
+ *  returns 0 or -1 (error)
+ */
+static int generate(char *buf, size_t n, unsigned char *raw, size_t *pos)
+{
+	size_t i = 0;
+	size_t p = *pos;
+	while (i < n)
+	{
+		if (p == OTPPAD_RAW) {
+			size_t got = 0;
+			while (got < OTPPAD_RAW) {
+				ssize_t r = getrandom(raw + got, OTPPAD_RAW - got, 0);
+				if (r == -1 && errno == EINTR)
+					continue;
+				if (r == -1) {
+					perror("getrandom() pad");
+					return -1;
+				}
+				got = got + r;
+			}
+			p = 0;
+		}
+		char c = charof[raw[p++]];
+		if (c)
+			buf[i++] = c;
+	}
+	*pos = p;
+	return 0;
+}
+
+
+/* NAME
+ *  record
+ * SYNOPSYS
+ * 	writes region r's progress to the progress record, on disk
+ *  returns 0 or -1 (error)
+ */
+static int record(padjob *j, int r)
+{
+	if (pwriteall(j->partfd, &j->done[r], sizeof(uint64_t), sizeof(otppad_hdr) + r * sizeof(uint64_t)) == -1)
+		return -1;
+	if (fdatasync(j->partfd) == -1) {
+		perror("fdatasync() pad progress");
+		return -1;
+	}
+	return 0;
+}
+
+
+/* NAME
+ *  openpart
+ * SYNOPSYS
+ * 	opens the progress record at part: one for the same pad resumes
+ *  its regions, sets *resume; none starts a new one
+ *  returns 0 or -1 (error, or a record for another pad)
+ */
+static int openpart(padjob *j, char *part, bool *resume)
+{
+	otppad_hdr hdr;
+	int fd = open(part, O_RDWR | O_CLOEXEC);
+	if (fd != -1) {
+		// the record decides the regions, whatever the thread count
+		if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || memcmp(hdr.magic, OTPPAD_MAGIC, 8) != 0
+				|| hdr.length != j->length || hdr.share != j->share || hdr.files != (uint32_t) j->files
+				|| hdr.regions < 1 || hdr.regions > OTPPAD_THREADS || hdr.region % OTPPAD_CHUNK != 0
+				|| (hdr.regions - 1) * hdr.region >= j->length || hdr.regions * hdr.region < j->length) {
+			fprintf(stderr, "Error: %s is not for this pad; remove it to start over.\n", part);
+			close(fd);
+			return -1;
+		}
+		j->regions = hdr.regions;
+		j->region = hdr.region;
+		j->done = (uint64_t *) calloc(j->regions, sizeof(uint64_t));
+		size_t need = j->regions * sizeof(uint64_t);
+		if (pread(fd, j->done, need, sizeof(hdr)) != (ssize_t) need) {
+			fprintf(stderr, "Error: %s is short; remove it to start over.\n", part);
+			close(fd);
+			return -1;
+		}
+		int r;
+		for (r = 0; r < j->regions; r++)
+			if (j->done[r] > j->region || r * j->region + j->done[r] > j->length) {
+				fprintf(stderr, "Error: %s is damaged; remove it to start over.\n", part);
+				close(fd);
+				return -1;
+			}
+		j->partfd = fd;
+		*resume = TRUE;
+		return 0;
+	}
+	if (errno != ENOENT) {
+		perror("open() pad progress");
+		return -1;
+	}
+
+	// new record, every region at its start
+	fd = open(part, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd == -1) {
+		perror("open() pad progress");
+		return -1;
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, OTPPAD_MAGIC, 8);
+	hdr.length = j->length;
+	hdr.share = j->share;
+	hdr.files = j->files;
+	hdr.regions = j->regions;
+	hdr.region = j->region;
+	j->done = (uint64_t *) calloc(j->regions, sizeof(uint64_t));
+	if (pwriteall(fd, &hdr, sizeof(hdr), 0) == -1
+			|| pwriteall(fd, j->done, j->regions * sizeof(uint64_t), sizeof(hdr)) == -1
+			|| fdatasync(fd) == -1) {
+		close(fd);
+		unlink(part);
+		return -1;
+	}
+	j->partfd = fd;
+	*resume = FALSE;
+	return 0;
+}
+
+
+/* NAME
+ *  openfiles
+ * SYNOPSYS
+ * 	opens the shard files, new or, when resuming, as they were left,
+ *  and preallocates each to its size (fallocate, or ftruncate where
+ *  the file system has no fallocate); with direct, also opens each
+ *  with O_DIRECT, falling back to plain writes where it is refused
+ *  returns 0 or -1 (error)
+ */
+static int openfiles(padjob *j, char **paths, bool resume, bool direct)
+{
+	int f;
+	for (f = 0; f < j->files; f++)
+	{
+		size_t from = f * j->share;
+		size_t size = (from >= j->length + 1) ? 0 : (j->length + 1 - from < j->share) ? j->length + 1 - from : j->share;
+
+		// a resumed shard must be the one the record was kept for
+		j->fds[f] = open(paths[f], O_WRONLY | O_CLOEXEC | (resume ? 0 : O_CREAT | O_TRUNC), 0600);
+		if (j->fds[f] == -1) {
+			fprintf(stderr, "Error: cannot open pad file %s: %s.\n", paths[f], strerror(errno));
+			return -1;
+		}
+		struct stat st;
+		if (resume && (fstat(j->fds[f], &st) == -1 || (size_t) st.st_size != size)) {
+			fprintf(stderr, "Error: pad file %s does not match its progress record.\n", paths[f]);
+			return -1;
+		}
+		if (size > 0 && fallocate(j->fds[f], 0, 0, size) == -1) {
+			if (errno != EOPNOTSUPP) {
+				fprintf(stderr, "Error: cannot allocate %zu bytes for %s: %s.\n", size, paths[f], strerror(errno));
+				return -1;
+			}
+			if (ftruncate(j->fds[f], size) == -1) {
+				perror("ftruncate() pad");
+				return -1;
+			}
+		}
+
+		if (direct) {
+			j->dfds[f] = open(paths[f], O_WRONLY | O_DIRECT | O_CLOEXEC);
+			if (j->dfds[f] == -1 && errno == EINVAL)
+				fprintf(stderr, "Warning: no O_DIRECT for %s, writing through the page cache.\n", paths[f]);
+			else if (j->dfds[f] == -1) {
+				perror("open() pad");
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+
+/* NAME
+ *  pwriteall
+ * SYNOPSYS
+ * 	writes all n bytes of buf at offset
+ *  returns 0 or -1 (error)
+ */
+static int pwriteall(int fd, const void *buf, size_t n, off_t offset)
+{
+	const char *p = (const char *) buf;
+	while (n > 0) {
+		ssize_t w = pwrite(fd, p, n, offset);
+		if (w == -1 && errno == EINTR)
+			continue;
+		if (w == -1) {
+			perror("pwrite() pad");
+			return -1;
+		}
+		p += w;
+		n -= w;
+		offset += w;
+	}
+	return 0;
+}
+
+
+/* NAME
+ *  closeall
+ * SYNOPSYS
+ * 	closes the shard files and the progress record
+ */
+static void closeall(padjob *j)
+{
+	int f;
+	for (f = 0; f < OTPPAD_FILES; f++) {
+		if (j->fds[f] != -1)
+			close(j->fds[f]);
+		if (j->dfds[f] != -1)
+			close(j->dfds[f]);
+	}
+	if (j->partfd != -1)
+		close(j->partfd);
+}
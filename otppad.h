@@ -0,0 +1,67 @@
+#ifndef OTPPAD_H
+#define OTPPAD_H
+
+
+/*
+ * otppad.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * parallel pad writer (header file)
+ *
+ * keygen -o writes a pad straight to one file, or to several shard
+ * files that concatenated in order make the pad, in the same format as
+ * keygen's standard output: the characters and a newline. The files
+ * are preallocated, then the pad is cut into one region per thread and
+ * each thread fills its region with its own stream from the kernel's
+ * CSPRNG (getrandom), writing it with pwrite a chunk at a time, through
+ * O_DIRECT if asked. Every shard is a whole number of chunks but the
+ * last, so no chunk spans two files.
+ *
+ * each thread records how far its region is done in <first file>.part
+ * after that much is on disk. Running the same command again after an
+ * interrupted run carries on from there; the record is removed when
+ * the pad is complete.
+ *
+ * otppad_fill is the same generator on its own, for keygen's pad pool
+ * service and key containers: the caller keeps raw, OTPPAD_RAW bytes,
+ * and *pos, OTPPAD_RAW to start, between calls.
+ */
+
+
+/* LIBRARIES */
+#include <stddef.h>
+#include <stdint.h>
+#include "otplib.h"
+
+
+/* MACROS */
+#define OTPPAD_MAGIC "OTPPAD1"			// first bytes of a progress record
+#define OTPPAD_CHUNK (1024 * 1024)		// characters per write, a multiple of the O_DIRECT alignment
+#define OTPPAD_SYNC 64					// chunks written between progress records
+#define OTPPAD_FILES 64					// most shard files
+#define OTPPAD_THREADS 256				// most threads
+#define OTPPAD_PART ".part"				// appended to the first file for the progress record
+#define OTPPAD_RAW 4096					// random bytes fetched at a time by otppad_fill
+
+
+/* STRUCTS AND ENUMS */
+// start of a progress record, followed by one uint64_t per region:
+// characters of the region on disk
+typedef struct otppad_hdr {
+	char magic[8];
+	uint64_t length;					// pad characters
+	uint64_t share;						// bytes per shard file, but the last
+	uint32_t files;
+	uint32_t regions;
+	uint64_t region;					// characters per region, but the last
+} otppad_hdr;
+
+
+/* FUNCTION DECLARATIONS */
+int otppad_write(char **paths, int files, size_t length, int threads, bool direct);
+int otppad_fill(char *buf, size_t n, unsigned char *raw, size_t *pos);
+
+#endif
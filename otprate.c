@@ -0,0 +1,458 @@
+/*
+ * otprate.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * per client rate limits
+ *
+ * buckets are mapped shared before the parent forks and guarded by a
+ * process shared, robust mutex, like the lanes (otplane.c). They sit
+ * in a small set associative table hashed by source; a new source
+ * takes the bucket in its set that was used longest ago, which is
+ * almost always full again, so forgetting it changes nothing. Tokens
+ * are refilled lazily, when a bucket is next looked at. Only the parent
+ * counts connections, so which source each child serves is kept in its
+ * own memory.
+ */
+
+
+/* LIBRARIES */
+#define _GNU_SOURCE						// struct ucred
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include "otprate.h"
+
+
+/* MACROS */
+#define KEYLEN 17						// family, then address or uid
+#define KEY_NONE 0						// families, key[0]
+#define KEY_INET 4
+#define KEY_INET6 6
+#define KEY_UID 'u'
+
+
+/* STRUCTS AND ENUMS */
+// one source's tokens and counts
+typedef struct bucket {
+	uint8_t key[KEYLEN];
+	uint8_t used;
+	double reqs;						// request tokens
+	double chars;						// character tokens, negative in debt
+	uint64_t last;						// nanoseconds, CLOCK_MONOTONIC, of last refill
+	uint64_t requests;
+	uint64_t charged;					// characters
+	uint64_t delayed;					// requests that waited for tokens
+	uint64_t rejected;					// requests refused
+	uint64_t refused;					// connections refused
+} bucket;
+
+// parent: the source a child serves
+typedef struct owner {
+	pid_t pid;							// 0 if free
+	uint8_t key[KEYLEN];
+} owner;
+
+// shared by the parent and all children
+typedef struct rates {
+	pthread_mutex_t lock;
+	double reqrate;						// per second, 0 for no limit
+	double charrate;
+	double reqburst;					// most tokens a bucket holds
+	double charburst;
+	int conns;							// connections per source at once, 0 for any
+	uint64_t evicted;					// sources forgotten for a new one
+	bucket set[OTPRATE_SETS][OTPRATE_WAYS];
+} rates;
+
+
+/* GLOBAL VARIABLES */
+static rates *rt = NULL;				// NULL until otprate_init, or with no limits
+static uint8_t me[KEYLEN];				// source of the connection being accepted or served
+static owner owners[OTPRATE_CXNS];		// parent: children by source
+
+
+/* FUNCTION DECLARATIONS */
+static uint64_t ratenow();
+static void ratelock();
+static void sourcekey(uint8_t *key, const struct sockaddr *sa, int fd);
+static void sourcename(const uint8_t *key, char *name, size_t size);
+static bucket * find(const uint8_t *key, uint64_t now);
+static uint64_t waitfor(const bucket *b);
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  otprate_init
+ * SYNOPSYS
+ * 	parent: maps the buckets; each source may make reqrate requests
+ *  and send charrate characters a second, over at most conns
+ *  connections (0 for no limit)
+ *  returns 0 or -1 (error)
+ */
+int otprate_init(double reqrate, double charrate, int conns)
+{
+	if (reqrate <= 0 && charrate <= 0 && conns <= 0)
+		return 0;
+	void *base = mmap(NULL, sizeof(rates), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		perror("mmap() rates");
+		return -1;
+	}
+	rt = (rates *) base;
+	rt->reqrate = (reqrate > 0) ? reqrate : 0;
+	rt->charrate = (charrate > 0) ? charrate : 0;
+	rt->reqburst = rt->reqrate * OTPRATE_BURST;
+	if (rt->reqburst < 1)
+		rt->reqburst = 1;
+	rt->charburst = rt->charrate * OTPRATE_BURST;
+	if (rt->charburst < 1)
+		rt->charburst = 1;
+	rt->conns = (conns > 0) ? conns : 0;
+
+	pthread_mutexattr_t ma;
+	pthread_mutexattr_init(&ma);
+	pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&rt->lock, &ma);
+	pthread_mutexattr_destroy(&ma);
+	return 0;
+}
+
+
+/* NAME
+ *  ratenow
+ * SYNOPSYS
+ * 	monotonic time in nanoseconds
+ */
+static uint64_t ratenow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/* NAME
+ *  ratelock
+ * SYNOPSYS
+ * 	takes the bucket lock, recovering it from a child that died holding it
+ */
+static void ratelock()
+{
+	if (pthread_mutex_lock(&rt->lock) == EOWNERDEAD)
+		pthread_mutex_consistent(&rt->lock);
+}
+
+
+/* NAME
+ *  sourcekey
+ * SYNOPSYS
+ * 	fills key with the source of a connection accepted from sa on fd:
+ *  its IPv4 or IPv6 address (IPv4 mapped addresses as IPv4), or the
+ *  peer's uid on a unix socket
+ */
+static void sourcekey(uint8_t *key, const struct sockaddr *sa, int fd)
+{
+	memset(key, 0, KEYLEN);
+	if (sa->sa_family == AF_INET) {
+		key[0] = KEY_INET;
+		memcpy(key + 1, &((const struct sockaddr_in *) sa)->sin_addr, 4);
+	}
+	else if (sa->sa_family == AF_INET6) {
+		const struct in6_addr *a = &((const struct sockaddr_in6 *) sa)->sin6_addr;
+		if (IN6_IS_ADDR_V4MAPPED(a)) {
+			key[0] = KEY_INET;
+			memcpy(key + 1, a->s6_addr + 12, 4);
+		}
+		else {
+			key[0] = KEY_INET6;
+			memcpy(key + 1, a->s6_addr, 16);
+		}
+	}
+	else if (sa->sa_family == AF_UNIX) {
+		struct ucred cred;
+		socklen_t len = sizeof(cred);
+		if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0) {
+			key[0] = KEY_UID;
+			memcpy(key + 1, &cred.uid, sizeof(cred.uid));
+		}
+	}
+}
+
+
+/* NAME
+ *  sourcename
+ * SYNOPSYS
+ * 	writes a source key as text to name
+ */
+static void sourcename(const uint8_t *key, char *name, size_t size)
+{
+	uint32_t uid;
+	switch (key[0])
+	{
+		case KEY_INET:
+			inet_ntop(AF_INET, key + 1, name, size);
+			break;
+		case KEY_INET6:
+			inet_ntop(AF_INET6, key + 1, name, size);
+			break;
+		case KEY_UID:
+			memcpy(&uid, key + 1, sizeof(uid));
+			snprintf(name, size, "uid %u", uid);
+			break;
+		default:
+			snprintf(name, size, "unknown");
+	}
+}
+
+
+/* NAME
+ *  find
+ * SYNOPSYS
+ * 	with the lock held: the bucket of source key, refilled up to now;
+ *  a source not in the table takes the least recently used bucket of
+ *  its set, full
+ */
+static bucket * find(const uint8_t *key, uint64_t now)
+{
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	int i;
+	for (i = 0; i < KEYLEN; i++)
+		h = (h ^ key[i]) * 16777619u;
+	bucket *set = rt->set[h % OTPRATE_SETS];
+
+	bucket *b = NULL;
+	for (i = 0; i < OTPRATE_WAYS; i++) {
+		if (set[i].used && memcmp(set[i].key, key, KEYLEN) == 0) {
+			b = &set[i];
+			break;
+		}
+	}
+	if (!b) {
+		b = &set[0];
+		for (i = 1; i < OTPRATE_WAYS && b->used; i++)
+			if (!set[i].used || set[i].last < b->last)
+				b = &set[i];
+		if (b->used)
+			rt->evicted++;
+		memset(b, 0, sizeof(*b));
+		memcpy(b->key, key, KEYLEN);
+		b->used = 1;
+		b->reqs = rt->reqburst;
+		b->chars = rt->charburst;
+		b->last = now;
+		return b;
+	}
+
+	double secs = (double) (now - b->last) / 1e9;
+	b->reqs += secs * rt->reqrate;
+	if (b->reqs > rt->reqburst)
+		b->reqs = rt->reqburst;
+	b->chars += secs * rt->charrate;
+	if (b->chars > rt->charburst)
+		b->chars = rt->charburst;
+	b->last = now;
+	return b;
+}
+
+
+/* NAME
+ *  waitfor
+ * SYNOPSYS
+ * 	nanoseconds until bucket b can take a request: a whole request
+ *  token and no character debt; 0 if it can now
+ */
+static uint64_t waitfor(const bucket *b)
+{
+	double secs = 0;
+	if (rt->reqrate > 0 && b->reqs < 1)
+		secs = (1 - b->reqs) / rt->reqrate;
+	if (rt->charrate > 0 && b->chars < 0 && -b->chars / rt->charrate > secs)
+		secs = -b->chars / rt->charrate;
+	return (uint64_t) (secs * 1e9);
+}
+
+
+/* NAME
+ *  otprate_accept
+ * SYNOPSYS
+ * 	parent: notes the source of the connection accepted from sa on fd,
+ *  for its child, and checks whether it is too far over its rates or
+ *  already holds its share of connections
+ *  returns 0, or -1 to refuse the connection
+ */
+int otprate_accept(const struct sockaddr *sa, int fd)
+{
+	if (!rt)
+		return 0;
+	sourcekey(me, sa, fd);
+
+	int held = 0;
+	int i;
+	for (i = 0; i < OTPRATE_CXNS; i++)
+		if (owners[i].pid && memcmp(owners[i].key, me, KEYLEN) == 0)
+			held++;
+
+	int status = 0;
+	ratelock();
+	bucket *b = find(me, ratenow());
+	if (waitfor(b) > OTPRATE_WAIT * 1000000ULL || (rt->conns > 0 && held >= rt->conns)) {
+		b->refused++;
+		status = -1;
+	}
+	pthread_mutex_unlock(&rt->lock);
+	return status;
+}
+
+
+/* NAME
+ *  otprate_fork
+ * SYNOPSYS
+ * 	parent: child pid serves the connection last accepted
+ */
+void otprate_fork(pid_t pid)
+{
+	if (!rt)
+		return;
+	int i;
+	for (i = 0; i < OTPRATE_CXNS; i++) {
+		if (owners[i].pid == 0) {
+			owners[i].pid = pid;
+			memcpy(owners[i].key, me, KEYLEN);
+			return;
+		}
+	}
+}
+
+
+/* NAME
+ *  otprate_reap
+ * SYNOPSYS
+ * 	parent: child pid is gone
+ */
+void otprate_reap(pid_t pid)
+{
+	int i;
+	for (i = 0; i < OTPRATE_CXNS; i++)
+		if (owners[i].pid == pid)
+			owners[i].pid = 0;
+}
+
+
+/* NAME
+ *  otprate_take
+ * SYNOPSYS
+ * 	child: takes a request of chars characters from its source's
+ *  buckets, first waiting for tokens if that is no more than
+ *  OTPRATE_WAIT
+ *  returns 0, or -1 to refuse the request
+ */
+int otprate_take(size_t chars)
+{
+	if (!rt)
+		return 0;
+
+	uint64_t waited = 0;
+	while (1) {
+		ratelock();
+		bucket *b = find(me, ratenow());
+		uint64_t wait = waitfor(b);
+		if (wait == 0) {
+			b->reqs -= 1;
+			b->chars -= chars;
+			b->requests++;
+			b->charged += chars;
+			if (waited > 0)
+				b->delayed++;
+			pthread_mutex_unlock(&rt->lock);
+			return 0;
+		}
+		if (waited + wait > OTPRATE_WAIT * 1000000ULL) {
+			b->rejected++;
+			pthread_mutex_unlock(&rt->lock);
+			return -1;
+		}
+		pthread_mutex_unlock(&rt->lock);
+
+		// another connection from the same source may take the tokens
+		// first, so look again after sleeping
+		struct timespec ts = {wait / 1000000000ULL, wait % 1000000000ULL};
+		while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+		waited += wait;
+	}
+}
+
+
+/* NAME
+ *  otprate_report
+ * SYNOPSYS
+ * 	writes the limits, totals and the busiest sources to buf
+ *  returns length written
+ */
+int otprate_report(char *buf, size_t size)
+{
+	if (!rt)
+		return snprintf(buf, size, "rate   no limits\n");
+
+	// copy the busiest sources out, most requests first
+	bucket top[OTPRATE_TOP];
+	bucket total;
+	memset(&total, 0, sizeof(total));
+	int ntop = 0, nsources = 0;
+	int s, w, i;
+	ratelock();
+	for (s = 0; s < OTPRATE_SETS; s++) {
+		for (w = 0; w < OTPRATE_WAYS; w++) {
+			bucket *b = &rt->set[s][w];
+			if (!b->used)
+				continue;
+			nsources++;
+			total.requests += b->requests;
+			total.charged += b->charged;
+			total.delayed += b->delayed;
+			total.rejected += b->rejected;
+			total.refused += b->refused;
+			for (i = ntop; i > 0 && top[i - 1].requests < b->requests; i--)
+				if (i < OTPRATE_TOP)
+					top[i] = top[i - 1];
+			if (i < OTPRATE_TOP) {
+				top[i] = *b;
+				if (ntop < OTPRATE_TOP)
+					ntop++;
+			}
+		}
+	}
+	uint64_t evicted = rt->evicted;
+	pthread_mutex_unlock(&rt->lock);
+
+	char reqs[24] = "any", chars[24] = "any", conns[24] = "any";
+	if (rt->reqrate > 0)
+		snprintf(reqs, sizeof(reqs), "%g", rt->reqrate);
+	if (rt->charrate > 0)
+		snprintf(chars, sizeof(chars), "%g", rt->charrate);
+	if (rt->conns > 0)
+		snprintf(conns, sizeof(conns), "%d", rt->conns);
+	int n = snprintf(buf, size, "rate   %s requests/s  %s characters/s  %s connections per source  sources %d  evicted %lu\n",
+		reqs, chars, conns, nsources, (unsigned long) evicted);
+	if (n < (int) size)
+		n += snprintf(buf + n, size - n, "source                   requests    characters   delayed  rejected   refused\n");
+	for (i = 0; i <= ntop && n < (int) size; i++) {
+		bucket *b = (i < ntop) ? &top[i] : &total;
+		char name[48] = "all";
+		if (i < ntop)
+			sourcename(b->key, name, sizeof(name));
+		n += snprintf(buf + n, size - n, "%-22s %10lu  %12lu  %8lu  %8lu  %8lu\n", name,
+			(unsigned long) b->requests, (unsigned long) b->charged, (unsigned long) b->delayed,
+			(unsigned long) b->rejected, (unsigned long) b->refused);
+	}
+	return n;
+}
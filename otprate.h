@@ -0,0 +1,55 @@
+#ifndef OTPRATE_H
+#define OTPRATE_H
+
+
+/*
+ * otprate.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * per client rate limits (header file)
+ *
+ * each client source, the peer address for TCP or the peer's uid for
+ * the unix socket, has two token buckets: one for requests and one for
+ * characters, refilled at the configured rates and holding at most
+ * OTPRATE_BURST seconds of either. A request takes one request token
+ * and its length in characters; a request longer than the burst is
+ * let through when the bucket is full and leaves it in debt. A request
+ * that would have to wait more than OTPRATE_WAIT for its tokens is
+ * refused, and so is a new connection from a source that far behind,
+ * before a child is forked for it. Buckets live in shared memory, so
+ * every connection from one source draws on the same ones.
+ *
+ * a source may also be held to a number of connections at once, so
+ * one whose connections all sit waiting for tokens cannot keep every
+ * other client out.
+ */
+
+
+/* LIBRARIES */
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+
+/* MACROS */
+#define OTPRATE_SETS 64					// bucket table: sets of OTPRATE_WAYS sources
+#define OTPRATE_WAYS 4
+#define OTPRATE_BURST 1					// seconds of rate a bucket holds
+#define OTPRATE_WAIT 1000				// longest a request waits for tokens, milliseconds
+#define OTPRATE_TOP 8					// sources listed in a report
+#define OTPRATE_CXNS 32					// connections tracked per source cap, at least 2 * MAXCXNS
+
+
+/* FUNCTION DECLARATIONS */
+int otprate_init(double reqrate, double charrate, int conns);
+int otprate_accept(const struct sockaddr *sa, int fd);
+void otprate_fork(pid_t pid);
+void otprate_reap(pid_t pid);
+int otprate_take(size_t chars);
+int otprate_report(char *buf, size_t size);
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ * otpreuse.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * key reuse detector
+ *
+ * a rolling (gear) hash runs over every OTPREUSE_WINDOW characters of
+ * key; windows whose hash falls in a 1 in 2^OTPREUSE_SAMPLE slice are kept
+ * as fingerprints. The choice depends only on the window's content,
+ * so the same stretch of pad yields the same fingerprints wherever it
+ * sits in a request. A run of OTPREUSE_HITS sampled windows seen
+ * before flags reuse: reused pad hits on every window, while false
+ * positives of the filter are scattered and rarely line up, even over
+ * megabytes of key. The first OTPREUSE_PREFIX characters are always
+ * fingerprinted too (with twice the probes, a hit alone flags), which
+ * catches short messages and pads restarted at the same offset. A key
+ * shorter than that is remembered but never flagged by its prefix: a
+ * few characters have too few values for fresh pad not to repeat them.
+ *
+ * fingerprints go into blocked bloom filters (every probe of one
+ * fingerprint within a cache line) in memory shared with the children.
+ * A digest of each request's input and key also goes into a ring of
+ * the last OTPREUSE_RECENT, and is taken out again if the request is
+ * flagged; a request flagged whose digest is there is one resent
+ * whole, not reuse.
+ * There are two filters, queried together: when the one taking inserts
+ * is full, the other is cleared and takes over, so memory stays fixed
+ * and the oldest key history is forgotten first. Lookups are batched and
+ * their lines prefetched, so the cache misses of a request overlap.
+ */
+
+
+/* LIBRARIES */
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "otpcrc.h"
+#include "otpreuse.h"
+
+
+/* MACROS */
+#define LINEWORDS 8						// 64-bit words per 64-byte line
+#define LINEBITS (LINEWORDS * 64)
+#define BASE 0x100000001B3ULL			// prefix hash multiplier
+#define SEED2 0x9E3779B97F4A7C15ULL		// second prefix fingerprint, gear table seed
+
+
+/* STRUCTS AND ENUMS */
+// shared header, the recent ring and then the filters follow it
+typedef struct reusehdr {
+	uint64_t nlines;					// cache lines per filter, power of 2
+	uint64_t capacity;					// fingerprints per filter before rotating
+	uint64_t count[2];					// fingerprints inserted into each filter
+	uint32_t cur;						// filter taking inserts
+	uint32_t rotating;					// set while the other filter is cleared
+	uint64_t checked;					// requests checked
+	uint64_t flagged;					// requests that reused key
+	uint64_t next;						// next slot of the recent ring
+	char pad[128 - 2 * sizeof(uint32_t) - 7 * sizeof(uint64_t)];
+} reusehdr;
+
+
+/* GLOBAL VARIABLES */
+static reusehdr *hdr = NULL;			// NULL if detection is off
+static uint64_t *recent = NULL;			// digests of the last requests, 0 unused
+static uint64_t *filters = NULL;
+static uint64_t gear[256];				// random value per character
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  mix
+ * SYNOPSYS
+ * 	spreads hash bits (splitmix64 finalizer)
+ */
+static inline uint64_t mix(uint64_t x)
+{
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+
+/* NAME
+ *  otpreuse_init
+ * SYNOPSYS
+ * 	maps filters of mb megabytes in total, shared with children forked
+ *  later; 0 turns detection off
+ *  returns 0 or -1 (error)
+ */
+int otpreuse_init(size_t mb)
+{
+	if (mb == 0)
+		return 0;
+
+	// each of the two filters gets the largest power of 2 lines that fits
+	uint64_t nlines = 1;
+	while (nlines * 2 * 64 * 2 <= (uint64_t) mb * 1024 * 1024)
+		nlines = nlines * 2;
+
+	size_t len = sizeof(reusehdr) + OTPREUSE_RECENT * sizeof(uint64_t) + 2 * nlines * 64;
+	void *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		perror("mmap() reuse filter");
+		return -1;
+	}
+
+	uint64_t seed = SEED2;
+	int i;
+	for (i = 0; i < 256; i++) {
+		seed = seed + SEED2;
+		gear[i] = mix(seed);
+	}
+
+	hdr = (reusehdr *) base;
+	hdr->nlines = nlines;
+	hdr->capacity = nlines * LINEBITS / OTPREUSE_BITS;
+	recent = (uint64_t *) (hdr + 1);
+	filters = recent + OTPREUSE_RECENT;
+	return 0;
+}
+
+
+/* NAME
+ *  lineof
+ * SYNOPSYS
+ * 	cache line of filter n holding fingerprint f
+ */
+static inline uint64_t * lineof(int n, uint64_t f)
+{
+	return filters + (n * hdr->nlines + ((f >> 40) & (hdr->nlines - 1))) * LINEWORDS;
+}
+
+
+/* NAME
+ *  probe
+ * SYNOPSYS
+ * 	checks the bits of fingerprint f in filter n, setting them if set
+ *  returns 1 if all were already set
+ */
+static inline int probe(int n, uint64_t f, int set)
+{
+	uint64_t *line = lineof(n, f);
+	uint64_t mask[LINEWORDS] = {0};
+	uint64_t step = (f >> 20) | 1;
+	int i;
+	for (i = 0; i < OTPREUSE_HASHES; i++) {
+		unsigned bit = (f + i * step) & (LINEBITS - 1);
+		mask[bit >> 6] |= 1ULL << (bit & 63);
+	}
+
+	// one read of the line; atomics only on words that lack bits
+	int all = 1;
+	for (i = 0; i < LINEWORDS; i++) {
+		if ((__atomic_load_n(&line[i], __ATOMIC_RELAXED) & mask[i]) != mask[i]) {
+			all = 0;
+			if (set)
+				__atomic_fetch_or(&line[i], mask[i], __ATOMIC_RELAXED);
+		}
+	}
+	return all;
+}
+
+
+/* NAME
+ *  remember
+ * SYNOPSYS
+ * 	inserts fingerprint of hash h into the current filter
+ *  returns 1 if either filter already held it
+ */
+static int remember(uint64_t h)
+{
+	uint64_t f = mix(h);
+	int cur = __atomic_load_n(&hdr->cur, __ATOMIC_ACQUIRE);
+	int hit = probe(cur, f, 1);
+	if (!hit)
+		hit = probe(cur ^ 1, f, 0);
+
+	// rotate when full: clear the older filter and switch to it
+	if (__atomic_add_fetch(&hdr->count[cur], 1, __ATOMIC_RELAXED) >= hdr->capacity) {
+		uint32_t idle = 0;
+		if (__atomic_compare_exchange_n(&hdr->rotating, &idle, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			if (__atomic_load_n(&hdr->cur, __ATOMIC_ACQUIRE) == (uint32_t) cur) {
+				memset(filters + (cur ^ 1) * hdr->nlines * LINEWORDS, 0, hdr->nlines * 64);
+				__atomic_store_n(&hdr->count[cur ^ 1], 0, __ATOMIC_RELAXED);
+				__atomic_store_n(&hdr->cur, cur ^ 1, __ATOMIC_RELEASE);
+			}
+			__atomic_store_n(&hdr->rotating, 0, __ATOMIC_RELEASE);
+		}
+	}
+	return hit;
+}
+
+
+/* NAME
+ *  lookup
+ * SYNOPSYS
+ * 	remembers n sampled window hashes, prefetching their lines first
+ *  so the cache misses overlap; run counts consecutive windows seen
+ *  before, across calls
+ *  returns 1 if a run reached OTPREUSE_HITS
+ */
+static int lookup(const uint64_t *batch, int n, int *run)
+{
+	int reused = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		uint64_t f = mix(batch[i]);
+		__builtin_prefetch(lineof(0, f), 1);
+		__builtin_prefetch(lineof(1, f), 1);
+	}
+	for (i = 0; i < n; i++) {
+		*run = remember(batch[i]) ? *run + 1 : 0;
+		if (*run >= OTPREUSE_HITS)
+			reused = 1;
+	}
+	return reused;
+}
+
+
+/* NAME
+ *  resent
+ * SYNOPSYS
+ * 	looks for digest d of a request in the recent ring, except in its
+ *  own slot
+ *  returns 1 if an earlier request had it
+ */
+static int resent(uint64_t d, uint64_t own)
+{
+	int i;
+	for (i = 0; i < OTPREUSE_RECENT; i++)
+		if ((uint64_t) i != own && __atomic_load_n(&recent[i], __ATOMIC_RELAXED) == d)
+			return 1;
+	return 0;
+}
+
+
+/* NAME
+ *  otpreuse_seen
+ * SYNOPSYS
+ * 	remembers the len characters of key and reports whether any part
+ *  of it was seen before, unless with the same len characters of
+ *  input in (NULL if unknown) in one of the last requests
+ *  returns 1 if reuse is suspected, else 0 (always 0 when off)
+ */
+int otpreuse_seen(const char *in, const char *key, size_t len)
+{
+	if (!hdr || len == 0)
+		return 0;
+	__atomic_add_fetch(&hdr->checked, 1, __ATOMIC_RELAXED);
+
+	// digest of input and key, in the recent ring before any key is
+	// remembered, so a request cut short anywhere past here is known
+	// when it comes again
+	uint64_t d = 0;
+	uint64_t own = 0;
+	if (in) {
+		d = mix(((uint64_t) otpcrc32c(0, in, len) << 32) | otpcrc32c((uint32_t) len, key, len)) | 1;
+		own = __atomic_fetch_add(&hdr->next, 1, __ATOMIC_RELAXED) % OTPREUSE_RECENT;
+		__atomic_store_n(&recent[own], d, __ATOMIC_RELAXED);
+	}
+
+	// prefix: two fingerprints, both must hit, and only a full prefix
+	// counts, a shorter one repeats by chance
+	const unsigned char *k = (const unsigned char *) key;
+	size_t plen = (len < OTPREUSE_PREFIX) ? len : OTPREUSE_PREFIX;
+	uint64_t h = plen;
+	size_t i;
+	for (i = 0; i < plen; i++)
+		h = h * BASE + k[i];
+	int a = remember(h);
+	int b = remember(h ^ SEED2);
+	int reused = a && b && plen == OTPREUSE_PREFIX;
+
+	// sampled windows: gear hash, each character shifts the oldest
+	// out of the top, so h depends on the last OTPREUSE_WINDOW only
+	uint64_t batch[OTPREUSE_BATCH];
+	int n = 0;
+	int run = 0;						// consecutive sampled windows seen before
+	h = 0;
+	for (i = 0; i < len; i++) {
+		h = (h << 1) + gear[k[i]];
+		if (i < OTPREUSE_WINDOW - 1 || (h >> (64 - OTPREUSE_SAMPLE)) != 0)
+			continue;
+		batch[n++] = h;
+		if (n == OTPREUSE_BATCH) {
+			reused |= lookup(batch, n, &run);
+			n = 0;
+		}
+	}
+	reused |= lookup(batch, n, &run);
+
+	// the whole request again is a resend: same input, same key, and
+	// so the same ciphertext, nothing learned from it
+	if (reused && in && resent(d, own))
+		reused = 0;
+
+	// a request flagged is no earlier request for its own resend to
+	// match, or a reuse refused once would pass when sent again
+	if (reused && in)
+		__atomic_compare_exchange_n(&recent[own], &d, 0, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+
+	if (reused)
+		__atomic_add_fetch(&hdr->flagged, 1, __ATOMIC_RELAXED);
+	return reused;
+}
+
+
+/* NAME
+ *  otpreuse_stats
+ * SYNOPSYS
+ * 	requests checked and flagged so far, across all children
+ */
+void otpreuse_stats(uint64_t *checked, uint64_t *flagged)
+{
+	*checked = hdr ? __atomic_load_n(&hdr->checked, __ATOMIC_RELAXED) : 0;
+	*flagged = hdr ? __atomic_load_n(&hdr->flagged, __ATOMIC_RELAXED) : 0;
+}
@@ -0,0 +1,49 @@
+#ifndef OTPREUSE_H
+#define OTPREUSE_H
+
+
+/*
+ * otpreuse.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * key reuse detector (header file)
+ *
+ * remembers fingerprints of key material in a bloom filter shared by
+ * all children of a daemon; any stretch of key seen before is found
+ * wherever it starts within a request; the same input sent again with
+ * the same key, as a client resuming a broken transfer does, is not
+ * reuse, since it encrypts to the same ciphertext
+ */
+
+
+/* LIBRARIES */
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* MACROS */
+#define OTPREUSE_WINDOW 64				// key characters per fingerprint (bits of the hash)
+#define OTPREUSE_SAMPLE 6				// keep 1 in 2^OTPREUSE_SAMPLE windows
+#define OTPREUSE_HITS 3					// consecutive sampled windows seen before to flag reuse
+#define OTPREUSE_BATCH 16				// fingerprints looked up together
+#define OTPREUSE_PREFIX 16				// leading key characters always fingerprinted
+#define OTPREUSE_HASHES 8				// bloom filter probes per fingerprint
+#define OTPREUSE_BITS 16				// filter bits per fingerprint at capacity
+#define OTPREUSE_MB 16					// default filter memory
+#define OTPREUSE_RECENT 4096			// last requests remembered whole, so a resend is not reuse
+
+
+/* STRUCTS AND ENUMS */
+// what to do about reused key
+typedef enum otpreuse_policy {RU_OFF, RU_WARN, RU_REJECT} otpreuse_policy;
+
+
+/* FUNCTION DECLARATIONS */
+int otpreuse_init(size_t mb);
+int otpreuse_seen(const char *in, const char *key, size_t len);
+void otpreuse_stats(uint64_t *checked, uint64_t *flagged);
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ * otpshm.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * shared memory ring transport
+ *
+ * the client creates the region (a sealed memfd, so it can never
+ * shrink under the daemon) and the eventfds, and passes all three
+ * over its unix socket; the daemon attaches to them. See otpshm.h.
+ */
+
+
+/* LIBRARIES */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "otpshm.h"
+
+
+/* MACROS */
+#define SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+
+/* FUNCTION DECLARATIONS */
+static size_t otpshm_stride(size_t maxlen);
+static int otpshm_map(otpshm *s, size_t size);
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  otpshm_stride
+ * SYNOPSYS
+ * 	bytes per slot holding maxlen characters of input and of key,
+ *  rounded up to a cache line
+ */
+static size_t otpshm_stride(size_t maxlen)
+{
+	size_t n = sizeof(otpshm_slot) + 2 * (maxlen + 1);
+	return (n + 63) & ~(size_t) 63;
+}
+
+
+/* NAME
+ *  otpshm_map
+ * SYNOPSYS
+ * 	maps size bytes of s->memfd
+ *  returns 0 or -1 (error)
+ */
+static int otpshm_map(otpshm *s, size_t size)
+{
+	void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, s->memfd, 0);
+	if (base == MAP_FAILED) {
+		perror("mmap() ring");
+		return -1;
+	}
+	s->ring = (otpshm_ring *) base;
+	s->size = size;
+	return 0;
+}
+
+
+/* NAME
+ *  otpshm_create
+ * SYNOPSYS
+ * 	client: makes a ring of OTPSHM_SLOTS slots of maxlen characters
+ *  and its eventfds
+ *  returns 0 or -1 (error, nothing left open)
+ */
+int otpshm_create(otpshm *s, size_t maxlen)
+{
+	memset(s, 0, sizeof(*s));
+	s->memfd = s->reqfd = s->donefd = -1;
+	if (maxlen == 0 || maxlen > OTPSHM_MAXLEN) {
+		fprintf(stderr, "Error: Ring slot size must be 1 to %d characters.\n", OTPSHM_MAXLEN);
+		return -1;
+	}
+	s->nslots = OTPSHM_SLOTS;
+	s->maxlen = maxlen;
+	s->stride = otpshm_stride(maxlen);
+	size_t size = sizeof(otpshm_ring) + s->nslots * s->stride;
+
+	s->memfd = memfd_create("otpshm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (s->memfd == -1) {
+		perror("memfd_create()");
+		return -1;
+	}
+	if (ftruncate(s->memfd, size) == -1 || fcntl(s->memfd, F_ADD_SEALS, SEALS) == -1) {
+		perror("ftruncate() ring");
+		otpshm_close(s);
+		return -1;
+	}
+	s->reqfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	s->donefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (s->reqfd == -1 || s->donefd == -1) {
+		perror("eventfd()");
+		otpshm_close(s);
+		return -1;
+	}
+	if (otpshm_map(s, size) == -1) {
+		otpshm_close(s);
+		return -1;
+	}
+
+	s->ring->magic = OTPSHM_MAGIC;
+	s->ring->nslots = s->nslots;
+	s->ring->maxlen = s->maxlen;
+	return 0;
+}
+
+
+/* NAME
+ *  otpshm_attach
+ * SYNOPSYS
+ * 	daemon: takes over the memfd, reqfd and donefd in fds (closed on
+ *  failure) and checks the region is sealed and as large as its
+ *  header says
+ *  returns 0 or -1 (error)
+ */
+int otpshm_attach(otpshm *s, int fds[3])
+{
+	memset(s, 0, sizeof(*s));
+	s->memfd = fds[0];
+	s->reqfd = fds[1];
+	s->donefd = fds[2];
+
+	// without the seals the client could truncate the region while
+	// we use it, and the daemon would die of SIGBUS
+	struct stat st;
+	int seals = fcntl(s->memfd, F_GET_SEALS);
+	if (seals == -1 || (seals & SEALS) != SEALS || fstat(s->memfd, &st) == -1
+			|| (size_t) st.st_size < sizeof(otpshm_ring)) {
+		fprintf(stderr, "Error: Invalid ring.\n");
+		otpshm_close(s);
+		return -1;
+	}
+	if (otpshm_map(s, st.st_size) == -1) {
+		otpshm_close(s);
+		return -1;
+	}
+
+	// geometry is read once and kept; the client may scribble on it
+	otpshm_ring *r = s->ring;
+	s->nslots = r->nslots;
+	s->maxlen = r->maxlen;
+	if (r->magic != OTPSHM_MAGIC || s->nslots == 0 || s->nslots > OTPSHM_SLOTS
+			|| s->maxlen == 0 || s->maxlen > OTPSHM_MAXLEN
+			|| sizeof(otpshm_ring) + s->nslots * otpshm_stride(s->maxlen) > s->size) {
+		fprintf(stderr, "Error: Invalid ring.\n");
+		otpshm_close(s);
+		return -1;
+	}
+	s->stride = otpshm_stride(s->maxlen);
+	return 0;
+}
+
+
+/* NAME
+ *  otpshm_close
+ * SYNOPSYS
+ * 	unmaps the ring and closes its descriptors
+ */
+void otpshm_close(otpshm *s)
+{
+	if (s->ring)
+		munmap(s->ring, s->size);
+	if (s->memfd >= 0)
+		close(s->memfd);
+	if (s->reqfd >= 0)
+		close(s->reqfd);
+	if (s->donefd >= 0)
+		close(s->donefd);
+	memset(s, 0, sizeof(*s));
+	s->memfd = s->reqfd = s->donefd = -1;
+}
+
+
+/* NAME
+ *  otpshm_slotat
+ * SYNOPSYS
+ * 	slot of request number seq
+ */
+otpshm_slot * otpshm_slotat(otpshm *s, uint64_t seq)
+{
+	return (otpshm_slot *) ((char *) (s->ring + 1) + (seq % s->nslots) * s->stride);
+}
+
+
+/* NAME
+ *  otpshm_key
+ * SYNOPSYS
+ * 	key area of slot
+ */
+char * otpshm_key(otpshm *s, otpshm_slot *slot)
+{
+	return slot->data + s->maxlen + 1;
+}
+
+
+/* NAME
+ *  otpshm_signal
+ * SYNOPSYS
+ * 	wakes the other side waiting on eventfd efd
+ */
+void otpshm_signal(int efd)
+{
+	uint64_t one = 1;
+	while (write(efd, &one, sizeof(one)) == -1 && errno == EINTR)
+		;
+}
+
+
+/* NAME
+ *  otpshm_clear
+ * SYNOPSYS
+ * 	resets eventfd efd after a wakeup
+ */
+void otpshm_clear(int efd)
+{
+	uint64_t n;
+	while (read(efd, &n, sizeof(n)) == -1 && errno == EINTR)
+		;
+}
@@ -0,0 +1,86 @@
+#ifndef OTPSHM_H
+#define OTPSHM_H
+
+
+/*
+ * otpshm.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * shared memory ring transport (header file)
+ *
+ * a same-host client connected over a unix socket may hand the daemon
+ * a memfd holding a ring of request slots and two eventfds. The client
+ * writes input and key into a slot and signals reqfd; the daemon
+ * encodes the slot in place and signals donefd. The socket itself only
+ * carries the handshake and tells each side when the other has gone.
+ *
+ * one producer and one consumer per ring: head is written only by the
+ * client, tail only by the daemon. Everything else in the region is
+ * client memory, so the daemon keeps its own copy of the geometry and
+ * reads each slot's length once.
+ */
+
+
+/* LIBRARIES */
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* MACROS */
+#define OTPSHM_MAGIC 0x4F545052			// "OTPR"
+#define OTPSHM_SLOTS 4					// requests in flight per ring
+#define OTPSHM_MAXLEN (64 * 1024 * 1024)	// largest slot the daemon maps
+#define OTPSHM_ID " shm"				// appended to the handshake id
+
+
+/* STRUCTS AND ENUMS */
+// result of a slot, set by the daemon
+typedef enum otpshm_status {SHM_OK, SHM_ECHARS, SHM_ESIZE, SHM_EREUSE, SHM_ERATE} otpshm_status;
+
+// start of the region, one cache line per writer
+typedef struct otpshm_ring {
+	uint32_t magic;
+	uint32_t nslots;
+	uint64_t maxlen;					// characters per slot
+	char pad0[48];
+	uint64_t head;						// requests submitted, client writes
+	char pad1[56];
+	uint64_t tail;						// requests completed, daemon writes
+	char pad2[56];
+} otpshm_ring;
+
+// one request; input at data, key at data + maxlen + 1, result
+// replaces input
+typedef struct otpshm_slot {
+	uint64_t len;
+	int32_t status;
+	int32_t pad;
+	char data[];
+} otpshm_slot;
+
+// either side's view of a ring
+typedef struct otpshm {
+	otpshm_ring *ring;
+	size_t size;						// bytes mapped
+	uint32_t nslots;					// geometry, private copies
+	size_t maxlen;
+	size_t stride;						// bytes per slot
+	int memfd;
+	int reqfd;							// eventfd, client -> daemon
+	int donefd;							// eventfd, daemon -> client
+} otpshm;
+
+
+/* FUNCTION DECLARATIONS */
+int otpshm_create(otpshm *s, size_t maxlen);
+int otpshm_attach(otpshm *s, int fds[3]);
+void otpshm_close(otpshm *s);
+otpshm_slot * otpshm_slotat(otpshm *s, uint64_t seq);
+char * otpshm_key(otpshm *s, otpshm_slot *slot);
+void otpshm_signal(int efd);
+void otpshm_clear(int efd);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * otptrace.c
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * per-request phase tracing
+ *
+ * the ring is written lock-free: each event claims a slot with an
+ * atomic increment, so client threads and the signal handler need
+ * no locking. Dumps write the last OTPTRACE_RING events, oldest first.
+ */
+
+
+/* LIBRARIES */
+#include "otptrace.h"
+
+#ifdef OTP_TRACE
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+/* GLOBAL VARIABLES */
+static otptrace_rec ring[OTPTRACE_RING];
+static uint64_t head = 0;				// total events recorded
+static uint32_t nextreq = 0;
+static __thread uint32_t curreq = 0;	// request being traced by this thread
+static uint32_t mypid = 0;
+static int initialized = 0;
+static const char *dumpdir = "/tmp";
+
+
+/* FUNCTION DEFINITIONS */
+/* NAME
+ *  otptrace_catch
+ * SYNOPSYS
+ * 	SIGUSR1 handler, dumps ring (open / write only, async-signal-safe)
+ */
+static void otptrace_catch(int signo)
+{
+	(void) signo;
+	otptrace_dump();
+}
+
+
+/* NAME
+ *  otptrace_init
+ * SYNOPSYS
+ * 	installs SIGUSR1 and exit dumps, once per process
+ */
+void otptrace_init()
+{
+	if (__atomic_exchange_n(&initialized, 1, __ATOMIC_ACQ_REL))
+		return;
+	mypid = getpid();
+	if (getenv("OTP_TRACE_DIR"))
+		dumpdir = getenv("OTP_TRACE_DIR");
+	atexit(otptrace_dump);
+
+	struct sigaction SIGUSR1_action = {0};
+	SIGUSR1_action.sa_handler = otptrace_catch;
+	sigfillset(&SIGUSR1_action.sa_mask);
+	SIGUSR1_action.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &SIGUSR1_action, NULL);
+}
+
+
+/* NAME
+ *  otptrace_fork
+ * SYNOPSYS
+ * 	called in a forked child: forget the parent's events
+ */
+void otptrace_fork()
+{
+	mypid = getpid();
+	__atomic_store_n(&head, 0, __ATOMIC_RELAXED);
+	nextreq = 0;
+}
+
+
+/* NAME
+ *  otptrace_newreq
+ * SYNOPSYS
+ * 	starts a new request on the calling thread
+ */
+void otptrace_newreq()
+{
+	curreq = __atomic_add_fetch(&nextreq, 1, __ATOMIC_RELAXED);
+}
+
+
+/* NAME
+ *  otptrace_now
+ * SYNOPSYS
+ * 	monotonic timestamp in nanoseconds
+ */
+uint64_t otptrace_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/* NAME
+ *  otptrace_event
+ * SYNOPSYS
+ * 	records an event for the current request
+ */
+void otptrace_event(otptrace_ev ev, uint64_t ts, uint64_t arg)
+{
+	uint64_t slot = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+	otptrace_rec *r = &ring[slot & (OTPTRACE_RING - 1)];
+
+	r->ts = ts;
+	r->arg = arg;
+	r->pid = mypid ? mypid : (uint32_t) getpid();
+	r->req = curreq;
+	r->ev = ev;
+	r->pad = 0;
+}
+
+
+/* NAME
+ *  otptrace_dump
+ * SYNOPSYS
+ * 	writes magic word and ring contents to $OTP_TRACE_DIR/otptrace.<pid>
+ */
+void otptrace_dump()
+{
+	uint64_t n = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+	if (n == 0)
+		return;
+
+	// build path without stdio, this may run in a signal handler
+	char path[256];
+	const char *dir = dumpdir;
+	char digits[16];
+	int nd = 0;
+	uint32_t pid = getpid();
+	do {
+		digits[nd++] = '0' + pid % 10;
+		pid = pid / 10;
+	} while (pid > 0);
+	size_t len = strlen(dir);
+	if (len > sizeof(path) - 32)
+		return;
+	memcpy(path, dir, len);
+	memcpy(path + len, "/otptrace.", 10);
+	len = len + 10;
+	while (nd > 0)
+		path[len++] = digits[--nd];
+	path[len] = '\0';
+
+	// a fresh file of our own: the default directory is shared, so
+	// never follow a link or write into a file someone else made
+	unlink(path);
+	int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (fd == -1)
+		return;
+
+	uint32_t magic = OTPTRACE_MAGIC;
+	write(fd, &magic, sizeof(magic));
+
+	// oldest first; once the ring has wrapped, start at the slot after head
+	uint64_t first = (n > OTPTRACE_RING) ? n - OTPTRACE_RING : 0;
+	uint64_t start = first & (OTPTRACE_RING - 1);
+	uint64_t count = n - first;
+	uint64_t tail = OTPTRACE_RING - start;
+	if (tail > count)
+		tail = count;
+	write(fd, &ring[start], tail * sizeof(otptrace_rec));
+	write(fd, &ring[0], (count - tail) * sizeof(otptrace_rec));
+
+	close(fd);
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef OTPTRACE_H
+#define OTPTRACE_H
+
+
+/*
+ * otptrace.h
+ * Alice O'Herin
+ * Oct 19, 2026
+ */
+
+/*
+ * per-request phase tracing (header file)
+ *
+ * probes record timestamped events into a per-process ring buffer,
+ * which is dumped to $OTP_TRACE_DIR/otptrace.<pid> (default /tmp) on
+ * SIGUSR1 and at exit, always as a new file, never through a link;
+ * otp_trace prints the dumps as per-request
+ * timelines. Probes compile out completely unless built with
+ * -DOTP_TRACE.
+ */
+
+
+/* LIBRARIES */
+#include <stdint.h>
+
+
+/* MACROS */
+#define OTPTRACE_RING 65536				// events kept per process (power of 2)
+#define OTPTRACE_MAGIC 0x4F545452		// "OTTR", first word of a dump
+
+
+/* STRUCTS AND ENUMS */
+// each event marks the end of a phase; the phase began at the previous event
+typedef enum otptrace_ev {
+	TR_ACCEPT,							// daemon: connection accepted
+	TR_ID,								// daemon: id received
+	TR_HANDSHAKE,						// daemon: id verified, OK sent
+	TR_RECV_IN,							// daemon: plaintext / ciphertext received
+	TR_RECV_KEY,						// daemon: key received
+	TR_VALIDATE,						// daemon: characters and length checked
+	TR_CODEC,							// daemon: encode / decode done
+	TR_SEND,							// daemon: reply sent
+	TR_C_START,							// client: request started
+	TR_C_CONNECT,						// client: connection ready (pooled or new)
+	TR_C_SEND_IN,						// client: input sent
+	TR_C_SEND_KEY,						// client: key sent
+	TR_C_RECV,							// client: reply received
+	TR_NEVENTS
+} otptrace_ev;
+
+// one event as stored in the ring and in dump files
+typedef struct otptrace_rec {
+	uint64_t ts;						// CLOCK_MONOTONIC, nanoseconds
+	uint64_t arg;						// event specific, usually a byte count
+	uint32_t pid;
+	uint32_t req;						// request number within process
+	uint32_t ev;
+	uint32_t pad;
+} otptrace_rec;
+
+
+/* FUNCTION DECLARATIONS */
+#ifdef OTP_TRACE
+void otptrace_init();
+void otptrace_fork();
+void otptrace_newreq();
+uint64_t otptrace_now();
+void otptrace_event(otptrace_ev ev, uint64_t ts, uint64_t arg);
+void otptrace_dump();
+
+#define TRACE_INIT() otptrace_init()
+#define TRACE_FORK() otptrace_fork()
+#define TRACE_REQ() otptrace_newreq()
+#define TRACE(ev, arg) otptrace_event((ev), otptrace_now(), (arg))
+#define TRACE_STAMP(var) uint64_t var = otptrace_now()
+#define TRACE_AT(ev, var, arg) otptrace_event((ev), (var), (arg))
+#else
+#define TRACE_INIT() ((void) 0)
+#define TRACE_FORK() ((void) 0)
+#define TRACE_REQ() ((void) 0)
+#define TRACE(ev, arg) ((void) 0)
+#define TRACE_STAMP(var)
+#define TRACE_AT(ev, var, arg) ((void) 0)
+#endif
+
+#endif